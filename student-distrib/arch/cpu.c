@@ -0,0 +1,56 @@
+#include "cpu.h"
+
+#include "../lib/lib.h"
+
+cpu_t cpus[MAX_CPUS];
+
+/* switch.S and the entry code reach these fields through %fs */
+typedef char cpu_offsets_match[
+    (__builtin_offsetof(cpu_t, self) == CPU_SELF
+  && __builtin_offsetof(cpu_t, lock_depth) == CPU_LOCK_DEPTH
+  && __builtin_offsetof(cpu_t, tss) + __builtin_offsetof(tss_t, esp0) == CPU_TSS_ESP0) ? 1 : -1];
+
+/* cpu_init
+ * DESCRIPTION:         gives a CPU its own copy of the GDT, whose TSS entry
+ *                      points at the CPU's TSS and whose KERNEL_PERCPU entry
+ *                      covers its cpu_t, and loads them (GDTR, TR, LDTR, %fs)
+ * INPUTS:              cpu -- the CPU's cpu_t, must be the running CPU's
+ *                      id -- its index into cpus[]
+ * NOTES:               the boot CPU's TSS starts as a copy of the boot TSS,
+ *                      so esp0 stays valid
+ */
+void cpu_init(cpu_t* cpu, uint32_t id){
+    cpu->self = cpu;
+    cpu->id = id;
+
+    memcpy(cpu->gdt, gdt, sizeof(cpu->gdt));
+    cpu->tss = tss;
+
+    // Same TSS descriptor, based at this CPU's TSS (and not busy yet)
+    seg_desc_t* tss_desc = &cpu->gdt[KERNEL_TSS >> 3];
+    *tss_desc = tss_desc_ptr;
+    tss_desc->type = 0x9;
+    SET_TSS_PARAMS((*tss_desc), &cpu->tss, tss_size);
+
+    // Byte granular read/write data segment covering just the cpu_t
+    seg_desc_t* percpu = &cpu->gdt[KERNEL_PERCPU >> 3];
+    percpu->val[0] = 0;
+    percpu->val[1] = 0;
+    percpu->granularity = 0x0;
+    percpu->opsize      = 0x1;
+    percpu->present     = 0x1;
+    percpu->dpl         = 0x0;
+    percpu->sys         = 0x1;
+    percpu->type        = 0x2;
+    SET_LDT_PARAMS((*percpu), cpu, sizeof(cpu_t) - 1);
+
+    struct {
+        uint16_t limit;
+        uint32_t base;
+    } __attribute__((packed)) gdtr = {sizeof(cpu->gdt) - 1, (uint32_t)cpu->gdt};
+
+    asm volatile ("lgdt %0" : : "m"(gdtr) : "memory");
+    asm volatile ("movw %w0, %%fs" : : "r"(KERNEL_PERCPU) : "memory");
+    ltr(KERNEL_TSS);
+    lldt(KERNEL_LDT);
+}
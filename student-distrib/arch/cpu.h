@@ -0,0 +1,58 @@
+#ifndef _CPU_H
+#define _CPU_H
+
+#include "../lib/types.h"
+
+/* Most CPUs brought up (the run queue bitmaps have room for 32) */
+#define MAX_CPUS            8
+
+/* Offsets into cpu_t used from assembly (checked in cpu.c) */
+#define CPU_SELF            0
+#define CPU_LOCK_DEPTH      8
+#define CPU_TSS_ESP0        16
+
+#ifndef ASM
+
+#include "x86_desc.h"
+
+/* Everything that is per CPU. Each CPU's %fs selects a segment based at
+ * its own cpu_t, so this_cpu() is a single load */
+typedef struct cpu {
+    struct cpu* self;           // Linear address of this struct
+    uint32_t id;                // Index into cpus[], 0 is the boot CPU
+    uint32_t lock_depth;        // Kernel lock nesting (see smp.c)
+    tss_t tss;                  // This CPU's TSS (only esp0/ss0 matter)
+
+    uint32_t apic_id;
+    volatile int online;        // Set once the CPU runs the scheduler
+
+    // Scheduler state of the context running on this CPU
+    uint32_t current_pid;       // The running task (active_pid, see process.h)
+    volatile int idling;        // Running the idle context (see scheduler.c)
+    uint32_t fpu_owner;         // Whose state the FPU registers hold
+
+    seg_desc_t gdt[GDT_ENTRIES];
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+
+/* this_cpu
+ * RETURNS:             the running CPU's cpu_t
+ * NOTES:               volatile so it is never cached across a context
+ *                      switch, which may move the caller to another CPU
+ */
+static inline cpu_t* this_cpu(void) {
+    cpu_t* cpu;
+    asm volatile ("movl %%fs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+/* Index of the running CPU */
+#define cpu_id()            (this_cpu()->id)
+
+/* Loads a CPU's own GDT, TSS and %fs */
+void cpu_init(cpu_t* cpu, uint32_t id);
+
+#endif /* ASM */
+
+#endif /* _CPU_H */
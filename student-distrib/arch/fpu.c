@@ -0,0 +1,191 @@
+#include "fpu.h"
+
+#include "cpu.h"
+#include "smp.h"
+#include "../lib/lib.h"
+#include "../tasks/process.h"
+
+#define CR0_MP              0x00000002  // WAIT/FWAIT honour TS
+#define CR0_EM              0x00000004  // Emulate (trap) every FPU instruction
+#define CR0_TS              0x00000008  // Task switched, FPU use traps
+#define CR0_NE              0x00000020  // Native x87 error reporting
+#define CR4_OSFXSR          0x00000200  // FXSAVE/FXRSTOR and SSE
+#define CR4_OSXMMEXCPT      0x00000400  // Unmasked SIMD exceptions raise #XM
+
+#define CPUID_EDX_FXSR      (1 << 24)
+#define CPUID_EDX_SSE       (1 << 25)
+
+#define MXCSR_DEFAULT       0x1F80      // All SIMD exceptions masked
+
+/* The FPU registers hold the state of fpu_owner (if it is a valid PID),
+ * every other task's state is in its PCB. CR0.TS is set whenever the
+ * running task isn't the owner, so its first FPU instruction traps.
+ * Each CPU has its own registers, and so its own owner */
+#define fpu_owner (this_cpu()->fpu_owner)
+static int has_fxsr = 0;
+static int has_sse = 0;
+
+static inline uint32_t get_cr0(void){
+    uint32_t cr0;
+    asm volatile ("movl %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void set_cr0(uint32_t cr0){
+    asm volatile ("movl %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+static inline void clts(void){
+    asm volatile ("clts" : : : "memory");
+}
+
+static inline void stts(void){
+    set_cr0(get_cr0() | CR0_TS);
+}
+
+/* fpu_save
+ * DESCRIPTION:         stores the FPU registers into a save area
+ * NOTES:               FNSAVE also reinitializes the FPU, FXSAVE doesn't
+ */
+static void fpu_save(uint8_t* area){
+    if(has_fxsr) asm volatile ("fxsave (%0)" : : "r"(area) : "memory");
+    else asm volatile ("fnsave (%0)" : : "r"(area) : "memory");
+}
+
+/* fpu_restore
+ * DESCRIPTION:         loads the FPU registers from a save area
+ */
+static void fpu_restore(uint8_t* area){
+    if(has_fxsr) asm volatile ("fxrstor (%0)" : : "r"(area) : "memory");
+    else asm volatile ("frstor (%0)" : : "r"(area) : "memory");
+}
+
+/* init_fpu
+ * DESCRIPTION:         enables the x87 FPU, and SSE through FXSAVE if the
+ *                      CPU has it, leaving TS set so no task owns it yet
+ */
+void init_fpu(void){
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    has_fxsr = (edx & CPUID_EDX_FXSR) != 0;
+    has_sse = has_fxsr && (edx & CPUID_EDX_SSE);
+
+    set_cr0((get_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+
+    if(has_fxsr){
+        uint32_t cr4;
+        asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR;
+        if(has_sse) cr4 |= CR4_OSXMMEXCPT;
+        asm volatile ("movl %0, %%cr4" : : "r"(cr4));
+    }
+
+    asm volatile ("fninit");
+    stts();
+}
+
+/* fpu_has_sse
+ * RETURNS:             1 if user programs may use SSE
+ */
+int fpu_has_sse(void){
+    return has_sse;
+}
+
+/* fpu_switch
+ * DESCRIPTION:         arms the FPU trap for a task about to run
+ * INPUTS:              pid -- the task
+ */
+void fpu_switch(pid_t pid){
+    if(pid == fpu_owner) clts();
+    else stts();
+}
+
+/* fpu_switch_out
+ * DESCRIPTION:         with more than one CPU online, saves the FPU state of
+ *                      the task being switched away from, since it may next
+ *                      run on a CPU whose registers don't hold it
+ * NOTES:               on one CPU the state stays in the registers until
+ *                      another task traps (the lazy case)
+ */
+void fpu_switch_out(void){
+    if(smp_num_cpus() < 2 || fpu_owner != active_pid) return;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    if(pcb != NULL){
+        clts();
+        fpu_save(FPU_STATE(&pcb->fpu));
+    }
+    fpu_owner = (unsigned)-1;
+    stts();
+}
+
+/* do_fpu_trap
+ * DESCRIPTION:         Device Not Available handler: saves the owner's FPU
+ *                      state and loads the active task's (or a clean state
+ *                      on its first use)
+ * RETURNS:             0 if handled, -1 if there is no task to give the FPU
+ */
+int do_fpu_trap(void){
+    pcb_t* pcb = get_pcb(active_pid);
+    if(pcb == NULL) return -1;
+
+    clts();
+    if(fpu_owner == active_pid) return 0;
+
+    pcb_t* owner = get_pcb(fpu_owner);
+    if(owner != NULL) fpu_save(FPU_STATE(&owner->fpu));
+
+    if(pcb->flags & TASK_USED_FPU){
+        fpu_restore(FPU_STATE(&pcb->fpu));
+    }
+    else{
+        asm volatile ("fninit");
+        if(has_sse){
+            uint32_t mxcsr = MXCSR_DEFAULT;
+            asm volatile ("ldmxcsr %0" : : "m"(mxcsr));
+        }
+        pcb->flags |= TASK_USED_FPU;
+    }
+
+    fpu_owner = active_pid;
+    return 0;
+}
+
+/* fpu_fork
+ * DESCRIPTION:         gives a forked child a copy of its parent's FPU state
+ * INPUTS:              parent, child -- the tasks (the child's PCB is
+ *                      already a copy of the parent's)
+ */
+void fpu_fork(pid_t parent, pid_t child){
+    pcb_t* parent_pcb = get_pcb(parent);
+    pcb_t* child_pcb = get_pcb(child);
+    if(parent_pcb == NULL || child_pcb == NULL) return;
+    if(!(parent_pcb->flags & TASK_USED_FPU)) return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    // The parent's latest state may only be in the registers
+    if(fpu_owner == parent){
+        clts();
+        fpu_save(FPU_STATE(&parent_pcb->fpu));
+        if(!has_fxsr) fpu_restore(FPU_STATE(&parent_pcb->fpu));
+    }
+
+    // The two PCBs may sit at different offsets from 16-byte alignment
+    memcpy(FPU_STATE(&child_pcb->fpu), FPU_STATE(&parent_pcb->fpu), FPU_STATE_SIZE);
+    child_pcb->flags |= TASK_USED_FPU;
+
+    restore_flags(flags);
+}
+
+/* fpu_release
+ * DESCRIPTION:         forgets the FPU state of a task that is going away
+ * INPUTS:              pid -- the task
+ */
+void fpu_release(pid_t pid){
+    if(pid == fpu_owner){
+        fpu_owner = (unsigned)-1;
+        stts();
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "../lib/types.h"
+
+#define DEVICE_NA_VEC       7
+
+/* FXSAVE needs 512 bytes, 16-byte aligned (FNSAVE fits in the same area) */
+#define FPU_STATE_SIZE      512
+#define FPU_STATE_ALIGN     16
+
+/* Storage for a task's FPU state, use FPU_STATE to get the aligned area */
+typedef struct {
+    uint8_t raw[FPU_STATE_SIZE + FPU_STATE_ALIGN - 1];
+} fpu_state_t;
+
+#define FPU_STATE(state) \
+    ((uint8_t*)(((uint32_t)(state)->raw + FPU_STATE_ALIGN - 1) & ~(FPU_STATE_ALIGN - 1)))
+
+/* Enables the FPU (and SSE if present) with lazy switching */
+void init_fpu(void);
+int fpu_has_sse(void);
+
+/* Called on every switch to a task, traps its first FPU use */
+void fpu_switch(uint32_t pid);
+void fpu_switch_out(void);
+
+/* Device Not Available handler, loads the active task's FPU state */
+int do_fpu_trap(void);
+
+/* Task lifetime */
+void fpu_fork(uint32_t parent, uint32_t child);
+void fpu_release(uint32_t pid);
+
+#endif /* _FPU_H */
@@ -0,0 +1,295 @@
+#include "mpconfig.h"
+
+#include "../lib/lib.h"
+#include "../memory/paging.h"
+
+/* Kernel page in the low page table that firmware memory is read through
+ * (below the IOAPIC's and local APIC's pages) */
+#define FIRMWARE_WINDOW     0x003FD000
+#define WINDOW_SIZE         0x1000
+
+/* Where the firmware may leave its tables */
+#define BDA_EBDA_SEGMENT    0x40E       // Real mode segment of the EBDA
+#define EBDA_SCAN_SIZE      0x400
+#define BIOS_AREA_START     0x000E0000
+#define BIOS_AREA_END       0x00100000
+#define SCAN_ALIGN          16
+
+/* ACPI: RSDP -> RSDT -> MADT ("APIC") */
+#define RSDP_SIZE           20
+#define RSDP_RSDT           16
+#define ACPI_HEADER_SIZE    36
+#define ACPI_LENGTH         4
+#define MADT_ENTRIES        44
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_OVERRIDE       2
+#define MADT_LAPIC_ENABLED  0x1
+
+/* MP specification: floating pointer -> configuration table */
+#define MPF_SIZE            16
+#define MPF_CONFIG          4
+#define MPC_HEADER_SIZE     44
+#define MPC_LENGTH          4
+#define MPC_COUNT           34
+#define MPC_PROCESSOR       0
+#define MPC_BUS             1
+#define MPC_IOAPIC          2
+#define MPC_IOINT           3
+#define MPC_PROCESSOR_SIZE  20
+#define MPC_ENTRY_SIZE      8
+#define MPC_ENABLED         0x1
+#define MPC_INT_VECTORED    0
+
+/* Every chipset with an IOAPIC wires the ISA timer to pin 2 */
+#define ISA_TIMER_GSI       2
+
+/* Tables are only read this far */
+#define MAX_TABLE_SIZE      0x1000
+
+static mp_config_t config;
+static uint8_t table[MAX_TABLE_SIZE];
+
+static inline uint16_t get16(const uint8_t* p){
+    return *(const uint16_t*)p;
+}
+
+static inline uint32_t get32(const uint8_t* p){
+    return *(const uint32_t*)p;
+}
+
+/* phys_read
+ * DESCRIPTION:         copies physical memory outside of the kernel's
+ *                      mappings, a page at a time through the window
+ * INPUTS:              dst -- where to copy to
+ *                      phys -- physical address to copy from
+ *                      len -- number of bytes
+ */
+static void phys_read(void* dst, uint32_t phys, uint32_t len){
+    uint8_t* out = dst;
+
+    while(len > 0){
+        uint32_t offset = phys & (WINDOW_SIZE - 1);
+        uint32_t chunk = min(len, WINDOW_SIZE - offset);
+
+        map_kernel_mmio(FIRMWARE_WINDOW, phys - offset);
+        memcpy(out, (void*)(FIRMWARE_WINDOW + offset), chunk);
+
+        out += chunk;
+        phys += chunk;
+        len -= chunk;
+    }
+}
+
+/* checksum
+ * RETURNS:             the byte sum of a table, 0 if it is intact
+ */
+static uint8_t checksum(const uint8_t* p, uint32_t len){
+    uint8_t sum = 0;
+    while(len-- > 0) sum += *p++;
+    return sum;
+}
+
+/* scan
+ * DESCRIPTION:         looks for a structure that starts with sig on a
+ *                      16-byte boundary, and whose len bytes sum to 0
+ * INPUTS:              start, end -- physical range to search
+ * RETURNS:             its physical address, 0 if not found
+ */
+static uint32_t scan(uint32_t start, uint32_t end, const char* sig, uint32_t len){
+    uint8_t found[RSDP_SIZE];
+    uint32_t sig_len = strlen((int8_t*)sig);
+    uint32_t page, addr;
+
+    for(page = start & ~(WINDOW_SIZE - 1); page < end; page += WINDOW_SIZE){
+        phys_read(table, page, WINDOW_SIZE);
+        for(addr = max(page, start); addr < min(page + WINDOW_SIZE, end); addr += SCAN_ALIGN){
+            if(strncmp((int8_t*)table + (addr - page), (int8_t*)sig, sig_len) != 0) continue;
+
+            // May run into the next page
+            phys_read(found, addr, len);
+            if(checksum(found, len) == 0) return addr;
+        }
+    }
+    return 0;
+}
+
+/* find
+ * DESCRIPTION:         searches the first KB of the EBDA, then the BIOS
+ *                      area below 1MB
+ * RETURNS:             physical address of the structure, 0 if not found
+ */
+static uint32_t find(const char* sig, uint32_t len){
+    uint16_t segment;
+    phys_read(&segment, BDA_EBDA_SEGMENT, sizeof(segment));
+
+    uint32_t ebda = (uint32_t)segment << 4;
+    uint32_t addr = ebda != 0 ? scan(ebda, ebda + EBDA_SCAN_SIZE, sig, len) : 0;
+    return addr != 0 ? addr : scan(BIOS_AREA_START, BIOS_AREA_END, sig, len);
+}
+
+/* read_table
+ * DESCRIPTION:         reads a table into the table buffer
+ * INPUTS:              phys -- physical address of the table
+ *                      length_offset -- where its length field is
+ *                      length_is_16 -- 1 for a 16-bit field, 0 for 32-bit
+ * RETURNS:             the number of bytes read (clipped to the buffer), 0
+ *                      if the checksum of a complete table is wrong
+ */
+static uint32_t read_table(uint32_t phys, uint32_t length_offset, int length_is_16){
+    uint32_t len = 0;
+    phys_read(&len, phys + length_offset, length_is_16 ? 2 : 4);
+
+    uint32_t size = min(len, MAX_TABLE_SIZE);
+    phys_read(table, phys, size);
+    if(size == len && checksum(table, size) != 0) return 0;
+    return size;
+}
+
+/* add_cpu
+ * DESCRIPTION:         records an enabled processor
+ */
+static void add_cpu(uint8_t apic_id){
+    if(config.num_cpus < MAX_CPUS) config.apic_ids[config.num_cpus++] = apic_id;
+}
+
+/* parse_madt
+ * DESCRIPTION:         takes the processors, IOAPIC and ISA overrides from
+ *                      the ACPI Multiple APIC Description Table
+ * RETURNS:             0 on success, -1 if there is no MADT
+ */
+static int parse_madt(void){
+    uint32_t rsdp = find("RSD PTR ", RSDP_SIZE);
+    if(rsdp == 0) return -1;
+
+    uint32_t rsdt;
+    phys_read(&rsdt, rsdp + RSDP_RSDT, sizeof(rsdt));
+
+    uint32_t rsdt_len = read_table(rsdt, ACPI_LENGTH, 0);
+    if(rsdt_len < ACPI_HEADER_SIZE || strncmp((int8_t*)table, (int8_t*)"RSDT", 4) != 0) return -1;
+
+    // The RSDT's entries are the physical addresses of the other tables
+    uint32_t i, madt = 0;
+    for(i = ACPI_HEADER_SIZE; i + 4 <= rsdt_len && madt == 0; i += 4){
+        char sig[4];
+        uint32_t addr = get32(table + i);
+        phys_read(sig, addr, sizeof(sig));
+        if(strncmp((int8_t*)sig, (int8_t*)"APIC", 4) == 0) madt = addr;
+    }
+    if(madt == 0) return -1;
+
+    uint32_t len = read_table(madt, ACPI_LENGTH, 0);
+    if(len < MADT_ENTRIES) return -1;
+
+    uint32_t off = MADT_ENTRIES;
+    while(off + 2 <= len && table[off + 1] >= 2 && off + table[off + 1] <= len){
+        uint8_t* entry = table + off;
+        switch(entry[0]){
+            case MADT_LAPIC:
+                // ACPI processor ID, APIC ID, flags
+                if(get32(entry + 4) & MADT_LAPIC_ENABLED) add_cpu(entry[3]);
+                break;
+            case MADT_IOAPIC:
+                // IOAPIC ID, reserved, address, first GSI
+                if(config.ioapic_addr == 0){
+                    config.ioapic_addr = get32(entry + 4);
+                    config.ioapic_gsi_base = get32(entry + 8);
+                }
+                break;
+            case MADT_OVERRIDE:
+                // Bus (0 is ISA), source IRQ, GSI, flags
+                if(entry[2] == 0 && entry[3] < ISA_IRQS) config.isa_gsi[entry[3]] = get32(entry + 4);
+                break;
+        }
+        off += entry[1];
+    }
+
+    config.source = "ACPI";
+    return 0;
+}
+
+/* parse_mp_table
+ * DESCRIPTION:         takes the processors, IOAPIC and ISA interrupt
+ *                      wiring from the MP specification's table, which
+ *                      older firmware has instead of ACPI
+ * RETURNS:             0 on success, -1 if there is no table
+ * NOTES:               the default configurations (no table, just a
+ *                      feature byte) are treated like having no table
+ */
+static int parse_mp_table(void){
+    uint8_t mpf[MPF_SIZE];
+    uint32_t addr = find("_MP_", MPF_SIZE);
+    if(addr == 0) return -1;
+
+    phys_read(mpf, addr, MPF_SIZE);
+    uint32_t mpc = get32(mpf + MPF_CONFIG);
+    if(mpc == 0) return -1;
+
+    uint32_t len = read_table(mpc, MPC_LENGTH, 1);
+    if(len < MPC_HEADER_SIZE || strncmp((int8_t*)table, (int8_t*)"PCMP", 4) != 0) return -1;
+
+    // Entries are sorted by type, so the buses come before the interrupts
+    uint32_t count = get16(table + MPC_COUNT);
+    uint32_t off = MPC_HEADER_SIZE;
+    uint32_t isa_bus = (unsigned)-1;
+    uint32_t i;
+    for(i = 0; i < count && off < len; i++){
+        uint8_t* entry = table + off;
+        switch(entry[0]){
+            case MPC_PROCESSOR:
+                // Type, APIC ID, version, flags
+                if(entry[3] & MPC_ENABLED) add_cpu(entry[1]);
+                off += MPC_PROCESSOR_SIZE;
+                continue;
+            case MPC_BUS:
+                // Type, bus ID, type string
+                if(strncmp((int8_t*)entry + 2, (int8_t*)"ISA", 3) == 0) isa_bus = entry[1];
+                break;
+            case MPC_IOAPIC:
+                // Type, ID, version, flags, address
+                if((entry[3] & MPC_ENABLED) && config.ioapic_addr == 0){
+                    config.ioapic_addr = get32(entry + 4);
+                }
+                break;
+            case MPC_IOINT:
+                // Type, interrupt type, flags, source bus, source IRQ,
+                // destination IOAPIC, destination pin
+                if(entry[1] == MPC_INT_VECTORED && entry[4] == isa_bus && entry[5] < ISA_IRQS){
+                    config.isa_gsi[entry[5]] = entry[7];
+                }
+                break;
+        }
+        off += MPC_ENTRY_SIZE;
+    }
+
+    config.source = "MP";
+    return 0;
+}
+
+/* mpconfig_init
+ * DESCRIPTION:         finds the processors and the IOAPIC, preferring the
+ *                      ACPI MADT over the MP table
+ * NOTES:               paging must be enabled. Without either table the
+ *                      machine is taken to be a uniprocessor PC with its
+ *                      IOAPIC (if any) at the standard address
+ */
+void mpconfig_init(void){
+    uint32_t irq;
+
+    memset(&config, 0, sizeof(config));
+    for(irq = 0; irq < ISA_IRQS; irq++){
+        config.isa_gsi[irq] = irq;
+    }
+
+    if(parse_madt() == 0 || parse_mp_table() == 0) return;
+
+    config.isa_gsi[0] = ISA_TIMER_GSI;
+    config.source = "default";
+}
+
+/* mp_config
+ * RETURNS:             the configuration found by mpconfig_init
+ */
+const mp_config_t* mp_config(void){
+    return &config;
+}
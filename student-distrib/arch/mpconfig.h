@@ -0,0 +1,25 @@
+#ifndef _MPCONFIG_H
+#define _MPCONFIG_H
+
+#include "../lib/types.h"
+#include "cpu.h"
+
+/* ISA IRQs, the ones an interrupt source override can move */
+#define ISA_IRQS            16
+
+/* What the firmware says about the machine's processors and interrupt
+ * routing, from the ACPI MADT or else the MP configuration table */
+typedef struct {
+    const char* source;             // "ACPI", "MP" or "default"
+    uint32_t num_cpus;
+    uint8_t apic_ids[MAX_CPUS];     // Enabled processors' local APIC IDs
+    uint32_t ioapic_addr;           // Physical base of the (first) IOAPIC
+    uint32_t ioapic_gsi_base;       // First global interrupt it handles
+    uint32_t isa_gsi[ISA_IRQS];     // Global interrupt each ISA IRQ is on
+} mp_config_t;
+
+/* Reads the firmware tables, falling back on a uniprocessor PC */
+void mpconfig_init(void);
+const mp_config_t* mp_config(void);
+
+#endif /* _MPCONFIG_H */
@@ -0,0 +1,252 @@
+#include "smp.h"
+
+#include "cpu.h"
+#include "fpu.h"
+#include "mpconfig.h"
+#include "../lib/lib.h"
+#include "../lib/spinlock.h"
+#include "../interrupts/apic.h"
+#include "../interrupts/pit.h"
+#include "../memory/paging.h"
+#include "../memory/memtype.h"
+#include "../scheduler/scheduler.h"
+#include "../tasks/process.h"
+
+/* The startup sequence from the MP specification: INIT, wait 10ms, then
+ * up to two STARTUPs 200us apart */
+#define INIT_DELAY_US       10000
+#define STARTUP_DELAY_US    200
+#define STARTUP_TIMEOUT_MS  100
+
+extern uint8_t smp_trampoline[];
+extern uint8_t smp_trampoline_end[];
+extern uint8_t trampoline_args[];
+
+/* trampoline.S reaches the arguments through these offsets */
+typedef char trampoline_offsets_match[
+    (__builtin_offsetof(trampoline_args_t, gdt_limit) == TRAMP_GDTR
+  && __builtin_offsetof(trampoline_args_t, cr3) == TRAMP_CR3
+  && __builtin_offsetof(trampoline_args_t, stack) == TRAMP_STACK
+  && __builtin_offsetof(trampoline_args_t, entry) == TRAMP_ENTRY
+  && __builtin_offsetof(trampoline_args_t, cpu) == TRAMP_CPU
+  && sizeof(trampoline_args_t) == TRAMP_ARGS_SIZE) ? 1 : -1];
+
+// Entries of cpus[] in use, and how many of them are running
+static uint32_t num_cpus = 1;
+static volatile uint32_t num_online = 1;
+
+// The kernel lock, held while some CPU runs kernel code. Each CPU counts
+// its own nesting in lock_depth, which switch_to keeps with the context
+static spinlock_t kernel_lock;
+static uint32_t last_holder = 0;
+
+static void ap_main(cpu_t* cpu);
+
+/* lock_kernel
+ * DESCRIPTION:         takes the kernel lock, which every kernel entry
+ *                      (interrupt, exception, system call) holds while it
+ *                      runs, so that kernel data is only touched by one CPU
+ *                      at a time. Nests
+ * NOTES:               spins with interrupts disabled: an interrupt taken
+ *                      while spinning could switch this context to another
+ *                      CPU halfway through. CPUs get it in the order they
+ *                      asked (a ticket lock), so none starves. The print functions' screen
+ *                      position is shared, it follows the lock between CPUs
+ */
+void lock_kernel(void){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    cpu_t* cpu = this_cpu();
+    if(cpu->lock_depth++ == 0){
+        spin_lock(&kernel_lock);
+
+        if(num_online > 1 && last_holder != cpu->id) load_task_screen();
+        last_holder = cpu->id;
+    }
+
+    restore_flags(flags);
+}
+
+/* unlock_kernel
+ * DESCRIPTION:         drops one level of the kernel lock, releasing it
+ *                      when the outermost holder is done
+ */
+void unlock_kernel(void){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    cpu_t* cpu = this_cpu();
+    if(cpu->lock_depth > 0 && --cpu->lock_depth == 0){
+        if(num_online > 1) save_task_screen();
+        spin_unlock(&kernel_lock);
+    }
+
+    restore_flags(flags);
+}
+
+/* smp_init_boot_cpu
+ * DESCRIPTION:         gives the boot CPU its GDT, TSS and per-CPU data, and
+ *                      the kernel lock, which the boot code keeps until it
+ *                      switches to the first task
+ * NOTES:               the boot TSS must be set up (its esp0 is kept)
+ */
+void smp_init_boot_cpu(void){
+    cpu_t* cpu = &cpus[0];
+
+    cpu->current_pid = (unsigned)-1;
+    cpu->fpu_owner = (unsigned)-1;
+    cpu->idling = 0;
+    cpu->lock_depth = 0;
+    cpu->online = 1;
+    cpu_init(cpu, 0);
+
+    spin_lock_init(&kernel_lock, "kernel");
+    lock_kernel();
+}
+
+/* boot_cpu
+ * DESCRIPTION:         sends the startup sequence to a secondary CPU and
+ *                      waits for it to come online
+ * INPUTS:              cpu -- its cpu_t, with the trampoline set up for it
+ * RETURNS:             0 on success, -1 if it didn't start
+ */
+static int boot_cpu(cpu_t* cpu){
+    uint32_t ms;
+
+    lapic_send_init(cpu->apic_id);
+    pit_delay_us(INIT_DELAY_US);
+
+    // The second STARTUP is only for CPUs that missed the first
+    lapic_send_startup(cpu->apic_id, TRAMPOLINE_ADDR >> 12);
+    pit_delay_us(STARTUP_DELAY_US);
+    if(!cpu->online) lapic_send_startup(cpu->apic_id, TRAMPOLINE_ADDR >> 12);
+
+    for(ms = 0; ms < STARTUP_TIMEOUT_MS && !cpu->online; ms++){
+        pit_delay_us(1000);
+    }
+    return cpu->online ? 0 : -1;
+}
+
+/* smp_init
+ * DESCRIPTION:         starts every other processor the firmware lists, one
+ *                      at a time, each into its scheduler's idle context
+ * NOTES:               needs the local APIC, paging and the scheduler, and
+ *                      reprograms the PIT (before the tick is started). A
+ *                      CPU that doesn't start keeps its cpus[] entry, so a
+ *                      late one can't share an entry with the next
+ */
+void smp_init(void){
+    const mp_config_t* config = mp_config();
+    uint32_t i;
+
+    if(!apic_enabled()) return;
+    cpus[0].apic_id = lapic_get_id();
+
+    // The trampoline page is identity mapped, so the code still runs once
+    // it turns paging on
+    map_kernel_mmio(TRAMPOLINE_ADDR, TRAMPOLINE_ADDR);
+    memcpy((void*)TRAMPOLINE_ADDR, smp_trampoline, smp_trampoline_end - smp_trampoline);
+
+    trampoline_args_t* args = (trampoline_args_t*)(TRAMPOLINE_ADDR + (trampoline_args - smp_trampoline));
+    args->gdt_limit = sizeof(seg_desc_t) * GDT_ENTRIES - 1;
+    args->gdt_base = (uint32_t)gdt;
+    args->cr3 = get_kernel_page_dir();
+    args->entry = (uint32_t)ap_main;
+
+    for(i = 0; i < config->num_cpus && num_cpus < MAX_CPUS; i++){
+        if(config->apic_ids[i] == cpus[0].apic_id) continue;
+
+        cpu_t* cpu = &cpus[num_cpus];
+        cpu->id = num_cpus++;
+        cpu->apic_id = config->apic_ids[i];
+        cpu->current_pid = (unsigned)-1;
+        cpu->fpu_owner = (unsigned)-1;
+        cpu->idling = 1;
+        cpu->lock_depth = 0;
+        cpu->online = 0;
+
+        // It starts out as its idle context, on the idle stack
+        args->stack = sched_idle_stack(cpu->id);
+        args->cpu = (uint32_t)cpu;
+
+        if(boot_cpu(cpu) == 0) num_online++;
+        else printf("CPU %u (APIC %u) didn't start\n", cpu->id, cpu->apic_id);
+    }
+}
+
+/* ap_main
+ * DESCRIPTION:         where a secondary CPU enters C from the trampoline:
+ *                      sets up its descriptors, PAT, FPU and local APIC,
+ *                      then becomes its scheduler's idle context
+ * INPUTS:              cpu -- its cpu_t
+ * RETURNS:             never
+ */
+static void ap_main(cpu_t* cpu){
+    cpu_init(cpu, cpu->id);
+    lidt(idt_desc_ptr);
+    memtype_init_ap();
+    init_fpu();
+    apic_ap_init();
+
+    cpu->online = 1;
+    lock_kernel();
+    idle_loop();
+}
+
+/* smp_num_cpus
+ * RETURNS:             the number of CPUs running
+ */
+uint32_t smp_num_cpus(void){
+    return num_online;
+}
+
+/* smp_online_mask
+ * RETURNS:             bit n set for every running CPU n
+ */
+uint32_t smp_online_mask(void){
+    uint32_t mask = 0;
+    uint32_t i;
+
+    for(i = 0; i < num_cpus; i++){
+        if(cpus[i].online) mask |= 1 << i;
+    }
+    return mask;
+}
+
+/* smp_send_resched
+ * DESCRIPTION:         tells another CPU that its run queue changed, waking
+ *                      it if it is idle
+ * INPUTS:              cpu -- index of the CPU (ignored if it is this one)
+ */
+void smp_send_resched(uint32_t cpu){
+    if(cpu >= num_cpus || cpu == cpu_id() || !cpus[cpu].online) return;
+    lapic_send_ipi(cpus[cpu].apic_id, APIC_RESCHED_VEC);
+}
+
+/* smp_flush_tlb_others
+ * DESCRIPTION:         has every other CPU flush its TLB
+ * NOTES:               doesn't wait for them. The caller holds the kernel
+ *                      lock, so until the interrupt lands they can only be
+ *                      in user code, where a stale vidmap entry at worst
+ *                      sends a few writes to the old buffer
+ */
+void smp_flush_tlb_others(void){
+    uint32_t i;
+
+    if(num_online < 2) return;
+    for(i = 0; i < num_cpus; i++){
+        if(i != cpu_id() && cpus[i].online) lapic_send_ipi(cpus[i].apic_id, APIC_TLB_VEC);
+    }
+}
+
+/* smp_ipi
+ * DESCRIPTION:         handles the interprocessor interrupt vectors
+ * INPUTS:              vec -- the vector
+ */
+void smp_ipi(uint32_t vec){
+    lapic_eoi();
+
+    if(vec == APIC_RESCHED_VEC) sched_resched_ipi();
+    else if(vec == APIC_TLB_VEC) flush_tlb();
+}
@@ -0,0 +1,48 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+/* Physical page secondary CPUs start on, in real mode (below 1MB) */
+#define TRAMPOLINE_ADDR     0x8000
+
+/* Offsets into trampoline_args_t used by trampoline.S (checked in smp.c) */
+#define TRAMP_GDTR          2
+#define TRAMP_CR3           8
+#define TRAMP_STACK         12
+#define TRAMP_ENTRY         16
+#define TRAMP_CPU           20
+#define TRAMP_ARGS_SIZE     24
+
+#ifndef ASM
+
+#include "../lib/types.h"
+#include "cpu.h"
+
+/* What the boot CPU leaves in the trampoline for the CPU it starts */
+typedef struct {
+    uint16_t padding;
+    uint16_t gdt_limit;         // GDTR to load before entering protected mode
+    uint32_t gdt_base;
+    uint32_t cr3;               // Page directory to turn paging on with
+    uint32_t stack;             // Initial stack
+    uint32_t entry;             // Called with cpu as its argument
+    uint32_t cpu;
+} trampoline_args_t;
+
+/* Starts the secondary CPUs the firmware lists */
+void smp_init_boot_cpu(void);
+void smp_init(void);
+uint32_t smp_num_cpus(void);
+uint32_t smp_online_mask(void);
+
+/* Interprocessor interrupts */
+void smp_send_resched(uint32_t cpu);
+void smp_flush_tlb_others(void);
+void smp_ipi(uint32_t vec);
+
+/* The kernel lock, held by whichever CPU runs kernel code */
+void lock_kernel(void);
+void unlock_kernel(void);
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
@@ -15,6 +15,10 @@
 #define USER_DS     0x002B
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
+#define KERNEL_PERCPU 0x0040    // The CPU's own cpu_t, loaded into %fs
+
+/* Entries in the GDT (each CPU has its own copy, see cpu.c) */
+#define GDT_ENTRIES 9
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
@@ -136,6 +140,7 @@ typedef struct __attribute__((packed)) tss_t {
 
 /* Some external descriptors declared in .S files */
 extern x86_desc_t gdt_desc;
+extern seg_desc_t gdt[GDT_ENTRIES];
 
 extern uint16_t ldt_desc;
 extern uint32_t ldt_size;
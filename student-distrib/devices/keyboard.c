@@ -27,10 +27,9 @@ void keyboard_init(){
 
 /* keyboard_irq
  * DESCRIPTION: Interrupt handler for PS/2 keyboard
- * INPUTS:      context -- the interrupt context (used for terminal switching)
  * RESULT: prints character to screen
  */
-void keyboard_irq(int_regs_t context){
+void keyboard_irq(void){
     // Read scancode from PS/2 port
     scancode1_t scancode = inb(PS2_DATA);
 
@@ -89,9 +88,9 @@ void keyboard_irq(int_regs_t context){
 
         // Switch terminals on ALT+F#
         if(alt && (scancode == CODE_F1 || scancode == CODE_F2 || scancode == CODE_F3)){
-            // EOI is sent within focus_terminal
-            focus_terminal(scancode - CODE_F1, context);
-            return; // Only reaches here if already focused on this terminal
+            // The switch itself happens after the EOI, in a tasklet
+            focus_terminal(scancode - CODE_F1);
+            return;
         }
 
         // If this is a normal character...
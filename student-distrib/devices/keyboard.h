@@ -5,7 +5,7 @@
 #include "../interrupts/interrupts.h"
 
 /* Functions */
-void keyboard_irq(int_regs_t context);
+void keyboard_irq(void);
 void keyboard_init(void);
 char shift_char(char c);
 char caps_char(char c);
@@ -2,6 +2,9 @@
 #include "keyboard.h"
 
 #include "../lib/types.h"
+#include "../scheduler/tick.h"
+#include "../scheduler/timer.h"
+#include "../tasks/process.h"
 
 /* Referring https://wiki.osdev.org/RTC#Setting_the_Registers */
 #define REG_A 0x8A
@@ -45,8 +48,11 @@
 /* The number of bytes rtc_bytes must always receive */
 #define WRITE_BYTES 4
 
-/* RTC driver will use file->inode for virtualized frequency
-   and file->fpos for a counter */
+/* RTC driver will use file->inode for virtualized frequency, file->deadline
+   for the last virtual interrupt and file->fpos for its fraction of a jiffy */
+#define FRAC_BITS 16
+#define FRAC_MASK ((1 << FRAC_BITS) - 1)
+
 static volatile uint32_t num_interrupts = 0;
 
 // REG_C must be read from to continue receiving interrupts
@@ -59,6 +65,32 @@ do{									\
 	sti();							\
 } while(0)
 
+/* rtc_restart
+ * DESCRIPTION: 	makes now the last virtual interrupt
+ * INPUTS: 			file -- pointer to file_t
+ */
+static void rtc_restart(file_t* file)
+{
+	// jiffies lags behind while a long one-shot tick is armed
+	tick_sync();
+	file->deadline = jiffies;
+	file->fpos = 0;
+}
+
+/* rtc_advance
+ * DESCRIPTION: 	moves the deadline on by one virtual period, in fixed
+ *					point so periods that aren't whole jiffies don't drift
+ * INPUTS: 			file -- pointer to file_t
+ */
+static void rtc_advance(file_t* file)
+{
+	uint32_t freq = (uint32_t)file->inode;
+	uint32_t frac = (uint32_t)file->fpos + ((TIMER_HZ % freq) << FRAC_BITS) / freq;
+
+	file->deadline += TIMER_HZ / freq + (frac >> FRAC_BITS);
+	file->fpos = frac & FRAC_MASK;
+}
+
 /* rtc_init
  * DESCRIPTION: 	Initializes rtc
  * SIDE EFFECTS: 	rtc interrupt enabled (slave)
@@ -108,12 +140,16 @@ int32_t rtc_open(file_t* file)
 
 	// Setting the interrupt frequency to 2Hz (in the virtualized RTC)
 	file->inode = FREQ_2Hz;
+	rtc_restart(file);
 
 	return 0;
 }
 
 /* rtc_read
- * DESCRIPTION: 	Checks if an RTC interrupt is encountered
+ * DESCRIPTION: 	Waits for the next virtual RTC interrupt (sleeping on a
+ *					kernel timer when called from a task)
+ * NOTES: 			like the real RTC, interrupts missed while the task
+ *					wasn't reading are merged into one that is already due
  * INPUTS: 			file -- pointer to file_t
  *					buf -- unused
  *					nbytes -- unused
@@ -122,14 +158,29 @@ int32_t rtc_open(file_t* file)
  */
 int32_t rtc_read(file_t* file, void* buf, int32_t nbytes)
 {
-	if(file == NULL) return -1;
-
-	// Mark the current number of interrupts
-	file->fpos = num_interrupts;
+	if(file == NULL || file->inode == 0) return -1;
+
+	// Tasks sleep on a kernel timer until one virtual period after the
+	// last interrupt, so time spent outside of read doesn't add up
+	if(active_pid <= MAX_PID){
+		tick_sync();
+		rtc_advance(file);
+		if(time_after_eq(jiffies, file->deadline)){
+			// Already due. Past it, the interrupts in between were missed
+			if(jiffies != file->deadline) rtc_restart(file);
+			return 0;
+		}
+
+		sleep_until(file->deadline);
+		return 0;
+	}
+
+	// Outside of a task (tests), count real RTC interrupts instead
+	uint32_t start = num_interrupts;
 
 	uint32_t period = (uint32_t)(FREQ_1024Hz / file->inode);
 
-	while (num_interrupts - (uint32_t)file->fpos < period);
+	while (num_interrupts - start < period);
 
 	return 0;
 }
@@ -162,6 +213,7 @@ int32_t rtc_write(file_t* file, const void* buf, int32_t nbytes)
 	if(byte_holder > FREQ_1024Hz) return -1;
 
 	file->inode = byte_holder;
+	rtc_restart(file);
 
 	/* Successful, sending number of bytes written */
 	return nbytes;
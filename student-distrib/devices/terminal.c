@@ -2,6 +2,8 @@
 
 #include "../lib/spinlock.h"
 #include "../memory/paging.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/wait.h"
 
 /* Line buffer */
 typedef struct {
@@ -9,6 +11,7 @@ typedef struct {
     uint32_t index;
     char buf[TERMINAL_BUF_SIZE];
     int reading;
+    wait_queue_t line_wait; // Readers waiting for a newline
     int terminal_x;
     int terminal_y;
 } line_buf_t;
@@ -76,7 +79,8 @@ void terminal_init(){
         terminals[active].index = 0;
         terminals[active].reading = 0;
         memset(terminals[active].buf, '\0', TERMINAL_BUF_SIZE);
-        spin_lock_init(&terminals[active].lock);
+        spin_lock_init(&terminals[active].lock, "terminal");
+        init_wait_queue(&terminals[active].line_wait);
         init_video_mem(VIDEO_PTR(active));
     }
 
@@ -149,6 +153,11 @@ int terminal_input(char c){
     // Save index changes
     terminals[active].index = index;
 
+    // A full line (or buffer) is ready for the reader
+    if(terminals[active].reading && (c == '\n' || index >= TERMINAL_BUF_SIZE)){
+        wake_up(&terminals[active].line_wait);
+    }
+
     // Print character if there was space in buffer
     if(result != -1){
         pcb_t* pcb = get_pcb(active_pid);
@@ -209,7 +218,7 @@ int32_t terminal_read(file_t* file, void* buf, int32_t n){
     pcb_t* pcb = get_pcb(active_pid);
     uint32_t term = pcb == NULL ? 0 : pcb->terminal;
 
-    // Wait for line to be done
+    // Wait for line to be done (sleeping until terminal_input wakes us)
     unsigned long flags;
     flags = spin_lock_irqsave(&terminals[term].lock);
     terminals[term].reading = 1;
@@ -218,10 +227,13 @@ int32_t terminal_read(file_t* file, void* buf, int32_t n){
     while(index < TERMINAL_BUF_SIZE &&
          (index == 0 || (index > 0 && terminals[term].buf[index - 1] != '\n')))
     {
+        prepare_to_wait(&terminals[term].line_wait);
         spin_unlock_irqrestore(&terminals[term].lock, flags);
+        schedule();
         flags = spin_lock_irqsave(&terminals[term].lock);
         index = terminals[term].index;
     }
+    finish_wait(&terminals[term].line_wait);
 
     // Find how many bytes to read
     int n_bytes = min(n, index);
@@ -0,0 +1,328 @@
+#include "apic.h"
+#include "i8259.h"
+#include "pit.h"
+
+#include "../lib/lib.h"
+#include "../memory/paging.h"
+#include "../scheduler/tick.h"
+#include "../arch/mpconfig.h"
+
+#define IA32_APIC_BASE_MSR     0x1B
+#define APIC_BASE_ENABLE       0x800
+#define APIC_BASE_ADDR_MASK    0xFFFFF000
+
+#define CPUID_EDX_APIC         (1 << 9)
+
+/* Longest timer shot, short enough that ticks * counts_per_tick can't
+ * overflow */
+#define APIC_MAX_COUNTS        0x7FFFFFFF
+
+static int active = 0;
+static uint32_t lapic_id;           // The boot CPU's, IRQs are sent to it
+static uint32_t ioapic_pins;
+static uint32_t ioapic_gsi_base;
+static uint32_t counts_per_tick = 0;
+
+static inline uint32_t lapic_read(uint32_t reg){
+    return *(volatile uint32_t*)(LAPIC_VADDR + reg);
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val){
+    *(volatile uint32_t*)(LAPIC_VADDR + reg) = val;
+}
+
+static inline uint32_t ioapic_read(uint32_t reg){
+    *(volatile uint32_t*)(IOAPIC_VADDR + IOAPIC_IOREGSEL) = reg;
+    return *(volatile uint32_t*)(IOAPIC_VADDR + IOAPIC_IOWIN);
+}
+
+static inline void ioapic_write(uint32_t reg, uint32_t val){
+    *(volatile uint32_t*)(IOAPIC_VADDR + IOAPIC_IOREGSEL) = reg;
+    *(volatile uint32_t*)(IOAPIC_VADDR + IOAPIC_IOWIN) = val;
+}
+
+/* lapic_irr
+ * RETURNS:             1 if an interrupt on vec is waiting to be delivered
+ */
+static int lapic_irr(uint32_t vec){
+    return (lapic_read(LAPIC_IRR + (vec / 32) * 0x10) >> (vec % 32)) & 1;
+}
+
+/* irq_pin
+ * RETURNS:             the IOAPIC pin an ISA IRQ is wired to (from the
+ *                      firmware's interrupt source overrides, see mpconfig.c)
+ */
+static uint32_t irq_pin(uint32_t irq){
+    return mp_config()->isa_gsi[irq] - ioapic_gsi_base;
+}
+
+/* apic_init
+ * DESCRIPTION:         enables the local APIC, routes the ISA IRQs through
+ *                      the IOAPIC (all masked) to the vectors the 8259 used,
+ *                      calibrates the APIC timer and masks the 8259
+ * RETURNS:             0 on success, -1 if the CPU has no APIC (the 8259
+ *                      stays in charge)
+ * NOTES:               paging must be enabled, the PIT must not be running,
+ *                      and mpconfig_init must have found the IOAPIC
+ */
+int apic_init(void){
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t irq;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if(!(edx & CPUID_EDX_APIC)) return -1;
+
+    uint32_t base = (uint32_t)rdmsr(IA32_APIC_BASE_MSR) & APIC_BASE_ADDR_MASK;
+    wrmsr(IA32_APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+    map_kernel_mmio(LAPIC_VADDR, base);
+
+    const mp_config_t* config = mp_config();
+    map_kernel_mmio(IOAPIC_VADDR, config->ioapic_addr != 0 ? config->ioapic_addr : IOAPIC_DEFAULT_BASE);
+    ioapic_gsi_base = config->ioapic_gsi_base;
+
+    lapic_id = lapic_read(LAPIC_ID) >> 24;
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VEC);
+
+    // Masked, edge triggered, active high, fixed delivery to this CPU
+    ioapic_pins = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+    for(irq = 0; irq < ISA_IRQS; irq++){
+        uint32_t pin = irq_pin(irq);
+        if(pin >= ioapic_pins) continue;
+        ioapic_write(IOAPIC_REDTBL(pin) + 1, lapic_id << 24);
+        ioapic_write(IOAPIC_REDTBL(pin), LVT_MASKED | (ICW2_MASTER + irq));
+    }
+
+    counts_per_tick = apic_timer_calibrate();
+    if(counts_per_tick == 0) return -1;
+
+    // From here on enable_irq and send_eoi go to the APIC
+    i8259_mask_all();
+    active = 1;
+    return 0;
+}
+
+/* apic_enabled
+ * RETURNS:             1 if interrupts are delivered through the APIC
+ */
+int apic_enabled(void){
+    return active;
+}
+
+/* lapic_eoi
+ * DESCRIPTION:         signals the end of the interrupt in service, a
+ *                      single memory write (no port I/O)
+ */
+void lapic_eoi(void){
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* lapic_get_id
+ * RETURNS:             the running CPU's local APIC ID
+ */
+uint32_t lapic_get_id(void){
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/* lapic_send_icr
+ * DESCRIPTION:         sends an interprocessor interrupt
+ * INPUTS:              apic_id -- the destination CPU
+ *                      icr -- the low half of the command (vector, delivery
+ *                             mode, level)
+ */
+static void lapic_send_icr(uint32_t apic_id, uint32_t icr){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    // The previous IPI must be on its way before the register is reused
+    while(lapic_read(LAPIC_ICR_LOW) & ICR_PENDING);
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+
+    restore_flags(flags);
+}
+
+/* lapic_send_ipi
+ * DESCRIPTION:         interrupts another CPU on a vector
+ * INPUTS:              apic_id -- the destination CPU
+ *                      vec -- the vector
+ */
+void lapic_send_ipi(uint32_t apic_id, uint32_t vec){
+    lapic_send_icr(apic_id, ICR_FIXED | vec);
+}
+
+/* lapic_send_init
+ * DESCRIPTION:         resets another CPU into its wait-for-startup state
+ *                      (asserted, then deasserted for older processors)
+ * INPUTS:              apic_id -- the destination CPU
+ */
+void lapic_send_init(uint32_t apic_id){
+    lapic_send_icr(apic_id, ICR_INIT | ICR_LEVEL_TRIGGER | ICR_ASSERT);
+    lapic_send_icr(apic_id, ICR_INIT | ICR_LEVEL_TRIGGER);
+}
+
+/* lapic_send_startup
+ * DESCRIPTION:         starts a CPU waiting after INIT in real mode at
+ *                      page:0000
+ * INPUTS:              apic_id -- the destination CPU
+ *                      page -- physical page number of the code, below 1MB
+ */
+void lapic_send_startup(uint32_t apic_id, uint32_t page){
+    lapic_send_icr(apic_id, ICR_STARTUP | page);
+}
+
+/* apic_ap_init
+ * DESCRIPTION:         enables the local APIC of a secondary CPU, with its
+ *                      timer stopped in one-shot mode (see
+ *                      apic_timer_quantum)
+ * NOTES:               the registers are at the same address on every CPU,
+ *                      each sees its own
+ */
+void apic_ap_init(void){
+    uint32_t base = (uint32_t)rdmsr(IA32_APIC_BASE_MSR);
+    wrmsr(IA32_APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VEC);
+    lapic_write(LAPIC_TIMER_DIV, APIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, APIC_TIMER_VEC);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/* apic_timer_quantum
+ * DESCRIPTION:         on a secondary CPU, arms the timer interrupt that
+ *                      ends the running task's time slice
+ * INPUTS:              ticks -- ticks from now, 0 stops the timer
+ * NOTES:               a slice that is already being timed isn't restarted,
+ *                      or a stream of wakeups could hold off preemption
+ */
+void apic_timer_quantum(uint32_t ticks){
+    if(ticks == 0) lapic_write(LAPIC_TIMER_INIT, 0);
+    else if(lapic_read(LAPIC_TIMER_CUR) == 0) lapic_write(LAPIC_TIMER_INIT, ticks * counts_per_tick);
+}
+
+/* ioapic_enable_irq
+ * DESCRIPTION:         unmasks an ISA IRQ at the IOAPIC
+ * INPUTS:              irq -- the IRQ number
+ */
+void ioapic_enable_irq(uint32_t irq){
+    if(irq >= ISA_IRQS || irq_pin(irq) >= ioapic_pins) return;
+
+    uint32_t reg = IOAPIC_REDTBL(irq_pin(irq));
+    ioapic_write(reg, ioapic_read(reg) & ~LVT_MASKED);
+}
+
+/* ioapic_disable_irq
+ * DESCRIPTION:         masks an ISA IRQ at the IOAPIC
+ * INPUTS:              irq -- the IRQ number
+ */
+void ioapic_disable_irq(uint32_t irq){
+    if(irq >= ISA_IRQS || irq_pin(irq) >= ioapic_pins) return;
+
+    uint32_t reg = IOAPIC_REDTBL(irq_pin(irq));
+    ioapic_write(reg, ioapic_read(reg) | LVT_MASKED);
+}
+
+/* apic_timer_calibrate
+ * DESCRIPTION:         measures the APIC timer's rate by letting it count
+ *                      down freely during a PIT one-shot
+ * RETURNS:             APIC timer counts per tick, 0 if it doesn't count
+ * NOTES:               busy-waits APIC_CALIBRATE_TICKS, stops the timer
+ */
+uint32_t apic_timer_calibrate(void){
+    unsigned long flags;
+    int fired = 0;
+
+    cli_and_save(flags);
+
+    lapic_write(LAPIC_TIMER_DIV, APIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | APIC_TIMER_VEC);
+
+    pit_oneshot(PIT_DIVISOR * APIC_CALIBRATE_TICKS);
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    while(!fired){
+        pit_read_count(&fired);
+    }
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    restore_flags(flags);
+    return elapsed / APIC_CALIBRATE_TICKS;
+}
+
+/* apic_timer_counts_per_tick
+ * RETURNS:             the calibrated APIC timer counts per tick
+ */
+uint32_t apic_timer_counts_per_tick(void){
+    return counts_per_tick;
+}
+
+/* apic_tick_arm
+ * DESCRIPTION:         tick device operation, starts a shot
+ * NOTES:               the timer runs in periodic mode so that, like the
+ *                      PIT, it keeps counting after it fires and the
+ *                      overshoot can be measured. tick.c re-arms it (or
+ *                      skips the stale interrupt) before it fires again
+ */
+static void apic_tick_arm(uint32_t counts){
+    lapic_write(LAPIC_TIMER_INIT, counts);
+}
+
+/* apic_tick_stop
+ * DESCRIPTION:         tick device operation, a zero initial count stops
+ *                      the timer
+ */
+static void apic_tick_stop(void){
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/* apic_tick_elapsed
+ * DESCRIPTION:         tick device operation, counts since the shot started
+ */
+static uint32_t apic_tick_elapsed(uint32_t counts, int fired){
+    uint32_t count = lapic_read(LAPIC_TIMER_CUR);
+
+    // Checked after reading, so a reload in between isn't missed
+    if(!fired && lapic_irr(APIC_TIMER_VEC)){
+        fired = 1;
+        count = lapic_read(LAPIC_TIMER_CUR);
+    }
+
+    // After firing the count restarts from counts
+    return fired ? counts + (counts - count) : counts - count;
+}
+
+/* apic_tick_pending
+ * DESCRIPTION:         tick device operation
+ */
+static int apic_tick_pending(void){
+    return lapic_irr(APIC_TIMER_VEC);
+}
+
+static tick_device_t apic_tick_device = {
+    .name = "lapic",
+    .max_counts = APIC_MAX_COUNTS,
+    .arm = apic_tick_arm,
+    .stop = apic_tick_stop,
+    .elapsed = apic_tick_elapsed,
+    .irq_pending = apic_tick_pending
+};
+
+/* apic_timer_init
+ * DESCRIPTION:         starts the scheduling clock on the APIC timer
+ * RETURNS:             0 on success, -1 if the APIC isn't active (the PIT
+ *                      must be used instead)
+ */
+int apic_timer_init(void){
+    if(!active) return -1;
+
+    lapic_write(LAPIC_TIMER_DIV, APIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_TIMER_PERIODIC | APIC_TIMER_VEC);
+#if (TICKLESS == 1)
+    apic_tick_device.counts_per_tick = counts_per_tick;
+    tick_start(&apic_tick_device);
+#else
+    lapic_write(LAPIC_TIMER_INIT, counts_per_tick);
+#endif
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "../lib/types.h"
+
+/* Local APIC registers (offsets into its 4KB MMIO page) */
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080   // Task priority
+#define LAPIC_EOI           0x0B0
+#define LAPIC_SVR           0x0F0   // Spurious interrupt vector
+#define LAPIC_ISR           0x100   // In service, 8 registers 0x10 apart
+#define LAPIC_IRR           0x200   // Requested, 8 registers 0x10 apart
+#define LAPIC_ICR_LOW       0x300   // Interrupt command, writing sends
+#define LAPIC_ICR_HIGH      0x310   // Destination APIC ID in bits 24-31
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_TIMER_INIT    0x380   // Initial count, writing starts the timer
+#define LAPIC_TIMER_CUR     0x390   // Current count
+#define LAPIC_TIMER_DIV     0x3E0
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LVT_MASKED          0x10000
+#define LVT_TIMER_PERIODIC  0x20000
+#define APIC_TIMER_DIV_16   0x3
+
+/* Interrupt command bits */
+#define ICR_FIXED           0x000
+#define ICR_INIT            0x500
+#define ICR_STARTUP         0x600
+#define ICR_PENDING         0x1000  // Delivery status: not accepted yet
+#define ICR_ASSERT          0x4000
+#define ICR_LEVEL_TRIGGER   0x8000
+
+/* IOAPIC registers, reached through IOREGSEL/IOWIN */
+#define IOAPIC_IOREGSEL     0x00
+#define IOAPIC_IOWIN        0x10
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL(pin)  (0x10 + 2*(pin))
+
+#define IOAPIC_DEFAULT_BASE 0xFEC00000
+
+/* Kernel pages in the low page table the registers are mapped at */
+#define LAPIC_VADDR         0x003FF000
+#define IOAPIC_VADDR        0x003FE000
+
+/* The timer interrupts on IRQ0's vector so do_irq handles it the same,
+ * the PIT's line is masked while the APIC is active */
+#define APIC_TIMER_VEC      0x20
+#define APIC_SPURIOUS_VEC   0xFF
+
+/* Interprocessor interrupts (see smp.c) */
+#define APIC_RESCHED_VEC    0xF0    // Something was put on the run queue
+#define APIC_TLB_VEC        0xF1    // Page tables in use were changed
+
+/* Ticks the APIC timer is measured over against the PIT */
+#define APIC_CALIBRATE_TICKS 10
+
+/* Sets up the local APIC and IOAPIC and masks the 8259, -1 without an APIC */
+int apic_init(void);
+int apic_enabled(void);
+
+/* Interrupt controller operations while the APIC is active (see i8259.c) */
+void lapic_eoi(void);
+void ioapic_enable_irq(uint32_t irq);
+void ioapic_disable_irq(uint32_t irq);
+
+/* Other CPUs */
+uint32_t lapic_get_id(void);
+void lapic_send_ipi(uint32_t apic_id, uint32_t vec);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint32_t page);
+void apic_ap_init(void);
+
+/* Timer */
+uint32_t apic_timer_calibrate(void);
+uint32_t apic_timer_counts_per_tick(void);
+int apic_timer_init(void);
+void apic_timer_quantum(uint32_t ticks);
+
+#endif /* _APIC_H */
@@ -3,6 +3,7 @@
  */
 
 #include "i8259.h"
+#include "apic.h"
 #include "../lib/lib.h"
 
 /* Data ports */
@@ -18,6 +19,9 @@
 /* Offset used to address the irq vectors in slave -> 8 */
 #define IRQ_OFFSET 8
 
+/* OCW3 to read the interrupt request register */
+#define OCW3_READ_IRR 0x0A
+
 /* Interrupt masks to determine which interrupts are enabled and disabled */
 uint8_t master_mask; /* IRQs 0-7  */
 uint8_t slave_mask;  /* IRQs 8-15 */
@@ -56,6 +60,36 @@ void i8259_init(void) {
 	enable_irq(IRQ_SLAVE_LINE);
 }
 
+/** i8259_mask_all
+ * DESCRIPTION: Masks every line of both PICs, once the APIC takes over
+ * INPUTS: none
+ * OUTPUTS: none
+ */
+void i8259_mask_all(void) {
+	master_mask = 0xFF;
+	slave_mask = 0xFF;
+	outb(master_mask, MASTER_8259_DATA);
+	outb(slave_mask, SLAVE_8259_DATA);
+}
+
+/** i8259_irq_pending
+ * DESCRIPTION: Checks whether an IRQ is latched but not yet delivered
+ * INPUTS: irq_num -- the irq number
+ * OUTPUTS: 1 if the IRQ's request bit is set, 0 otherwise
+ */
+int i8259_irq_pending(uint32_t irq_num) {
+	if(irq_num > (IRQ_VEC_NUM - 1))
+		return 0;
+
+	if (irq_num < IRQ_OFFSET)
+	{
+		outb(OCW3_READ_IRR, MASTER_8259_PORT);
+		return (inb(MASTER_8259_PORT) >> irq_num) & 1;
+	}
+	outb(OCW3_READ_IRR, SLAVE_8259_PORT);
+	return (inb(SLAVE_8259_PORT) >> (irq_num - IRQ_OFFSET)) & 1;
+}
+
 /** enable_irq
  * DESCRIPTION: Enables (unmasks) the specified IRQ
  * INPUTS: irq_num -- the irq number to unmask
@@ -68,6 +102,12 @@ void enable_irq(uint32_t irq_num) {
 	if(irq_num < 0 || irq_num > (IRQ_VEC_NUM - 1))
 		return;
 
+	/* The IOAPIC routes the IRQs once the APIC is active */
+	if (apic_enabled()) {
+		ioapic_enable_irq(irq_num);
+		return;
+	}
+
 	/* Checking if the IRQ is in the master */
 	if (irq_num < IRQ_OFFSET)
 	{
@@ -95,6 +135,11 @@ void disable_irq(uint32_t irq_num) {
 	if(irq_num < 0 || irq_num > (IRQ_VEC_NUM - 1))
 		return;
 
+	if (apic_enabled()) {
+		ioapic_disable_irq(irq_num);
+		return;
+	}
+
 	/* Checking if the IRQ is in the master */
 	if (irq_num < IRQ_OFFSET)
 	{
@@ -113,9 +158,12 @@ void disable_irq(uint32_t irq_num) {
 }
 
 /** send_eoi
- * DESCRIPTION: Send EOI signal to PIC
+ * DESCRIPTION: Send EOI signal to the interrupt controller in charge
  * INPUTS: irq_num -- the irq number which ended
  * OUTPUTS: none
+ * NOTES: the local APIC EOI is a single MMIO write and ends whichever
+ *   interrupt is in service. A second EOI for the same IRQ (sent before
+ *   switching tasks and again on the way out) finds none and is ignored
  */
 void send_eoi(uint32_t irq_num) {
 
@@ -123,6 +171,24 @@ void send_eoi(uint32_t irq_num) {
 	if(irq_num < 0 || irq_num > (IRQ_VEC_NUM - 1))
 		return;
 
+	if (apic_enabled()) {
+		lapic_eoi();
+		return;
+	}
+
+	i8259_eoi(irq_num);
+}
+
+/** i8259_eoi
+ * DESCRIPTION: Send a specific EOI signal to the PIC
+ * INPUTS: irq_num -- the irq number which ended
+ * OUTPUTS: none
+ */
+void i8259_eoi(uint32_t irq_num) {
+
+	if(irq_num > (IRQ_VEC_NUM - 1))
+		return;
+
     // EOI must be sent to either master or both
     if(irq_num >= IRQ_OFFSET){
         outb(EOI | (irq_num - IRQ_OFFSET), SLAVE_8259_PORT);
@@ -31,6 +31,13 @@
 
 /* Initialize both PICs */
 void i8259_init(void);
+/* Mask every line (the APIC delivers interrupts instead) */
+void i8259_mask_all(void);
+/* Whether the specified IRQ is waiting to be delivered */
+int i8259_irq_pending(uint32_t irq_num);
+/* Send end-of-interrupt signal to the PIC itself */
+void i8259_eoi(uint32_t irq_num);
+/* These go to the IOAPIC/local APIC while the APIC is active */
 /* Enable (unmask) the specified IRQ */
 void enable_irq(uint32_t irq_num);
 /* Disable (mask) the specified IRQ */
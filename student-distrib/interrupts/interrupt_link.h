@@ -30,5 +30,8 @@ extern void asm_intv_32(void);
 extern void asm_intv_33(void);
 extern void asm_intv_34(void);
 extern void asm_intv_40(void);
+extern void asm_intv_240(void);
+extern void asm_intv_241(void);
+extern void asm_intv_255(void);
 
 #endif /* _INTERRUPT_LINK_H */
@@ -3,17 +3,30 @@
 #include "../lib/lib.h"
 #include "../arch/x86_desc.h"
 #include "i8259.h"
+#include "apic.h"
 #include "../devices/keyboard.h"
 #include "../devices/rtc.h"
 #include "interrupt_link.h"
 #include "syscall_link.h"
 #include "../tasks/process.h"
+#include "../tasks/kthread.h"
 #include "syscalls.h"
 #include "pit.h"
+#include "softirq.h"
 #include "../scheduler/scheduler.h"
+#include "../scheduler/tick.h"
+#include "../memory/paging.h"
+#include "../arch/fpu.h"
+#include "../arch/cpu.h"
+#include "../arch/smp.h"
 
 #define EXCEPTION_INFO 1
 
+#define USER_RPL 3
+
+// Interrupt and fault counters, see intr_get_stats
+static intr_stats_t intr_stats;
+
 /** init_idt
  * DESCRIPTION: Initializes the IDT with handlers for the 32 exceptions
  *   and 4 notable IRQ lines (timer, keyboard, slave cascade, RTC)
@@ -57,6 +70,11 @@ void init_idt(){
             case 33: SET_IDT_ENTRY(idt[i], &asm_intv_33); break;
             case 34: SET_IDT_ENTRY(idt[i], &asm_intv_34); break;
             case 40: SET_IDT_ENTRY(idt[i], &asm_intv_40); break;
+            case APIC_SPURIOUS_VEC: SET_IDT_ENTRY(idt[i], &asm_intv_255); break;
+
+            // Interprocessor Interrupts
+            case APIC_RESCHED_VEC: SET_IDT_ENTRY(idt[i], &asm_intv_240); break;
+            case APIC_TLB_VEC: SET_IDT_ENTRY(idt[i], &asm_intv_241); break;
 
             // System Calls
             case 0x80: SET_IDT_ENTRY(idt[i], &asm_syscall); break;
@@ -100,11 +118,27 @@ void do_intv(int intv, int_regs_t regs){
     // if(intv != 40) printf("Interrupt received with vector: %d at EIP: 0x%x\n", intv, regs.eip);
 
     if(intv < 32){
+        // Page faults on demand-paged user memory are not errors
+        if(intv == PAGE_FAULT_VEC && do_page_fault(regs) == 0) return;
+
+        // So is a task's first FPU instruction since it was switched to
+        if(intv == DEVICE_NA_VEC && do_fpu_trap() == 0) return;
+
+        intr_stats.exceptions++;
 
 #if (EXCEPTION_INFO == 1)
         exception_debug(intv, regs);
 #endif
 
+        // A kernel thread has no parent to report to, it just ends
+        if(is_kthread(active_pid)){
+#if (EXCEPTION_INFO == 0)
+            exception_debug(intv, regs);
+#endif
+            printf("Exception in kernel thread %s, ending it\n", get_pcb(active_pid)->args);
+            kthread_exit();
+        }
+
         // halt current process with exception
         if(num_tasks > 0){
             exception_flag = 1;
@@ -119,31 +153,80 @@ void do_intv(int intv, int_regs_t regs){
             while(1);
         }
     }
-    // If this is an IRQ, run do_irq
-    else if(intv >= 32 && intv <= 48){
-        do_irq(intv - 32, regs);
+    // If this is an IRQ, run do_irq, then the work it deferred
+    else if(intv >= 32 && intv < 32 + NUM_IRQS){
+        intr_stats.irqs[intv - 32]++;
+        do_irq(intv - 32, (regs.cs & USER_RPL) == USER_RPL);
+        do_softirq();
+        sched_irq_exit();
+    }
+    else if(intv == APIC_RESCHED_VEC || intv == APIC_TLB_VEC){
+        intr_stats.ipis++;
+        smp_ipi(intv);
+    }
+    // APIC_SPURIOUS_VEC needs no handling (and no EOI)
+}
+
+/** do_page_fault
+ * DESCRIPTION: Page fault handler, pages in user memory of the active task
+ *   and breaks copy-on-write sharing
+ * INPUTS: regs -- the interrupt context (error_code describes the fault)
+ * OUTPUTS: 0 if the fault was resolved, -1 if it is a real exception
+ * SIDE EFFECTS: maps a frame into the task's page tables
+ */
+int do_page_fault(int_regs_t regs){
+    uint32_t addr = get_cr2();
+    pcb_t* pcb = get_pcb(active_pid);
+
+    if(pcb == NULL || pcb->page_dir == 0) return -1;
+
+    // Writes to present pages are only fine on copy-on-write pages
+    int result;
+    if(regs.error_code & PF_PRESENT){
+        result = (regs.error_code & PF_WRITE) ? cow_page(pcb, addr) : FAULT_FAIL;
+    }
+    else{
+        result = demand_page(pcb, addr);
+    }
+
+    switch(result){
+        case FAULT_MINOR:
+            pcb->min_flt++;
+            intr_stats.min_flt++;
+            return 0;
+        case FAULT_MAJOR:
+            pcb->maj_flt++;
+            intr_stats.maj_flt++;
+            return 0;
+        default:
+            return -1;
     }
 }
 
 /** do_irq
  * DESCRIPTION: Handles device IRQ interrupts
- * INPUTS: irq -- the IRQ number (0 to 16)
- *         context -- the interrupt context (register state)
+ * INPUTS: irq -- the IRQ number (0 to 15)
+ *         user -- 1 if the interrupt came from user mode
  * OUTPUTS: none
  * SIDE EFFECTS: calls device-specific handler functions
+ * NOTES: handlers run before the EOI, anything slow belongs in a tasklet
+ *   (softirq.h), which runs after it with interrupts enabled
  */
 // #define SCHEDULER_COUTNER
-void do_irq(int irq, int_regs_t context){
+void do_irq(int irq, int user){
 
     switch(irq){
         case 0:
         #ifdef SCHEDULER_COUTNER
             increment_clock();
         #endif
-            pit_handler(context);
+            // Other CPUs' local timers only end time slices
+            if(cpu_id() == TICK_CPU) tick_irq();
+            sched_account_tick(user);
+            pit_handler();
             break;
         case 1:
-            keyboard_irq(context);
+            keyboard_irq();
             break;
         case 8:
             rtc_handler();
@@ -157,6 +240,17 @@ void do_irq(int irq, int_regs_t context){
     send_eoi(irq);
 }
 
+/** intr_get_stats
+ * DESCRIPTION: copies out the interrupt and fault counters
+ * INPUTS: out -- where to copy them
+ */
+void intr_get_stats(intr_stats_t* out){
+    unsigned long flags;
+    cli_and_save(flags);
+    *out = intr_stats;
+    restore_flags(flags);
+}
+
 /** exception_debug
  * DESCRIPTION: Prints processor state on exception
  * INPUTS: intv -- the interrupt vector
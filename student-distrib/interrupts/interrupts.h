@@ -3,6 +3,9 @@
 
 #include "../lib/lib.h"
 
+#define PAGE_FAULT_VEC 14
+#define NUM_IRQS 16
+
 /* Interupt regs structure
  *  (pushed to stack by processor on interrupt,
  *   see I-32A ref figure 5-4)
@@ -22,8 +25,19 @@ typedef struct {
     uint32_t eflags;
 } int_regs_t;
 
+/* Counters since boot */
+typedef struct {
+    uint32_t irqs[NUM_IRQS];    // Per IRQ line
+    uint32_t ipis;
+    uint32_t min_flt;           // Page faults resolved, see do_page_fault
+    uint32_t maj_flt;
+    uint32_t exceptions;        // That ended a task
+} intr_stats_t;
+
 extern void do_intv(int intv, int_regs_t regs);
-void do_irq(int irq, int_regs_t context);
+int do_page_fault(int_regs_t regs);
+void do_irq(int irq, int user);
+void intr_get_stats(intr_stats_t* out);
 void exception_debug(int intv, int_regs_t regs);
 void init_idt(void);
 
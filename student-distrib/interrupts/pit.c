@@ -2,10 +2,9 @@
 #include "../lib/lib.h"
 #include "i8259.h"
 #include "../devices/terminal.h"
+#include "../scheduler/tick.h"
 
 #define PIT_IRQ 0
-#define PIT_BASE_FREQ 1193182
-#define PIT_FREQ 1000
 
 unsigned int counter = 0;
 unsigned int one = 0;
@@ -13,13 +12,81 @@ unsigned int two = 0;
 unsigned int three = 0;
 
 void pit_init(void) {
-  int divisor = PIT_BASE_FREQ / PIT_FREQ;
+#if (TICKLESS == 1)
+  // The tick code keeps channel 0 armed in one-shot mode from here on
+  tick_start(&pit_tick_device);
+#else
   outb(0x34, PIT_COMMAND);
-  outb(divisor & 0xFF, PIT_CH0);
-  outb(divisor >> 8, PIT_CH0);
+  outb(PIT_DIVISOR & 0xFF, PIT_CH0);
+  outb(PIT_DIVISOR >> 8, PIT_CH0);
+#endif
   enable_irq(PIT_IRQ);
 }
 
+// Arms channel 0 to interrupt once after counts PIT cycles (mode 0)
+void pit_oneshot(uint16_t counts) {
+  outb(0x30, PIT_COMMAND);
+  outb(counts & 0xFF, PIT_CH0);
+  outb(counts >> 8, PIT_CH0);
+}
+
+// Latches and reads channel 0's current count, and whether its output
+// went high (a one-shot has fired) through the read-back command
+uint16_t pit_read_count(int* fired) {
+  outb(0xC2, PIT_COMMAND);
+  uint8_t status = inb(PIT_CH0);
+  uint16_t count = inb(PIT_CH0);
+  count |= inb(PIT_CH0) << 8;
+  if (fired != NULL) *fired = (status & 0x80) != 0;
+  return count;
+}
+
+// Busy-waits at least us microseconds on channel 0, for use before the
+// tick is started (it reprograms the channel)
+void pit_delay_us(uint32_t us) {
+  while (us > 0) {
+    uint32_t chunk = us < PIT_MAX_DELAY_US ? us : PIT_MAX_DELAY_US;
+    int fired = 0;
+
+    pit_oneshot(chunk * (PIT_BASE_FREQ / 1000) / 1000 + 1);
+    while (!fired) {
+      pit_read_count(&fired);
+    }
+    us -= chunk;
+  }
+}
+
+// Tick device operations, see tick.h
+static void pit_tick_arm(uint32_t counts) {
+  pit_oneshot(counts);
+}
+
+static void pit_tick_stop(void) {
+  // Writing the mode stops channel 0 until a new count is loaded
+  outb(0x30, PIT_COMMAND);
+}
+
+static uint32_t pit_tick_elapsed(uint32_t counts, int fired) {
+  // Unless the caller knows, the read-back status says whether it fired.
+  // Once it has the counter wraps to 0xFFFF and keeps counting down
+  uint16_t count = pit_read_count(fired ? NULL : &fired);
+  return fired ? counts + ((0x10000 - count) & 0xFFFF) : counts - count;
+}
+
+static int pit_tick_pending(void) {
+  return i8259_irq_pending(PIT_IRQ);
+}
+
+const tick_device_t pit_tick_device = {
+  .name = "pit",
+  .counts_per_tick = PIT_DIVISOR,
+  .max_counts = 0xFFFF,
+  .arm = pit_tick_arm,
+  .stop = pit_tick_stop,
+  .elapsed = pit_tick_elapsed,
+  .irq_pending = pit_tick_pending
+};
+
 void increment_clock(void){
   uint32_t term = get_active_terminal();
   if(term == 0){
@@ -1,6 +1,28 @@
+#ifndef _PIT_H
+#define _PIT_H
+
+#include "../lib/types.h"
+#include "../scheduler/tick.h"
+
 #define PIT_CH0 0x40
 #define PIT_COMMAND 0x43
 #define PIT_IRQ 0
+#define PIT_FREQ 1000 /* Ticks per second */
+#define PIT_BASE_FREQ 1193182
+#define PIT_DIVISOR (PIT_BASE_FREQ / PIT_FREQ) /* PIT cycles per tick */
+#define PIT_MAX_DELAY_US 50000 /* Longest wait one 16-bit count covers */
+
+/* 1 to program the PIT one-shot for the next deadline (tick.c),
+ * 0 for a fixed PIT_FREQ periodic tick */
+#define TICKLESS 1
+
+/* One-shot tick on channel 0, used when there is no local APIC */
+extern const tick_device_t pit_tick_device;
 
 void pit_init(void);
+void pit_oneshot(uint16_t counts);
+uint16_t pit_read_count(int* fired);
+void pit_delay_us(uint32_t us);
 void increment_clock(void);
+
+#endif /* _PIT_H */
@@ -0,0 +1,180 @@
+#include "softirq.h"
+
+#include "../lib/lib.h"
+#include "../arch/cpu.h"
+#include "../arch/smp.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/wait.h"
+#include "../tasks/kthread.h"
+
+#define KSOFTIRQD_NAME      "ksoftirqd/"
+
+// Each CPU's scheduled tasklets, in the order they were scheduled
+static tasklet_t* pending[MAX_CPUS];
+static tasklet_t** pending_tail[MAX_CPUS];
+
+// Set while the CPU runs tasklets, an interrupt taken meanwhile leaves
+// what it schedules to the pass already running
+static uint32_t running[MAX_CPUS];
+
+// Each CPU's ksoftirqd, while it waits for deferred tasklets
+static wait_queue_t ksoftirqd_wait[MAX_CPUS];
+
+static softirq_stats_t stats;
+
+/* init_tasklet
+ * DESCRIPTION:         sets up a tasklet that isn't scheduled
+ * INPUTS:              tasklet -- the tasklet
+ *                      fn -- what it runs, called with data
+ *                      data -- argument for fn
+ */
+void init_tasklet(tasklet_t* tasklet, void (*fn)(uint32_t data), uint32_t data){
+    tasklet->next = NULL;
+    tasklet->pending = 0;
+    tasklet->fn = fn;
+    tasklet->data = data;
+}
+
+/* tasklet_schedule
+ * DESCRIPTION:         queues a tasklet to run on this CPU, on the way out
+ *                      of the current interrupt (or the next one, outside
+ *                      of an interrupt)
+ * INPUTS:              tasklet -- the tasklet
+ * NOTES:               does nothing if it is already queued
+ */
+void tasklet_schedule(tasklet_t* tasklet){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if(!tasklet->pending){
+        uint32_t cpu = cpu_id();
+        if(pending_tail[cpu] == NULL) pending_tail[cpu] = &pending[cpu];
+
+        tasklet->pending = 1;
+        tasklet->next = NULL;
+        *pending_tail[cpu] = tasklet;
+        pending_tail[cpu] = &tasklet->next;
+        stats.scheduled++;
+    }
+
+    restore_flags(flags);
+}
+
+/* do_softirq
+ * DESCRIPTION:         runs the tasklets scheduled on this CPU with
+ *                      interrupts enabled, going back for ones scheduled
+ *                      meanwhile up to MAX_SOFTIRQ_RESTART times
+ * NOTES:               called with interrupts disabled (returns with them
+ *                      disabled), after the interrupt's EOI. Does nothing
+ *                      if it interrupted a pass on this CPU
+ */
+void do_softirq(void){
+    uint32_t cpu = cpu_id();
+    int restart;
+
+    if(running[cpu] || pending[cpu] == NULL) return;
+    running[cpu] = 1;
+
+    for(restart = 0; restart < MAX_SOFTIRQ_RESTART && pending[cpu] != NULL; restart++){
+        tasklet_t* list = pending[cpu];
+        pending[cpu] = NULL;
+        pending_tail[cpu] = &pending[cpu];
+
+        while(list != NULL){
+            // Once it is off the list it may be scheduled again
+            tasklet_t* tasklet = list;
+            list = tasklet->next;
+            tasklet->pending = 0;
+            stats.run++;
+
+            sti();
+            tasklet->fn(tasklet->data);
+            cli();
+        }
+    }
+    running[cpu] = 0;
+
+    // Without another interrupt coming the rest would wait indefinitely
+    if(pending[cpu] != NULL){
+        stats.deferred++;
+        wake_up(&ksoftirqd_wait[cpu]);
+    }
+}
+
+/* ksoftirqd_thread
+ * DESCRIPTION:         body of a CPU's ksoftirqd: sleeps until do_softirq
+ *                      leaves tasklets behind, then runs them as a task,
+ *                      giving the CPU to other tasks between passes
+ * INPUTS:              cpu -- the CPU it is bound to
+ * RETURNS:             never
+ */
+static void ksoftirqd_thread(uint32_t cpu){
+    unsigned long flags;
+
+    while(1){
+        cli_and_save(flags);
+        while(pending[cpu] == NULL){
+            prepare_to_wait(&ksoftirqd_wait[cpu]);
+            if(pending[cpu] == NULL) schedule();
+            finish_wait(&ksoftirqd_wait[cpu]);
+        }
+
+        do_softirq();
+        restore_flags(flags);
+
+        schedule();
+    }
+}
+
+/* init_ksoftirqd
+ * DESCRIPTION:         starts a ksoftirqd kernel thread on each online CPU
+ * RETURNS:             0 on success, -1 if a thread couldn't be created
+ * NOTES:               PID 0's kernel stack is the boot stack, so the
+ *                      caller must hold PID 0 while the boot code runs
+ */
+int init_ksoftirqd(void){
+    char name[sizeof(KSOFTIRQD_NAME) + 2];
+    uint32_t cpu;
+
+    for(cpu = 0; cpu < MAX_CPUS; cpu++){
+        if(!(smp_online_mask() & (1 << cpu))) continue;
+
+        init_wait_queue(&ksoftirqd_wait[cpu]);
+        strcpy(name, KSOFTIRQD_NAME);
+        itoa(cpu, (int8_t*)name + sizeof(KSOFTIRQD_NAME) - 1, 10);
+
+        pid_t pid = kthread_create(ksoftirqd_thread, cpu, name);
+        if(pid > MAX_PID) return -1;
+        kthread_bind(pid, cpu);
+        kthread_wake(pid);
+    }
+    return 0;
+}
+
+/* softirq_pending
+ * RETURNS:             1 if tasklets wait to run on this CPU, 0 otherwise
+ */
+int softirq_pending(void){
+    return pending[cpu_id()] != NULL;
+}
+
+/* in_softirq
+ * RETURNS:             1 if this CPU is running tasklets (and what runs now
+ *                      interrupted one), 0 otherwise
+ * NOTES:               the scheduler doesn't switch tasks then, a tasklet
+ *                      runs to completion on its CPU
+ */
+int in_softirq(void){
+    return running[cpu_id()];
+}
+
+/* softirq_get_stats
+ * DESCRIPTION:         copies out the tasklet counters
+ * INPUTS:              out -- where to copy them
+ */
+void softirq_get_stats(softirq_stats_t* out){
+    unsigned long flags;
+    cli_and_save(flags);
+    *out = stats;
+    restore_flags(flags);
+}
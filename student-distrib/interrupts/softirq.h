@@ -0,0 +1,42 @@
+#ifndef _SOFTIRQ_H
+#define _SOFTIRQ_H
+
+#include "../lib/types.h"
+
+/* Times do_softirq goes back for tasklets scheduled while it ran, the
+ * rest are left to the CPU's ksoftirqd thread (or the next interrupt, or
+ * the idle loop, whichever comes first) */
+#define MAX_SOFTIRQ_RESTART 10
+
+/* Deferred interrupt work. An interrupt handler schedules a tasklet and
+ * returns, and the tasklet runs on that CPU after the EOI, on the way out
+ * of the interrupt, with interrupts enabled. A tasklet must not sleep or
+ * switch tasks (sched_request asks for a switch once it is done), and
+ * runs once however many times it was scheduled before it ran */
+typedef struct tasklet {
+    struct tasklet* next;
+    volatile uint32_t pending;  // Queued and not yet started
+    void (*fn)(uint32_t data);
+    uint32_t data;
+} tasklet_t;
+
+typedef struct {
+    uint32_t scheduled;         // tasklet_schedule calls that queued one
+    uint32_t run;
+    uint32_t deferred;          // Passes that stopped at MAX_SOFTIRQ_RESTART
+} softirq_stats_t;
+
+void init_tasklet(tasklet_t* tasklet, void (*fn)(uint32_t data), uint32_t data);
+void tasklet_schedule(tasklet_t* tasklet);
+
+/* Runs this CPU's scheduled tasklets, called with interrupts disabled */
+void do_softirq(void);
+int softirq_pending(void);
+int in_softirq(void);
+
+/* Starts the per-CPU threads running deferred tasklets */
+int init_ksoftirqd(void);
+
+void softirq_get_stats(softirq_stats_t* out);
+
+#endif /* _SOFTIRQ_H */
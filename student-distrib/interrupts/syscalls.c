@@ -1,20 +1,62 @@
 #include "syscalls.h"
 
 #include "../memory/paging.h"
+#include "../memory/frame.h"
+#include "../memory/shm.h"
 #include "../tasks/process.h"
 #include "../storage/filesys.h"
+#include "../storage/procfs.h"
 #include "../devices/rtc.h"
 #include "../arch/x86_desc.h"
+#include "../arch/smp.h"
 #include "../devices/terminal.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/timer.h"
 
 #define ELF_MAGIC_LEN 4
 #define ELF_MAGIC {0x7f, 0x45, 0x4C, 0x46};
 #define ELF_ENTRYPT_OFFSET 24
+#define ELF_PHOFF_OFFSET 28
+#define ELF_PHENTSIZE_OFFSET 42
+#define ELF_PHNUM_OFFSET 44
+#define ELF_PT_LOAD 1
+#define ELF_PF_W 0x2
+
+#define USER_EFLAGS 0x202 // IF, and bit 1 which is always set
+#define INT_SAVED_REGS 8 // Registers saved by pushal
+
+/* ELF program header */
+typedef struct {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+} elf_phdr_t;
+
+/* Registers saved on the kernel stack by asm_syscall (syscall_link.S),
+ * ending with the frame pushed by int $0x80 */
+typedef struct {
+    uint32_t edi;
+    uint32_t esi;
+    uint32_t ebx;
+    uint32_t edx;
+    uint32_t ecx;
+    uint32_t ebp;
+    uint32_t eip;
+    uint32_t cs;
+    uint32_t eflags;
+    uint32_t esp;
+    uint32_t ss;
+} syscall_frame_t;
 
 // Global exception flag for do_halt
 volatile int32_t exception_flag = 0;
 
-// There are 3 other types of fops tables
+// There are 4 other types of fops tables
 static struct file_ops file_fops = {
     .open = file_open,
     .close = file_close,
@@ -33,6 +75,21 @@ static struct file_ops rtc_fops = {
     .read = rtc_read,
     .write = rtc_write
 };
+static struct file_ops proc_fops = {
+    .open = proc_open,
+    .close = proc_close,
+    .read = proc_read,
+    .write = proc_write
+};
+
+/* account_syscall
+ * DESCRIPTION:     counts a system call made by the active task, called
+ *                  by asm_syscall before the handler
+ */
+void account_syscall(void){
+    pcb_t* pcb = get_pcb(active_pid);
+    if(pcb != NULL) pcb->nsyscalls++;
+}
 
 /* syscall_fail
  * DESCRIPTION:     Used for invalid fops entries
@@ -77,6 +134,9 @@ int32_t do_open (const uint8_t* filename){
         case DENTRY_TYPE_FILE:
             file->ops = &file_fops;
             break;
+        case DENTRY_TYPE_PROC:
+            file->ops = &proc_fops;
+            break;
         default:
             // We shouldn't ever get here
             return -1;
@@ -195,47 +255,122 @@ int32_t do_halt (uint8_t status){
     }
 
     pcb_t* pcb = get_pcb(active_pid);
+    sched_dequeue(active_pid);
 
-    if(pcb->flags & TASK_VID_IN_USE){
-        disable_user_video_mem();
-    }
+    // Whoever runs next in this terminal continues where the task left off
+    pause_task();
 
-    // Restore parent state
-    pid_t parent = pcb->parent_pid;
-    set_terminal_pid_head(pcb->terminal, parent);
-    free_pid(active_pid);
+    // Release the task's memory
+    shm_detach_all(pcb);
+    shm_exit(active_pid);
+    delete_task_page();
+    free_task_page(pcb);
 
-    // Invalid parent PID implies a shell must be respawned for this terminal
-    if(parent <= MAX_PID){
-        setup_task_page(parent);
-        tss.esp0 = get_kernel_stack(parent);
-        active_pid = parent;
+    // Children left behind (forked ones) belong to this task's parent now
+    pid_t parent = pcb->parent_pid;
+    reparent_children(active_pid, parent);
+
+    // Only the terminal's head hands the terminal back. A forked descendant
+    // may still own it while this task halts
+    if(get_terminal_pid_head(pcb->terminal) == active_pid){
+        // The parent is the nearest live ancestor, children are reparented
+        // as their parents halt
+        set_terminal_pid_head(pcb->terminal, get_pcb(parent) != NULL ? parent : (pid_t)-1);
     }
-    else{
-        // A shell must always be running, respawn shell
+
+    // Forked tasks have no execute call to return to
+    if(pcb->flags & TASK_FORKED){
+        free_pid(active_pid);
+
+        pid_t old_pid = active_pid;
         active_pid = -1;
-        do_execute((uint8_t*)"shell");
+        sched_exit(old_pid);
+
+        // Should never get here
+        return -1;
     }
 
-    // Return to parent task
+    // Invalid parent PID implies a shell must be respawned for this terminal
+    pid_t old_pid = active_pid;
     pcb_t* parent_pcb = get_pcb(parent);
+    if(parent_pcb == NULL){
+        // A shell must always be running. Prep it while this task's PID is
+        // still reserved, the same PID would get the kernel stack in use here
+        uint32_t shown = get_active_terminal();
+        set_terminal_pos(pcb->terminal, get_screen_x(), get_screen_y());
+        set_terminal(pcb->terminal);
+        active_pid = -1;
+        prep_task((uint8_t*)"shell");
+        set_terminal(shown);
+
+        free_pid(old_pid);
+        sched_exit(old_pid);
+
+        // Should never get here
+        return -1;
+    }
+
+    // Restore parent state
+    free_pid(old_pid);
+    active_pid = -1;
+
+    // Return to parent task, its execute call returns retval
+    parent_pcb->child_status = retval;
     parent_pcb->flags &= ~(TASK_WAITING_FOR_CHILD);
     parent_pcb->flags |= TASK_EXECUTING;
-    asm volatile (
-        "movl %0, %%esp;"
-        "movl %1, %%ebp;"
-        "movl %2, %%eax;"
-        "leave;"
-        "ret;"
-        : /* no output */
-        : "r"(parent_pcb->context.esp), "r"(parent_pcb->context.ebp), "r"(retval)
-        : "esp", "ebp", "eax"
-    );
+    sched_enqueue(parent);
+    resume_task(parent);
 
     // Should never get here
     return -1;
 }
 
+/* elf_layout
+ * DESCRIPTION:     fills in where a task's memory image ends and which
+ *                  pages hold read-only text, using the loadable segments
+ *                  of the executable's program header table
+ * INPUTS:          inode -- inode of the executable
+ *                  pcb -- the task, with image_file_end already set
+ */
+static void elf_layout(uint32_t inode, pcb_t* pcb){
+    uint32_t phoff = 0, end = 0;
+    uint32_t text_start = 0, text_end = 0, data_start = USER_STACK;
+    uint16_t phentsize = 0, phnum = 0;
+    elf_phdr_t phdr;
+    int i;
+
+    read_data(inode, ELF_PHOFF_OFFSET, (uint8_t*)&phoff, sizeof(phoff));
+    read_data(inode, ELF_PHENTSIZE_OFFSET, (uint8_t*)&phentsize, sizeof(phentsize));
+    read_data(inode, ELF_PHNUM_OFFSET, (uint8_t*)&phnum, sizeof(phnum));
+    if(phentsize < sizeof(elf_phdr_t)) phnum = 0;
+
+    for(i = 0; i < phnum; i++){
+        if(read_data(inode, phoff + i*phentsize, (uint8_t*)&phdr, sizeof(phdr)) != sizeof(phdr)) break;
+        if(phdr.type != ELF_PT_LOAD) continue;
+
+        end = max(end, phdr.vaddr + phdr.memsz);
+        if(phdr.flags & ELF_PF_W){
+            data_start = min(data_start, phdr.vaddr);
+        }
+        else if(text_end == 0 && phdr.offset == phdr.vaddr - USER_LOAD_ADDR){
+            // Text can only be mapped in place where the file layout matches memory
+            text_start = phdr.vaddr;
+            text_end = phdr.vaddr + phdr.filesz;
+        }
+    }
+
+    pcb->image_end = max(pcb->image_file_end, end);
+    pcb->image_end = min(pcb->image_end, USER_STACK - USER_STACK_SIZE);
+
+    // Only whole pages of the file which nothing writable shares
+    pcb->text_start = PAGE_ALIGN_UP(text_start);
+    pcb->text_end = min(PAGE_ALIGN_UP(text_end), PAGE_ALIGN_DOWN(data_start));
+    pcb->text_end = min(pcb->text_end, PAGE_ALIGN_DOWN(pcb->image_file_end));
+    if(pcb->text_start >= pcb->text_end){
+        pcb->text_start = pcb->text_end = 0;
+    }
+}
+
 /* prep_task
  * DESCRIPTION:     helper for do_execute which preps a task but does not start it
  * INPUTS:          command -- pointer to command name
@@ -274,7 +409,7 @@ pid_t prep_task(const uint8_t* command){
 
     // Get file info
     dentry_t dentry;
-    if(read_dentry_by_name(p_name, &dentry) != 0){
+    if(read_dentry_by_name(p_name, &dentry) != 0 || dentry.type != DENTRY_TYPE_FILE){
         // Requested executable doesn't exist
         return -1;
     }
@@ -293,6 +428,23 @@ pid_t prep_task(const uint8_t* command){
     pid_t pid = reserve_pid();
     if(pid > MAX_PID) return -1;
 
+    // Create PCB
+    pcb_t* pcb = get_pcb(pid);
+    init_pcb(pcb, pid, args);
+
+    // Only the page tables are built here, the program image and stack are
+    // paged in by demand_page as the task touches them
+    if(create_task_page(pcb) != 0){
+        // Out of memory
+        free_task_page(pcb);
+        free_pid(pid);
+        return -1;
+    }
+    pcb->exe_inode = dentry.inode;
+    pcb->image_file_end = USER_LOAD_ADDR + inode->size;
+    elf_layout(dentry.inode, pcb);
+    pcb->heap_start = pcb->brk = PAGE_ALIGN_UP(pcb->image_end);
+
     // Special case for initial shells
     pcb_t* parent_pcb;
     if(active_pid > MAX_PID){
@@ -307,54 +459,28 @@ pid_t prep_task(const uint8_t* command){
         set_terminal_pid_head(parent_pcb->terminal, pid);
         parent_pcb->flags &= ~(TASK_EXECUTING);
         parent_pcb->flags |= TASK_WAITING_FOR_CHILD;
+        sched_dequeue(active_pid);
     }
 
-    // Load file to memory
-    setup_task_page(pid);
-    read_data(dentry.inode, 0, (uint8_t*)USER_LOAD_ADDR, inode->size);
-
-    // Create PCB
-    pcb_t* pcb = get_pcb(pid);
-    init_pcb(pcb, pid, args);
-
     // Save entry info
-    read_data(dentry.inode, ELF_ENTRYPT_OFFSET, (uint8_t*)&(pcb->context.eip), 4);
-
-    // Simulate interrupt context before calling resume_task
-    pcb->context.esp = get_kernel_stack(pid);
-    uint32_t old_stack, temp_flags;
-
-    // Preprocessor stuff for stringizing constants
-    #define STR(val) _STR(val)
-    #define _STR(val) #val
-    #define USER_CS_STR STR(USER_CS)
-    #define USER_DS_STR STR(USER_DS)
-    #define USER_STACK_STR STR(USER_STACK)
-
-    asm volatile(
-        "movl %%esp, %0;"
-        "movl %2, %%esp;"
-
-        // Fake interrupt context
-        "pushl $"USER_DS_STR";"
-        "pushl $"USER_STACK_STR";"
-        "pushfl;"
-        "popl %1;"
-        "orl $0x200, %1;" // Ensure interrupts are enabled
-        "pushl %1;"
-        "pushl $"USER_CS_STR";"
-        "pushl %3;"
-
-        "pushl $0;"                     // Fake error code
-        "pushal;"
-        "movl %0, %%esp;"            // Return to this function
-        : "=&r"(old_stack), "=&r"(temp_flags)
-        : "r"(pcb->context.esp), "r"(pcb->context.eip)
-        : "memory"
-    );
-
-    // resume_task assumes ESP points between interrupt context and register state
-    pcb->context.esp -= 24;
+    uint32_t entry;
+    read_data(dentry.inode, ELF_ENTRYPT_OFFSET, (uint8_t*)&entry, 4);
+
+    // Fake interrupt context (See Intel manual figure 5-4), the first switch
+    // to the task unwinds it into user space
+    uint32_t* stack = (uint32_t*)get_kernel_stack(pid);
+    *--stack = USER_DS;
+    *--stack = USER_STACK;
+    *--stack = USER_EFLAGS;
+    *--stack = USER_CS;
+    *--stack = entry;
+    *--stack = 0; // Fake error code
+    for(i = 0; i < INT_SAVED_REGS; i++){
+        *--stack = 0; // pushal registers
+    }
+    finish_task_stack(pcb, stack);
+
+    sched_enqueue(pid);
 
     return pid;
 }
@@ -362,8 +488,8 @@ pid_t prep_task(const uint8_t* command){
 /* do_execute
  * DESCRIPTION:     the execute syscall handler
  * INPUTS:          command -- pointer to command name
- * RETURNS:         0 on success, 1 on failure due to too many tasks,
- *                  -1 on other failures
+ * RETURNS:         the child's halt status on success, 1 on failure due to
+ *                  too many tasks, -1 on other failures
  */
 int32_t do_execute (const uint8_t* command){
     if(num_tasks >= MAX_TASKS) return 1;
@@ -375,15 +501,7 @@ int32_t do_execute (const uint8_t* command){
 
     pcb_t* parent_pcb = active_pid > MAX_PID ? NULL : get_pcb(active_pid);
 
-    // Save parent's stack registers for use in halt
     if(parent_pcb != NULL){
-        asm volatile(
-            "movl %%esp, %0;"
-            "movl %%ebp, %1;"
-            : "=r"(parent_pcb->context.esp), "=r"(parent_pcb->context.ebp)
-            : /* no input */
-        );
-
         // Save terminal position
         set_terminal_pos(parent_pcb->terminal, get_screen_x(), get_screen_y());
     }
@@ -397,10 +515,10 @@ int32_t do_execute (const uint8_t* command){
         set_terminal_pos(t, get_screen_x(), get_screen_y());
     }
 
-    resume_task(pid);
+    // Switches back here once the child halts (a first shell never does)
+    if(resume_task(pid) != 0 || parent_pcb == NULL) return -1;
 
-    // Should never reach here, will be exited by halt
-    return -1;
+    return parent_pcb->child_status;
 }
 
 /* do_getargs
@@ -442,6 +560,214 @@ int32_t do_vidmap (uint8_t** screen_start){
     return 0;
 }
 
+/* do_fork
+ * DESCRIPTION:     the fork syscall handler, creates a copy of the caller
+ *                  which shares its memory copy-on-write
+ * RETURNS:         the child's PID to the parent, 0 to the child,
+ *                  -1 on failure
+ */
+int32_t do_fork (void){
+    uint32_t flags;
+    cli_and_save(flags);
+
+    pid_t pid = reserve_pid();
+    if(pid > MAX_PID){
+        restore_flags(flags);
+        return -1;
+    }
+
+    pcb_t* parent = get_pcb(active_pid);
+    pcb_t* child = get_pcb(pid);
+    memcpy(child, parent, sizeof(pcb_t));
+    child->flags = TASK_EXECUTING | TASK_FORKED | (parent->flags & TASK_VID_IN_USE);
+    child->parent_pid = active_pid;
+    child->min_flt = 0;
+    child->maj_flt = 0;
+    child->utime = child->stime = 0;
+    child->nvcsw = child->nivcsw = 0;
+    child->nsyscalls = 0;
+
+    if(copy_task_page(parent, child) != 0){
+        free_pid(pid);
+        restore_flags(flags);
+        return -1;
+    }
+    shm_fork(child);
+    fpu_fork(active_pid, pid);
+    setup_user_video_mem(child);
+
+    // Resume the child from the same syscall, returning 0 into user space
+    syscall_frame_t* frame = (syscall_frame_t*)(get_kernel_stack(active_pid) - sizeof(syscall_frame_t));
+    uint32_t* stack = (uint32_t*)get_kernel_stack(pid);
+
+    // iret frame
+    *--stack = frame->ss;
+    *--stack = frame->esp;
+    *--stack = frame->eflags;
+    *--stack = frame->cs;
+    *--stack = frame->eip;
+    *--stack = 0; // Fake error code
+
+    // pushal order, see ret_from_intr
+    *--stack = 0; // eax
+    *--stack = frame->ecx;
+    *--stack = frame->edx;
+    *--stack = frame->ebx;
+    *--stack = 0; // esp (skipped by popal)
+    *--stack = frame->ebp;
+    *--stack = frame->esi;
+    *--stack = frame->edi;
+    finish_task_stack(child, stack);
+
+    sched_enqueue(pid);
+    restore_flags(flags);
+    return pid;
+}
+
+/* do_mmap
+ * DESCRIPTION:     the mmap syscall handler, maps an open file read-only into
+ *                  the caller's address space without copying it
+ * INPUTS:          fd -- file descriptor of an open regular file
+ *                  start -- pointer to a pointer which is set to the
+ *                           start of the mapping
+ * RETURNS:         size of the file in bytes on success, -1 on failure
+ */
+int32_t do_mmap (int32_t fd, uint8_t** start){
+    if(fd >= MAX_FILES || fd < 0 || start == NULL) return -1;
+
+    // Confirm that pointer is within 4MB user page
+    if((uint32_t)start < USER_PAGE_START
+    || (uint32_t)start > USER_PAGE_START + USER_BASE_OFFSET - sizeof(uint8_t*))
+        return -1;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    file_t* file = &pcb->files[fd];
+
+    // Only regular files live in data blocks
+    if(file->flags != FILE_IN_USE || file->ops != &file_fops) return -1;
+
+    uint32_t addr = map_file(pcb, file->inode);
+    if(addr == 0) return -1;
+
+    *start = (uint8_t*)addr;
+    return inode_at(file->inode)->size;
+}
+
+/* do_munmap
+ * DESCRIPTION:     the munmap syscall handler
+ * INPUTS:          start -- address of a mapping returned by mmap
+ * RETURNS:         0 on success, -1 on failure
+ */
+int32_t do_munmap (uint8_t* start){
+    return unmap_file(get_pcb(active_pid), (uint32_t)start);
+}
+
+/* do_shmget
+ * DESCRIPTION:     the shmget syscall handler
+ * INPUTS:          key -- key shared by cooperating programs, or 0 for a
+ *                         new private segment
+ *                  size -- size of the segment in bytes
+ * RETURNS:         id of the segment, -1 on failure
+ */
+int32_t do_shmget (int32_t key, uint32_t size){
+    return shm_get(key, size);
+}
+
+/* do_shmat
+ * DESCRIPTION:     the shmat syscall handler, maps a shared memory segment
+ *                  into the caller's address space
+ * INPUTS:          id -- id from shmget
+ *                  start -- pointer to a pointer which is set to the
+ *                           start of the segment
+ * RETURNS:         size of the segment in bytes on success, -1 on failure
+ */
+int32_t do_shmat (int32_t id, uint8_t** start){
+    if(start == NULL) return -1;
+
+    // Confirm that pointer is within 4MB user page
+    if((uint32_t)start < USER_PAGE_START
+    || (uint32_t)start > USER_PAGE_START + USER_BASE_OFFSET - sizeof(uint8_t*))
+        return -1;
+
+    uint32_t addr = shm_attach(get_pcb(active_pid), id);
+    if(addr == 0) return -1;
+
+    *start = (uint8_t*)addr;
+    return shm_size(id);
+}
+
+/* do_shmdt
+ * DESCRIPTION:     the shmdt syscall handler
+ * INPUTS:          start -- address of a segment returned by shmat
+ * RETURNS:         0 on success, -1 on failure
+ */
+int32_t do_shmdt (uint8_t* start){
+    return shm_detach(get_pcb(active_pid), (uint32_t)start);
+}
+
+/* do_brk
+ * DESCRIPTION:     the brk syscall handler, sets the end of the heap
+ * INPUTS:          end -- the new end of the heap, or NULL to query it
+ * RETURNS:         the end of the heap after the call, -1 on failure
+ */
+int32_t do_brk (void* end){
+    pcb_t* pcb = get_pcb(active_pid);
+    if(end != NULL && set_task_brk(pcb, (uint32_t)end) != 0) return -1;
+    return pcb->brk;
+}
+
+/* do_sbrk
+ * DESCRIPTION:     the sbrk syscall handler, grows or shrinks the heap
+ * INPUTS:          increment -- number of bytes to add (or remove)
+ * RETURNS:         the previous end of the heap, -1 on failure
+ */
+int32_t do_sbrk (int32_t increment){
+    pcb_t* pcb = get_pcb(active_pid);
+    uint32_t old_brk = pcb->brk;
+    if(set_task_brk(pcb, old_brk + increment) != 0) return -1;
+    return old_brk;
+}
+
+/* do_nanosleep
+ * DESCRIPTION:     the nanosleep syscall handler, sleeps for at least
+ *                  the given time (rounded up to whole timer ticks)
+ * INPUTS:          sec -- seconds
+ *                  nsec -- nanoseconds, less than a second
+ * RETURNS:         0 on success, -1 on failure
+ */
+int32_t do_nanosleep (uint32_t sec, uint32_t nsec){
+    if(nsec >= NSEC_PER_SEC) return -1;
+
+    // Anything longer than the timer wheel covers is clamped by add_timer
+    uint32_t ticks;
+    if(sec > MAX_TIMER_DELTA / TIMER_HZ) ticks = MAX_TIMER_DELTA;
+    else ticks = sec * TIMER_HZ + (nsec + NSEC_PER_TICK - 1) / NSEC_PER_TICK;
+    if(ticks == 0) return 0;
+
+    // Sleep past the end of the current, partly elapsed tick
+    sleep_for(ticks + 1);
+    return 0;
+}
+
+/* do_set_affinity
+ * DESCRIPTION:     the set_affinity syscall handler, restricts the CPUs the
+ *                  caller may run on
+ * INPUTS:          mask -- bit n allows CPU n
+ * RETURNS:         the previous mask, -1 if mask allows no running CPU
+ */
+int32_t do_set_affinity (uint32_t mask){
+    mask &= CPUS_ALL;
+    if((mask & smp_online_mask()) == 0) return -1;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    uint32_t old_mask = pcb->cpus_allowed;
+    pcb->cpus_allowed = mask;
+
+    // Returns once the task runs on an allowed CPU
+    sched_migrate();
+    return old_mask;
+}
+
 /* do_set_handler
  * DESCRIPTION:     the set_handler syscall handler
  * INPUTS:          signum -- the signal to register this handler to
@@ -5,11 +5,12 @@
 #include "../tasks/process.h"
 
 int32_t syscall_fail();
+void account_syscall(void);
 
 // Halt status to return upon exception
 #define EXCEPTION_STATUS 256
 
-#define MAX_TASKS 6
+#define MAX_TASKS (MAX_PID + 1)
 
 // Global exception flag
 extern volatile int32_t exception_flag;
@@ -25,6 +26,16 @@ extern int32_t do_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t do_vidmap (uint8_t** screen_start);
 extern int32_t do_set_handler (int32_t signum, void* handler);
 extern int32_t do_sigreturn (void);
+extern int32_t do_mmap (int32_t fd, uint8_t** start);
+extern int32_t do_munmap (uint8_t* start);
+extern int32_t do_fork (void);
+extern int32_t do_shmget (int32_t key, uint32_t size);
+extern int32_t do_shmat (int32_t id, uint8_t** start);
+extern int32_t do_shmdt (uint8_t* start);
+extern int32_t do_brk (void* end);
+extern int32_t do_sbrk (int32_t increment);
+extern int32_t do_nanosleep (uint32_t sec, uint32_t nsec);
+extern int32_t do_set_affinity (uint32_t mask);
 
 // Called by user, executes int 0x80
 extern int32_t ece391_halt (uint8_t status);
@@ -37,6 +48,15 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_munmap (uint8_t* start);
+extern int32_t ece391_fork (void);
+extern int32_t ece391_shmget (int32_t key, uint32_t size);
+extern int32_t ece391_shmat (int32_t id, uint8_t** start);
+extern int32_t ece391_shmdt (uint8_t* start);
+extern int32_t ece391_brk (void* end);
+extern int32_t ece391_sbrk (int32_t increment);
+extern int32_t ece391_nanosleep (uint32_t sec, uint32_t nsec);
 
 // Helper functions
 pid_t prep_task(const uint8_t* command);
@@ -13,10 +13,22 @@
 #include "debug.h"
 #include "tests/tests.h"
 #include "memory/paging.h"
+#include "memory/frame.h"
+#include "memory/slab.h"
+#include "memory/shm.h"
+#include "memory/memtype.h"
 #include "storage/filesys.h"
 #include "interrupts/syscalls.h"
 #include "tasks/process.h"
+#include "tasks/workqueue.h"
+#include "interrupts/softirq.h"
 #include "interrupts/pit.h"
+#include "interrupts/apic.h"
+#include "scheduler/scheduler.h"
+#include "scheduler/timer.h"
+#include "arch/fpu.h"
+#include "arch/mpconfig.h"
+#include "arch/smp.h"
 #define RUN_TESTS 1
 
 /* Macros. */
@@ -72,6 +84,9 @@ void entry(unsigned long magic, unsigned long addr) {
             }
             printf("\n");
 
+            // Keep the frame allocator away from every module
+            frame_reserve_region(mod->mod_start, mod->mod_end);
+
             // Load module 0 as file image
             switch(mod_count){
                 case 0:
@@ -104,7 +119,7 @@ void entry(unsigned long magic, unsigned long addr) {
                 (unsigned)mbi->mmap_addr, (unsigned)mbi->mmap_length);
         for (mmap = (memory_map_t *)mbi->mmap_addr;
                 (unsigned long)mmap < mbi->mmap_addr + mbi->mmap_length;
-                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size)))
+                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size))) {
             printf("    size = 0x%x, base_addr = 0x%#x%#x\n    type = 0x%x,  length    = 0x%#x%#x\n",
                     (unsigned)mmap->size,
                     (unsigned)mmap->base_addr_high,
@@ -112,6 +127,16 @@ void entry(unsigned long magic, unsigned long addr) {
                     (unsigned)mmap->type,
                     (unsigned)mmap->length_high,
                     (unsigned)mmap->length_low);
+
+            /* Type 1 is usable RAM; we can't address anything above 4GB */
+            if (mmap->type == 1 && mmap->base_addr_high == 0)
+                frame_add_region(mmap->base_addr_low,
+                        mmap->length_high ? -mmap->base_addr_low : mmap->length_low);
+        }
+    }
+    /* Without a memory map, fall back on the size of upper memory */
+    else if (CHECK_FLAG(mbi->flags, 0)) {
+        frame_add_region(0x100000, (unsigned)mbi->mem_upper * 1024);
     }
 
     /* Set up IDT */
@@ -158,12 +183,50 @@ void entry(unsigned long magic, unsigned long addr) {
         ltr(KERNEL_TSS);
     }
 
+    /* The boot CPU's own GDT, TSS and per-CPU data. It holds the kernel
+     * lock from here until it switches to the first task */
+    smp_init_boot_cpu();
+
     /* Init the PIC */
     i8259_init();
 
     /* Init page_directory */
     init_paging();
 
+    /* Program the PAT and the cache policy of kernel mappings */
+    init_memtype();
+    printf("PAT %s\n", pat_supported() ? "enabled" : "not supported");
+
+    /* Enable the FPU (and SSE), switched lazily between tasks */
+    init_fpu();
+    printf("FPU enabled%s\n", fpu_has_sse() ? " with SSE" : "");
+
+    /* Find the processors and the IOAPIC in the firmware's tables */
+    mpconfig_init();
+    printf("%u CPUs in the %s tables\n", mp_config()->num_cpus, mp_config()->source);
+
+    /* Move interrupt delivery to the local APIC and IOAPIC if present */
+    if(apic_init() == 0)
+        printf("APIC enabled, timer %u counts per tick\n", apic_timer_counts_per_tick());
+    else
+        printf("No APIC, using the 8259 PIC\n");
+
+    /* Init physical frame allocator (needs the direct map from paging) */
+    init_frames();
+    refill_zero_pool(ZERO_POOL_SIZE);
+    printf("Frame allocator: %u free frames\n", num_free_frames());
+
+    /* Init kernel object caches */
+    init_slab();
+    init_tasks();
+    init_shm();
+    init_timers();
+    init_scheduler();
+
+    /* Start the other CPUs, each waits in its idle loop for tasks */
+    smp_init();
+    printf("%u CPUs online\n", smp_num_cpus());
+
     /*
     load_page_dir(); move page directory address to cr3
     ready_page_dir(); notify page directory loaded through cr0
@@ -191,6 +254,11 @@ void entry(unsigned long magic, unsigned long addr) {
     // We must reserve PID 0 while we do this to avoid overwriting our own stack
     pid_t fake_pid = reserve_pid();
 
+    /* Kernel worker threads, they start running along with the shells */
+    if(init_workqueues() == 0) start_zero_pool_work();
+    else printf("Couldn't start the kernel workqueue\n");
+    if(init_ksoftirqd() != 0) printf("Couldn't start ksoftirqd\n");
+
     int32_t t;
     pid_t pid;
     for(t = NUM_TERMINALS-1; t >= 0; t--){
@@ -200,11 +268,11 @@ void entry(unsigned long magic, unsigned long addr) {
         if(t == 0){
             free_pid(fake_pid);
             set_terminal_pos(0, get_screen_x(), get_screen_y());
-            pit_init();
+            if(apic_timer_init() != 0) pit_init();
             resume_task(pid);
         }
     }
 
-    /* Spin (nicely, so we don't chew up cycles) */
-    asm volatile (".1: hlt; jmp .1;");
+    /* Only reached if the first shell couldn't be started */
+    idle_loop();
 }
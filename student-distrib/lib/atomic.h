@@ -0,0 +1,61 @@
+#ifndef _ATOMIC_H
+#define _ATOMIC_H
+
+#include "types.h"
+
+/* Atomic read-modify-write operations. The locked instructions are also
+ * full memory barriers, and each asm is a compiler barrier */
+
+/* xchg
+ * DESCRIPTION:         stores val and returns what was there
+ * NOTES:               xchg with memory is always locked
+ */
+static inline uint32_t xchg(volatile uint32_t* addr, uint32_t val) {
+    asm volatile ("xchgl %0, %1"
+            : "+r"(val), "+m"(*addr)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* cmpxchg
+ * DESCRIPTION:         stores new if the value is still old
+ * RETURNS:             the value found, old on success
+ */
+static inline uint32_t cmpxchg(volatile uint32_t* addr, uint32_t old, uint32_t new) {
+    uint32_t prev;
+    asm volatile ("lock; cmpxchgl %2, %1"
+            : "=a"(prev), "+m"(*addr)
+            : "r"(new), "0"(old)
+            : "memory", "cc"
+    );
+    return prev;
+}
+
+/* xadd
+ * DESCRIPTION:         adds val
+ * RETURNS:             the value before the addition
+ */
+static inline uint32_t xadd(volatile uint32_t* addr, uint32_t val) {
+    asm volatile ("lock; xaddl %0, %1"
+            : "+r"(val), "+m"(*addr)
+            :
+            : "memory", "cc"
+    );
+    return val;
+}
+
+/* cpu_relax
+ * DESCRIPTION:         spin-wait hint (pause), lets a hyperthread sibling
+ *                      run and avoids the memory-order flush on loop exit
+ */
+static inline void cpu_relax(void) {
+    asm volatile ("pause" : : : "memory");
+}
+
+/* Compiler barrier, stores before it are emitted before any after it
+ * (x86 doesn't reorder stores with each other) */
+#define barrier() asm volatile ("" : : : "memory")
+
+#endif /* _ATOMIC_H */
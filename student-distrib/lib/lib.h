@@ -164,6 +164,44 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Read the timestamp counter (cycles since reset) */
+static inline uint64_t rdtsc(void) {
+    uint64_t val;
+    asm volatile ("rdtsc"
+            : "=A"(val)
+            : /* no inputs */
+            : "memory"
+    );
+    return val;
+}
+
+/* Read a model specific register */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint64_t val;
+    asm volatile ("rdmsr"
+            : "=A"(val)
+            : "c"(msr)
+    );
+    return val;
+}
+
+/* Write a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr"
+            : /* no outputs */
+            : "c"(msr), "A"(val)
+            : "memory"
+    );
+}
+
+/* Query the processor's features (leaf in eax) */
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile ("cpuid"
+            : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+            : "a"(leaf), "c"(0)
+    );
+}
+
 /** min
  * returns the min of two args
  * (chooses the first if equal)
@@ -1,16 +1,118 @@
 #include "spinlock.h"
 
 #include "lib.h"
+#include "atomic.h"
 
-#define LOCKED 1
-#define UNLOCKED 0
+#define TICKET_ONE      0x10000     // Next ticket, in the high half
+#define OWNER_MASK      0xFFFF
+
+#define RW_WRITER       0xFFFFFFFF  // count while a writer holds the lock
+
+#if (SPINLOCK_STATS == 1)
+// Every lock initialized with a name, newest first
+static spinlock_t* named_locks = NULL;
+#endif
 
 /** spin_lock_init
  * DESCRIPTION: initializes a spinlock
  * INPUTS: lock -- pointer to a spinlock
+ *         name -- shown by spin_lock_print_stats, NULL to leave it out
+ */
+void spin_lock_init(spinlock_t* lock, const char* name){
+    lock->tickets = 0;
+
+#if (SPINLOCK_STATS == 1)
+    unsigned long flags;
+    spinlock_t* l;
+
+    memset(&lock->stats, 0, sizeof(lock->stats));
+    lock->name = name;
+    if(name == NULL) return;
+
+    // Initializing a lock again mustn't link it twice
+    cli_and_save(flags);
+    for(l = named_locks; l != NULL && l != lock; l = l->next);
+    if(l == NULL){
+        lock->next = named_locks;
+        named_locks = lock;
+    }
+    restore_flags(flags);
+#endif
+}
+
+/** spin_lock
+ * DESCRIPTION: takes a spinlock, spinning until it is this caller's turn
+ * INPUTS: lock -- pointer to a spinlock
+ * NOTES: leaves interrupts alone, the caller must keep any handler that
+ *        takes the lock from running on this CPU meanwhile
+ */
+void spin_lock(spinlock_t* lock){
+    uint32_t tickets = xadd(&lock->tickets, TICKET_ONE);
+    uint32_t ticket = tickets >> 16;
+
+#if (SPINLOCK_STATS == 1)
+    uint32_t spins = 0;
+    while((lock->tickets & OWNER_MASK) != ticket){
+        cpu_relax();
+        spins++;
+    }
+
+    lock->stats.acquisitions++;
+    if(spins > 0){
+        lock->stats.contended++;
+        lock->stats.spins += spins;
+    }
+    lock->held_since = (uint32_t)rdtsc();
+#else
+    while((lock->tickets & OWNER_MASK) != ticket){
+        cpu_relax();
+    }
+#endif
+}
+
+/** spin_trylock
+ * DESCRIPTION: takes a spinlock only if it is free
+ * INPUTS: lock -- pointer to a spinlock
+ * RETURN VALUE: 1 if it was taken, 0 if it is held
  */
-void spin_lock_init(spinlock_t* lock){
-    lock->lock = UNLOCKED;
+int spin_trylock(spinlock_t* lock){
+    uint32_t tickets = lock->tickets;
+
+    // Free when the owner has caught up with the next ticket
+    if((tickets >> 16) != (tickets & OWNER_MASK)) return 0;
+    if(cmpxchg(&lock->tickets, tickets, tickets + TICKET_ONE) != tickets) return 0;
+
+#if (SPINLOCK_STATS == 1)
+    lock->stats.acquisitions++;
+    lock->held_since = (uint32_t)rdtsc();
+#endif
+    return 1;
+}
+
+/** spin_unlock
+ * DESCRIPTION: releases a spinlock to the next waiter
+ * INPUTS: lock -- pointer to a spinlock
+ */
+void spin_unlock(spinlock_t* lock){
+#if (SPINLOCK_STATS == 1)
+    uint32_t held = (uint32_t)rdtsc() - lock->held_since;
+    if(held > lock->stats.max_hold) lock->stats.max_hold = held;
+#endif
+
+    // Only the holder writes the owner half, and stores aren't reordered
+    // with earlier stores, so a plain 16-bit increment releases it
+    barrier();
+    *(volatile uint16_t*)&lock->tickets = (uint16_t)(lock->tickets + 1);
+    barrier();
+}
+
+/** spin_is_locked
+ * RETURN VALUE: 1 if the lock is held (or waited on), 0 otherwise
+ * INPUTS: lock -- pointer to a spinlock
+ */
+int spin_is_locked(spinlock_t* lock){
+    uint32_t tickets = lock->tickets;
+    return (tickets >> 16) != (tickets & OWNER_MASK);
 }
 
 /** spin_lock_irqsave
@@ -23,12 +125,7 @@ unsigned long spin_lock_irqsave(spinlock_t* lock){
 
     // Save flags
     cli_and_save(flags);
-
-    // Wait until unlocked
-    while(lock->lock == LOCKED);
-    
-    // Lock it ourselves
-    lock->lock = LOCKED;
+    spin_lock(lock);
 
     return flags;
 }
@@ -38,9 +135,111 @@ unsigned long spin_lock_irqsave(spinlock_t* lock){
  * INPUTS: lock -- pointer to a spinlock
  */
 void spin_unlock_irqrestore(spinlock_t* lock, unsigned long flags){
-    // Unlock
-    lock->lock = UNLOCKED;
-    
+    spin_unlock(lock);
+
     // Restore flags (including IF => no need to use sti)
     restore_flags(flags);
 }
+
+/** spin_lock_get_stats
+ * DESCRIPTION: copies out a lock's statistics (all 0 without
+ *              SPINLOCK_STATS)
+ * INPUTS: lock -- pointer to a spinlock
+ *         out -- where to copy them
+ */
+void spin_lock_get_stats(spinlock_t* lock, spinlock_stats_t* out){
+#if (SPINLOCK_STATS == 1)
+    *out = lock->stats;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
+
+/** spin_lock_print_stats
+ * DESCRIPTION: prints the statistics of every named lock
+ */
+void spin_lock_print_stats(void){
+#if (SPINLOCK_STATS == 1)
+    spinlock_t* lock;
+    for(lock = named_locks; lock != NULL; lock = lock->next){
+        printf("%s: %u acquisitions, %u contended (%u spins), max hold %u cycles\n",
+            lock->name, lock->stats.acquisitions, lock->stats.contended,
+            lock->stats.spins, lock->stats.max_hold);
+    }
+#else
+    printf("Lock statistics are off (SPINLOCK_STATS)\n");
+#endif
+}
+
+/** rwlock_init
+ * DESCRIPTION: initializes a reader-writer lock
+ * INPUTS: lock -- pointer to the lock
+ */
+void rwlock_init(rwlock_t* lock){
+    lock->count = 0;
+    lock->writers_waiting = 0;
+}
+
+/** read_lock_irqsave
+ * DESCRIPTION: takes a reader-writer lock shared, once no writer holds it
+ *              or waits for it
+ * INPUTS: lock -- pointer to the lock
+ * RETURN VALUE: flags
+ */
+unsigned long read_lock_irqsave(rwlock_t* lock){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    while(1){
+        uint32_t count = lock->count;
+        if(count != RW_WRITER && lock->writers_waiting == 0
+        && cmpxchg(&lock->count, count, count + 1) == count) break;
+        cpu_relax();
+    }
+    return flags;
+}
+
+/** read_unlock_irqrestore
+ * DESCRIPTION: drops a shared hold, restores flags after
+ * INPUTS: lock -- pointer to the lock
+ */
+void read_unlock_irqrestore(rwlock_t* lock, unsigned long flags){
+    xadd(&lock->count, (uint32_t)-1);
+    restore_flags(flags);
+}
+
+/** write_trylock
+ * DESCRIPTION: takes a reader-writer lock exclusively if nobody holds it
+ * INPUTS: lock -- pointer to the lock
+ * RETURN VALUE: 1 if it was taken, 0 otherwise
+ */
+int write_trylock(rwlock_t* lock){
+    return cmpxchg(&lock->count, 0, RW_WRITER) == 0;
+}
+
+/** write_lock_irqsave
+ * DESCRIPTION: takes a reader-writer lock exclusively, waiting for the
+ *              readers in it to leave
+ * INPUTS: lock -- pointer to the lock
+ * RETURN VALUE: flags
+ */
+unsigned long write_lock_irqsave(rwlock_t* lock){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    xadd(&lock->writers_waiting, 1);
+    while(!write_trylock(lock)){
+        cpu_relax();
+    }
+    xadd(&lock->writers_waiting, (uint32_t)-1);
+    return flags;
+}
+
+/** write_unlock_irqrestore
+ * DESCRIPTION: drops an exclusive hold, restores flags after
+ * INPUTS: lock -- pointer to the lock
+ */
+void write_unlock_irqrestore(rwlock_t* lock, unsigned long flags){
+    xchg(&lock->count, 0);
+    restore_flags(flags);
+}
@@ -1,12 +1,54 @@
 #ifndef _SPINLOCK_H
 #define _SPINLOCK_H
 
-typedef struct{
-    int lock;
+#include "types.h"
+
+/* 1 to count acquisitions, contention and hold times of every lock */
+#define SPINLOCK_STATS 1
+
+typedef struct {
+    uint32_t acquisitions;
+    uint32_t contended;         // Acquisitions that had to wait
+    uint32_t spins;             // Times a waiter went around the loop
+    uint32_t max_hold;          // Longest hold, in TSC cycles
+} spinlock_stats_t;
+
+/* Ticket lock: a locker takes the next ticket (the high half) and waits
+ * until the owner (the low half) reaches it, so waiters get the lock in
+ * the order they arrived */
+typedef struct spinlock {
+    volatile uint32_t tickets;
+#if (SPINLOCK_STATS == 1)
+    const char* name;
+    uint32_t held_since;        // Low half of the TSC when it was taken
+    spinlock_stats_t stats;
+    struct spinlock* next;      // Named locks, see spin_lock_print_stats
+#endif
 } spinlock_t;
 
-void spin_lock_init(spinlock_t* lock);
+/* Reader-writer lock: count is the number of readers, or -1 while a
+ * writer holds it. A waiting writer holds off new readers */
+typedef struct {
+    volatile uint32_t count;
+    volatile uint32_t writers_waiting;
+} rwlock_t;
+
+void spin_lock_init(spinlock_t* lock, const char* name);
+void spin_lock(spinlock_t* lock);
+int spin_trylock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+int spin_is_locked(spinlock_t* lock);
 unsigned long spin_lock_irqsave(spinlock_t* lock);
 void spin_unlock_irqrestore(spinlock_t* lock, unsigned long flags);
 
+void spin_lock_get_stats(spinlock_t* lock, spinlock_stats_t* out);
+void spin_lock_print_stats(void);
+
+void rwlock_init(rwlock_t* lock);
+unsigned long read_lock_irqsave(rwlock_t* lock);
+void read_unlock_irqrestore(rwlock_t* lock, unsigned long flags);
+unsigned long write_lock_irqsave(rwlock_t* lock);
+void write_unlock_irqrestore(rwlock_t* lock, unsigned long flags);
+int write_trylock(rwlock_t* lock);
+
 #endif /* _SPINLOCK_H */
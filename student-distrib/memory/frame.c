@@ -0,0 +1,379 @@
+#include "frame.h"
+
+#include "../lib/lib.h"
+#include "../lib/spinlock.h"
+#include "../tasks/workqueue.h"
+
+#define MAX_MEM_REGIONS     16
+#define MAX_RESERVED        8
+
+/* frame_state entries: the order of the block starting at this frame,
+ * with FRAME_FREE set if the block is sitting in a free list */
+#define FRAME_FREE          0x80
+#define FRAME_ORDER_MASK    0x7F
+
+#define FRAME_INDEX(addr)   (((addr) - FRAME_MEM_START) >> FRAME_SHIFT)
+#define FRAME_ADDR(index)   (FRAME_MEM_START + ((index) << FRAME_SHIFT))
+
+/* Free blocks are linked through their own (direct-mapped) memory */
+typedef struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+} free_block_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} mem_region_t;
+
+static mem_region_t mem_regions[MAX_MEM_REGIONS];
+static int num_mem_regions = 0;
+static mem_region_t reserved[MAX_RESERVED];
+static int num_reserved = 0;
+
+static uint8_t frame_state[MAX_FRAMES];
+static uint8_t frame_refs[MAX_FRAMES]; // References to allocated blocks
+static free_block_t* free_lists[FRAME_MAX_ORDER + 1];
+static uint32_t free_count = 0;
+static spinlock_t frame_lock;
+
+// Frames zeroed ahead of time by the idle loop, or by system_wq when the
+// pool runs low and no CPU goes idle
+static uint32_t zero_pool[ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+static work_t zero_pool_work;
+static int zero_pool_work_ready = 0;
+
+/* list_push
+ * DESCRIPTION:         adds the block at index to the free list of its order
+ */
+static void list_push(uint32_t index, uint32_t order){
+    free_block_t* block = (free_block_t*)FRAME_ADDR(index);
+    block->prev = NULL;
+    block->next = free_lists[order];
+    if(block->next != NULL) block->next->prev = block;
+    free_lists[order] = block;
+    frame_state[index] = FRAME_FREE | order;
+}
+
+/* list_remove
+ * DESCRIPTION:         unlinks the block at index from the free list of its order
+ */
+static void list_remove(uint32_t index, uint32_t order){
+    free_block_t* block = (free_block_t*)FRAME_ADDR(index);
+    if(block->prev != NULL) block->prev->next = block->next;
+    else free_lists[order] = block->next;
+    if(block->next != NULL) block->next->prev = block->prev;
+    frame_state[index] = order;
+}
+
+/* release_block
+ * DESCRIPTION:         returns a block to the free lists, merging it with its
+ *                      buddy for as long as the buddy is also free
+ * NOTES:               caller must hold frame_lock
+ */
+static void release_block(uint32_t index, uint32_t order){
+    free_count += 1 << order;
+
+    while(order < FRAME_MAX_ORDER){
+        uint32_t buddy = index ^ (1 << order);
+        if(buddy >= MAX_FRAMES || frame_state[buddy] != (FRAME_FREE | order)) break;
+
+        list_remove(buddy, order);
+        index &= ~(1 << order);
+        order++;
+    }
+
+    list_push(index, order);
+}
+
+/* is_reserved
+ * RETURNS:             1 if the frame at addr overlaps a reserved region
+ */
+static int is_reserved(uint32_t addr){
+    int i;
+    for(i = 0; i < num_reserved; i++){
+        if(addr < reserved[i].end && addr + FRAME_SIZE > reserved[i].start) return 1;
+    }
+    return 0;
+}
+
+/* release_range
+ * DESCRIPTION:         frees every frame in [start, end) in the largest
+ *                      naturally aligned blocks that fit
+ */
+static void release_range(uint32_t start, uint32_t end){
+    uint32_t index = FRAME_INDEX(start);
+    uint32_t last = FRAME_INDEX(end);
+
+    while(index < last){
+        uint32_t order = 0;
+        while(order < FRAME_MAX_ORDER
+           && !(index & ((2 << order) - 1))
+           && index + (2 << order) <= last){
+            order++;
+        }
+        release_block(index, order);
+        index += 1 << order;
+    }
+}
+
+/* frame_add_region
+ * DESCRIPTION:         records a range of usable RAM from the bootloader
+ * INPUTS:              start -- physical start address
+ *                      length -- length of the range in bytes
+ */
+void frame_add_region(uint32_t start, uint32_t length){
+    if(num_mem_regions >= MAX_MEM_REGIONS) return;
+
+    // Clip to what the allocator manages (also avoids 32-bit overflow)
+    uint32_t end = start + length < start ? FRAME_MEM_END : start + length;
+    start = max(start, FRAME_MEM_START);
+    end = min(end, FRAME_MEM_END);
+    if(start >= end) return;
+
+    mem_regions[num_mem_regions].start = start;
+    mem_regions[num_mem_regions].end = end;
+    num_mem_regions++;
+}
+
+/* frame_reserve_region
+ * DESCRIPTION:         marks a range of RAM as in use (modules, etc.) so it
+ *                      is never handed out
+ * INPUTS:              start -- physical start address
+ *                      end -- physical end address (exclusive)
+ */
+void frame_reserve_region(uint32_t start, uint32_t end){
+    if(num_reserved >= MAX_RESERVED) return;
+
+    reserved[num_reserved].start = start;
+    reserved[num_reserved].end = end;
+    num_reserved++;
+}
+
+/* init_frames
+ * DESCRIPTION:         builds the buddy free lists from the recorded regions
+ * NOTES:               paging (and the direct map) must be enabled first,
+ *                      since the free lists live inside the free frames
+ */
+void init_frames(void){
+    int i;
+    uint32_t addr, run_start;
+
+    spin_lock_init(&frame_lock, "frames");
+    for(i = 0; i <= FRAME_MAX_ORDER; i++){
+        free_lists[i] = NULL;
+    }
+
+    for(i = 0; i < num_mem_regions; i++){
+        // Page-align inwards
+        uint32_t start = (mem_regions[i].start + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+        uint32_t end = mem_regions[i].end & ~(FRAME_SIZE - 1);
+
+        // Free each run of frames between reserved regions
+        run_start = start;
+        for(addr = start; addr < end; addr += FRAME_SIZE){
+            if(is_reserved(addr)){
+                if(run_start < addr) release_range(run_start, addr);
+                run_start = addr + FRAME_SIZE;
+            }
+        }
+        if(run_start < end) release_range(run_start, end);
+    }
+}
+
+/* alloc_frames
+ * DESCRIPTION:         allocates 2^order physically contiguous frames,
+ *                      aligned to their size
+ * INPUTS:              order -- log2 of the number of frames
+ * RETURNS:             physical (and direct-mapped) address, 0 on failure
+ */
+uint32_t alloc_frames(uint32_t order){
+    if(order > FRAME_MAX_ORDER) return 0;
+
+    unsigned long flags = spin_lock_irqsave(&frame_lock);
+
+    // Find the smallest block that will do
+    uint32_t o = order;
+    while(o <= FRAME_MAX_ORDER && free_lists[o] == NULL) o++;
+    if(o > FRAME_MAX_ORDER){
+        // Last resort, take back a frame from the zero pool
+        uint32_t frame = 0;
+        if(order == 0 && zero_pool_count > 0) frame = zero_pool[--zero_pool_count];
+        spin_unlock_irqrestore(&frame_lock, flags);
+        return frame;
+    }
+
+    uint32_t index = FRAME_INDEX((uint32_t)free_lists[o]);
+    list_remove(index, o);
+
+    // Split off the upper halves until the block is the right size
+    while(o > order){
+        o--;
+        list_push(index + (1 << o), o);
+    }
+    frame_state[index] = order;
+    frame_refs[index] = 1;
+    free_count -= 1 << order;
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return FRAME_ADDR(index);
+}
+
+/* alloc_frame
+ * DESCRIPTION:         allocates a single 4KB frame
+ * RETURNS:             physical address, 0 on failure
+ */
+uint32_t alloc_frame(void){
+    return alloc_frames(0);
+}
+
+/* free_frames
+ * DESCRIPTION:         drops a reference to a block from alloc_frames,
+ *                      returning it to the allocator with the last one
+ * INPUTS:              addr -- address returned by alloc_frames
+ *                      order -- the order it was allocated with
+ */
+void free_frames(uint32_t addr, uint32_t order){
+    if(addr < FRAME_MEM_START || addr >= FRAME_MEM_END) return;
+    if(order > FRAME_MAX_ORDER) return;
+
+    uint32_t index = FRAME_INDEX(addr);
+
+    unsigned long flags = spin_lock_irqsave(&frame_lock);
+
+    // Guard against double frees
+    if(!(frame_state[index] & FRAME_FREE) && --frame_refs[index] == 0){
+        release_block(index, order);
+    }
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/* get_frame
+ * DESCRIPTION:         takes another reference to an allocated block, so
+ *                      that it can be shared (e.g. copy-on-write pages)
+ * INPUTS:              addr -- address returned by alloc_frames
+ */
+void get_frame(uint32_t addr){
+    if(addr < FRAME_MEM_START || addr >= FRAME_MEM_END) return;
+
+    unsigned long flags = spin_lock_irqsave(&frame_lock);
+    frame_refs[FRAME_INDEX(addr)]++;
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+/* frame_refcount
+ * RETURNS:             the number of references to the block at addr
+ */
+uint32_t frame_refcount(uint32_t addr){
+    if(addr < FRAME_MEM_START || addr >= FRAME_MEM_END) return 0;
+    return frame_refs[FRAME_INDEX(addr)];
+}
+
+/* frame_order
+ * RETURNS:             the order the block at addr was allocated with
+ */
+uint32_t frame_order(uint32_t addr){
+    if(addr < FRAME_MEM_START || addr >= FRAME_MEM_END) return 0;
+    return frame_state[FRAME_INDEX(addr)] & FRAME_ORDER_MASK;
+}
+
+/* free_frame
+ * DESCRIPTION:         frees a single 4KB frame
+ * INPUTS:              addr -- address returned by alloc_frame
+ */
+void free_frame(uint32_t addr){
+    free_frames(addr, 0);
+}
+
+/* alloc_zeroed_frame
+ * DESCRIPTION:         allocates a single 4KB frame filled with zeros,
+ *                      from the zero pool when possible
+ * RETURNS:             physical address, 0 on failure
+ */
+uint32_t alloc_zeroed_frame(void){
+    unsigned long flags = spin_lock_irqsave(&frame_lock);
+    uint32_t frame = zero_pool_count > 0 ? zero_pool[--zero_pool_count] : 0;
+    int low = zero_pool_count < ZERO_POOL_LOW;
+    spin_unlock_irqrestore(&frame_lock, flags);
+
+    // A busy system may not go idle for a long time
+    if(low && zero_pool_work_ready) schedule_work(&zero_pool_work);
+    if(frame != 0) return frame;
+
+    // Pool is dry, zero one on the spot
+    frame = alloc_frame();
+    if(frame != 0) memset((void*)frame, 0, FRAME_SIZE);
+    return frame;
+}
+
+/* refill_zero_pool
+ * DESCRIPTION:         zeroes free frames into the zero pool
+ * INPUTS:              max -- most frames to zero in this call
+ * RETURNS:             the number of frames added
+ * NOTES:               frames are zeroed without holding the lock (and with
+ *                      interrupts as the caller left them), so this can run
+ *                      from the idle loop without holding anyone up
+ */
+uint32_t refill_zero_pool(uint32_t max){
+    uint32_t added = 0;
+    unsigned long flags;
+
+    while(added < max){
+        flags = spin_lock_irqsave(&frame_lock);
+        int full = zero_pool_count >= ZERO_POOL_SIZE;
+        spin_unlock_irqrestore(&frame_lock, flags);
+        if(full) break;
+
+        uint32_t frame = alloc_frame();
+        if(frame == 0) break;
+        memset((void*)frame, 0, FRAME_SIZE);
+
+        flags = spin_lock_irqsave(&frame_lock);
+        if(zero_pool_count < ZERO_POOL_SIZE){
+            zero_pool[zero_pool_count++] = frame;
+            frame = 0;
+        }
+        spin_unlock_irqrestore(&frame_lock, flags);
+
+        // Someone else filled the pool first
+        if(frame != 0){
+            free_frame(frame);
+            break;
+        }
+        added++;
+    }
+    return added;
+}
+
+/* zero_pool_worker
+ * DESCRIPTION:         system_wq work filling the zero pool back up
+ */
+static void zero_pool_worker(uint32_t data){
+    refill_zero_pool(ZERO_POOL_SIZE);
+}
+
+/* start_zero_pool_work
+ * DESCRIPTION:         lets alloc_zeroed_frame hand refills to system_wq
+ *                      once the pool runs low, system_wq must be running
+ */
+void start_zero_pool_work(void){
+    init_work(&zero_pool_work, zero_pool_worker, 0);
+    zero_pool_work_ready = 1;
+}
+
+/* num_free_frames
+ * RETURNS:             the number of 4KB frames currently free
+ *                      (including the zero pool)
+ */
+uint32_t num_free_frames(void){
+    return free_count + zero_pool_count;
+}
+
+/* num_zeroed_frames
+ * RETURNS:             the number of frames waiting in the zero pool
+ */
+uint32_t num_zeroed_frames(void){
+    return zero_pool_count;
+}
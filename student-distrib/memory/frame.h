@@ -0,0 +1,53 @@
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "../lib/types.h"
+
+#define FRAME_SIZE          0x1000
+#define FRAME_SHIFT         12
+
+/* Largest block handed out is 2^FRAME_MAX_ORDER frames (one 4MB page) */
+#define FRAME_MAX_ORDER     10
+#define FRAME_4MB_ORDER     FRAME_MAX_ORDER
+
+/* Physical memory managed by the frame allocator. Everything below
+ * FRAME_MEM_START belongs to the kernel, and the whole range is
+ * direct-mapped by init_paging so that frame addresses can be used as
+ * kernel pointers. The direct map ends where user space begins. */
+#define FRAME_MEM_START     0x00800000
+#define FRAME_MEM_END       0x08000000
+#define MAX_FRAMES          ((FRAME_MEM_END - FRAME_MEM_START) >> FRAME_SHIFT)
+
+/* Frames kept zeroed ahead of time for demand-zero faults */
+#define ZERO_POOL_SIZE      64
+#define ZERO_POOL_BATCH     4   // Frames zeroed per idle loop iteration
+#define ZERO_POOL_LOW       16  // Below this, system_wq refills the pool
+
+/* Boot-time description of physical memory (called before init_frames) */
+void frame_add_region(uint32_t start, uint32_t length);
+void frame_reserve_region(uint32_t start, uint32_t end);
+
+/* Builds the free lists, paging must already be enabled */
+void init_frames(void);
+
+/* Allocation functions, return a physical address or 0 on failure */
+uint32_t alloc_frames(uint32_t order);
+uint32_t alloc_frame(void);
+
+void free_frames(uint32_t addr, uint32_t order);
+void free_frame(uint32_t addr);
+
+/* Reference counting for shared frames, freeing drops a reference */
+void get_frame(uint32_t addr);
+uint32_t frame_refcount(uint32_t addr);
+uint32_t frame_order(uint32_t addr);
+
+/* Pre-zeroed frames */
+uint32_t alloc_zeroed_frame(void);
+uint32_t refill_zero_pool(uint32_t max);
+void start_zero_pool_work(void);
+
+uint32_t num_free_frames(void);
+uint32_t num_zeroed_frames(void);
+
+#endif /* _FRAME_H */
@@ -0,0 +1,130 @@
+#include "memtype.h"
+#include "frame.h"
+
+#include "../lib/lib.h"
+
+#define CPUID_PAT           (1 << 16)   // CPUID.01h:EDX
+
+/* PAT entries */
+#define PAT_UC              0x00
+#define PAT_WC              0x01
+#define PAT_WT              0x04
+#define PAT_WP              0x05
+#define PAT_WB              0x06
+#define PAT_UC_MINUS        0x07
+
+/* Entry i of the PAT is byte i of the MSR. The upper half (PAT bit set)
+ * mirrors the lower half, so 4MB pages and 4KB pages agree */
+#define PAT_LOW             ((PAT_WB) | (PAT_WC << 8) | (PAT_UC_MINUS << 16) | (PAT_UC << 24))
+#define PAT_VALUE           (((uint64_t)PAT_LOW << 32) | PAT_LOW)
+
+const char* memtype_name[] = {"WB", "WC", "UC-", "UC"};
+
+/* pat_supported
+ * RETURNS:             1 if the processor has a PAT, 0 otherwise
+ */
+int pat_supported(void){
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_PAT) != 0;
+}
+
+/* load_pat
+ * DESCRIPTION:         programs this CPU's PAT with the types in memtype.h
+ */
+static void load_pat(void){
+    if(!pat_supported()) return;
+
+    // Caches must not hold lines of the old types
+    asm volatile("wbinvd" : : : "memory");
+    wrmsr(IA32_PAT_MSR, PAT_VALUE);
+    asm volatile("wbinvd" : : : "memory");
+}
+
+/* init_memtype
+ * DESCRIPTION:         programs the PAT and sets the cache policy of the
+ *                      kernel's mappings: write-back for the kernel,
+ *                      write-combining for video memory and the terminal
+ *                      buffers
+ * NOTES:               must run before any task page directory is created,
+ *                      since those copy the kernel's directory entries.
+ *                      Without a PAT, MEM_WC falls back to write-through
+ */
+void init_memtype(void){
+    uint32_t flags;
+    cli_and_save(flags);
+
+    load_pat();
+    set_kernel_memtype(KERNEL_BASE_ADDR, USER_BASE_OFFSET, MEM_WB);
+    set_kernel_memtype(VIDEO_BASE_ADDR, (NUM_TERMINALS + 1) * VIDEO_SIZE, MEM_WC);
+
+    restore_flags(flags);
+}
+
+/* memtype_init_ap
+ * DESCRIPTION:         programs a secondary CPU's PAT like the boot CPU's,
+ *                      so the shared mappings mean the same types on it
+ */
+void memtype_init_ap(void){
+    uint32_t flags;
+    cli_and_save(flags);
+    load_pat();
+    restore_flags(flags);
+}
+
+/* pte_set_memtype
+ * DESCRIPTION:         selects the memory type of a 4KB mapping
+ * INPUTS:              pte -- the page table entry
+ *                      type -- the memory type
+ */
+void pte_set_memtype(PTE_t* pte, mem_type_t type){
+    pte->pat = 0;
+    pte->pcd = (type >> 1) & 1;
+    pte->pwt = type & 1;
+}
+
+/* pde_set_memtype
+ * DESCRIPTION:         selects the memory type of a 4MB mapping
+ * INPUTS:              pde -- the page directory entry
+ *                      type -- the memory type
+ */
+void pde_set_memtype(PDE_t* pde, mem_type_t type){
+    pde->pcd = (type >> 1) & 1;
+    pde->pwt = type & 1;
+}
+
+/* pte_get_memtype
+ * RETURNS:             the memory type of a 4KB mapping
+ */
+mem_type_t pte_get_memtype(PTE_t* pte){
+    return (mem_type_t)((pte->pcd << 1) | pte->pwt);
+}
+
+/* set_kernel_memtype
+ * DESCRIPTION:         changes the memory type of a range of kernel mappings
+ * INPUTS:              vaddr -- start of the range
+ *                      length -- length of the range in bytes
+ *                      type -- the memory type
+ * RETURNS:             0 on success, -1 if the range isn't kernel memory
+ */
+int set_kernel_memtype(uint32_t vaddr, uint32_t length, mem_type_t type){
+    if(PD_INDEX(vaddr + length - 1) >= USER_PDE) return -1;
+
+    uint32_t addr = PAGE_ALIGN_DOWN(vaddr);
+    while(addr < vaddr + length){
+        PDE_t* pde = get_kernel_pde(addr);
+        if(pde->p && pde->ps){
+            pde_set_memtype(pde, type);
+            addr = (PD_INDEX(addr) + 1) << 22;
+            continue;
+        }
+
+        PTE_t* pte = get_kernel_pte(addr);
+        if(pte != NULL && pte->p) pte_set_memtype(pte, type);
+        addr += FRAME_SIZE;
+    }
+
+    // Kernel mappings are global, a CR3 reload wouldn't drop them
+    flush_tlb_global();
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef _MEMTYPE_H
+#define _MEMTYPE_H
+
+#include "../lib/types.h"
+#include "paging.h"
+
+#define IA32_PAT_MSR        0x277
+
+/* Memory types, the values are the PAT entries selected through the PWT
+ * and PCD bits of a mapping (PAT bit clear). init_memtype programs the
+ * PAT so that entries 0-3 (and 4-7) hold these types */
+typedef enum {
+    MEM_WB = 0,         // Write-back: RAM
+    MEM_WC = 1,         // Write-combining: framebuffers
+    MEM_UC_MINUS = 2,   // Uncached, overridable by MTRRs
+    MEM_UC = 3          // Uncached: MMIO
+} mem_type_t;
+
+/* Programs the PAT and applies the kernel's memory types */
+void init_memtype(void);
+void memtype_init_ap(void);
+int pat_supported(void);
+
+/* Cache policy of single mappings */
+void pte_set_memtype(PTE_t* pte, mem_type_t type);
+void pde_set_memtype(PDE_t* pde, mem_type_t type);
+mem_type_t pte_get_memtype(PTE_t* pte);
+
+/* Cache policy of kernel mappings (shared by every page directory) */
+int set_kernel_memtype(uint32_t vaddr, uint32_t length, mem_type_t type);
+
+extern const char* memtype_name[];
+
+#endif /* _MEMTYPE_H */
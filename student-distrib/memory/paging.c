@@ -1,8 +1,12 @@
 #include "paging.h"
+#include "../arch/smp.h"
+#include "frame.h"
+#include "tlb.h"
+#include "memtype.h"
 
 static PDE_t page_dir[PD_LENGTH] __attribute__((aligned (4096)));
 static PTE_t page_table[PT_LENGTH] __attribute__((aligned (4096)));
-static PTE_t page_table_vidmap[PT_LENGTH] __attribute__((aligned (4096)));
+static PTE_t page_table_vidmap[NUM_TERMINALS][PT_LENGTH] __attribute__((aligned (4096)));
 
 /* init_paging
  * DESCRIPTION: Initializes page directory and page table of the first PDE
@@ -25,6 +29,7 @@ void init_paging() {
     page_table[VIDEO_PT_OFFSET].dirty = 0;
     page_table[VIDEO_PT_OFFSET].pcd = 0;
     page_table[VIDEO_PT_OFFSET].pwt = 0;
+    page_table[VIDEO_PT_OFFSET].g = 1;
     page_table[VIDEO_PT_OFFSET].us = 0;
     page_table[VIDEO_PT_OFFSET].rw = 1;
     page_table[VIDEO_PT_OFFSET].p = 1;
@@ -32,11 +37,12 @@ void init_paging() {
     // Map terminal vmem buffers next to actual video memory
     int t;
     for(t = 1; t < NUM_TERMINALS + 1; t++){
-        page_table[VIDEO_PT_OFFSET + t].base = (VIDEO_BASE_ADDR >> 12) + t * VIDEO_SIZE;
+        page_table[VIDEO_PT_OFFSET + t].base = (VIDEO_BASE_ADDR >> 12) + t;
         page_table[VIDEO_PT_OFFSET + t].pat = 0;
         page_table[VIDEO_PT_OFFSET + t].dirty = 0;
         page_table[VIDEO_PT_OFFSET + t].pcd = 0;
         page_table[VIDEO_PT_OFFSET + t].pwt = 0;
+        page_table[VIDEO_PT_OFFSET + t].g = 1;
         page_table[VIDEO_PT_OFFSET + t].us = 0;
         page_table[VIDEO_PT_OFFSET + t].rw = 1;
         page_table[VIDEO_PT_OFFSET + t].p = 1;
@@ -46,7 +52,7 @@ void init_paging() {
     page_dir[0].base = (int) page_table >> 12;
     page_dir[0].ps = 0;
     page_dir[0].dirty = 0;
-    page_dir[0].pcd = 1;
+    page_dir[0].pcd = 0;
     page_dir[0].pwt = 0;
     page_dir[0].us = 0;
     page_dir[0].rw = 1;
@@ -57,101 +63,554 @@ void init_paging() {
     page_dir[1].g = 1;
     page_dir[1].ps = 1;
     page_dir[1].dirty = 0;
-    page_dir[1].pcd = 1;
+    page_dir[1].pcd = 0;
     page_dir[1].pwt = 0;
     page_dir[1].us = 0;
     page_dir[1].rw = 1;
     page_dir[1].p = 1;
 
+    /* Direct-map frame memory (8MB - 128MB) for the kernel only */
+    for (i = DIRECT_MAP_PDE; i < DIRECT_MAP_END_PDE; ++i) {
+        page_dir[i].base = (i * USER_BASE_OFFSET) >> 12;
+        page_dir[i].g = 1;
+        page_dir[i].ps = 1;
+        page_dir[i].dirty = 0;
+        page_dir[i].pcd = 0;
+        page_dir[i].pwt = 0;
+        page_dir[i].us = 0;
+        page_dir[i].rw = 1;
+        page_dir[i].p = 1;
+    }
+
     /* Set rest of page directory to unmapped */
-    for (i = 2; i < PD_LENGTH; ++i) {
+    for (i = DIRECT_MAP_END_PDE; i < PD_LENGTH; ++i) {
         page_dir[i].p = 0;
     }
 
+    /* Video memory page tables handed to vidmap users, one per terminal */
+    for (t = 0; t < NUM_TERMINALS; t++) {
+        for (i = 0; i < PT_LENGTH; ++i) {
+            page_table_vidmap[t][i].p = 0;
+        }
+        page_table_vidmap[t][0].dirty = 0;
+        pte_set_memtype(&page_table_vidmap[t][0], MEM_WC);
+        page_table_vidmap[t][0].us = 1;
+        page_table_vidmap[t][0].rw = 1;
+        page_table_vidmap[t][0].p = 1;
+    }
+    sync_user_video_mem();
+
     load_pd(page_dir);
 }
 
+/* create_task_page
+ * DESCRIPTION:     Allocates a page directory for a task which shares all of
+ *                  the kernel's mappings and has an empty user page table
+ * INPUTS:          pcb -- the PCB of the task
+ * RETURNS:         0 on success, -1 if out of memory
+ */
+int create_task_page(pcb_t* pcb){
+  uint32_t dir = alloc_frame();
+  if(dir == 0) return -1;
+
+  // Kernel PDEs are shared, user PDEs start out unmapped
+  memcpy((void*)dir, page_dir, USER_PDE * PDE_SIZE);
+  memset((PDE_t*)dir + USER_PDE, 0, (PD_LENGTH - USER_PDE) * PDE_SIZE);
+  pcb->page_dir = dir;
+
+  if(get_task_pte(pcb, USER_PAGE_START, 1) == NULL){
+    free_frame(dir);
+    pcb->page_dir = 0;
+    return -1;
+  }
+  return 0;
+}
+
+/* get_task_pte
+ * DESCRIPTION:     Finds the page table entry of a user address in a task
+ * INPUTS:          pcb -- the PCB of the task
+ *                  vaddr -- user virtual address
+ *                  create -- if nonzero, allocate the page table when missing
+ * RETURNS:         pointer to the PTE, or NULL if there is none
+ */
+PTE_t* get_task_pte(pcb_t* pcb, uint32_t vaddr, int create){
+  if(pcb == NULL || pcb->page_dir == 0) return NULL;
+  if(PD_INDEX(vaddr) < USER_PDE || PD_INDEX(vaddr) == USER_VIDEO_PDE) return NULL;
+
+  PDE_t* pde = (PDE_t*)pcb->page_dir + PD_INDEX(vaddr);
+  if(!pde->p){
+    if(!create) return NULL;
+
+    uint32_t table = alloc_zeroed_frame();
+    if(table == 0) return NULL;
+
+    pde->base = table >> 12;
+    pde->ps = 0;
+    pde->dirty = 0;
+    pde->pcd = 0;
+    pde->pwt = 0;
+    pde->g = 0;
+    pde->us = 1;
+    pde->rw = 1;
+    pde->p = 1;
+  }
+
+  return (PTE_t*)(pde->base << 12) + PT_INDEX(vaddr);
+}
+
+/* map_task_page
+ * DESCRIPTION:     Backs one 4KB user page of a task with a fresh, zeroed frame
+ * INPUTS:          pcb -- the PCB of the task
+ *                  vaddr -- user virtual address
+ * RETURNS:         0 on success, -1 on failure
+ */
+int map_task_page(pcb_t* pcb, uint32_t vaddr){
+  PTE_t* pte = get_task_pte(pcb, vaddr, 1);
+  if(pte == NULL) return -1;
+  if(pte->p) return 0;
+
+  uint32_t frame = alloc_zeroed_frame();
+  if(frame == 0) return -1;
+
+  pte->base = frame >> 12;
+  pte->pat = 0;
+  pte->dirty = 0;
+  pte->pcd = 0;
+  pte->pwt = 0;
+  pte->g = 0;
+  pte->us = 1;
+  pte->rw = 1;
+  pte->p = 1;
+  return 0;
+}
+
+/* map_foreign_page
+ * DESCRIPTION:     Maps a user page of a task read-only onto memory the task
+ *                  doesn't own (such as the filesystem image)
+ * INPUTS:          pcb -- the PCB of the task
+ *                  vaddr -- page aligned user virtual address
+ *                  phys -- page aligned physical address to map
+ * RETURNS:         0 on success, -1 on failure
+ */
+int map_foreign_page(pcb_t* pcb, uint32_t vaddr, uint32_t phys){
+  PTE_t* pte = get_task_pte(pcb, vaddr, 1);
+  if(pte == NULL) return -1;
+
+  pte->base = phys >> 12;
+  pte->pat = 0;
+  pte->dirty = 0;
+  pte->pcd = 0;
+  pte->pwt = 0;
+  pte->g = 0;
+  pte->avail = PTE_NOT_OWNED;
+  pte->us = 1;
+  pte->rw = 0;
+  pte->p = 1;
+  return 0;
+}
+
+/* map_shared_page
+ * DESCRIPTION:     Maps a user page of a task writable onto a frame shared
+ *                  with other tasks, taking a reference to the frame
+ * INPUTS:          pcb -- the PCB of the task
+ *                  vaddr -- page aligned user virtual address
+ *                  frame -- the shared frame
+ * RETURNS:         0 on success, -1 on failure
+ */
+int map_shared_page(pcb_t* pcb, uint32_t vaddr, uint32_t frame){
+  PTE_t* pte = get_task_pte(pcb, vaddr, 1);
+  if(pte == NULL) return -1;
+
+  get_frame(frame);
+  pte->base = frame >> 12;
+  pte->pat = 0;
+  pte->dirty = 0;
+  pte->pcd = 0;
+  pte->pwt = 0;
+  pte->g = 0;
+  pte->avail = PTE_SHARED;
+  pte->us = 1;
+  pte->rw = 1;
+  pte->p = 1;
+  return 0;
+}
+
+/* unmap_task_page
+ * DESCRIPTION:     Removes a user page from a task, freeing its frame if the
+ *                  task owns it
+ * INPUTS:          pcb -- the PCB of the task
+ *                  vaddr -- user virtual address
+ */
+void unmap_task_page(pcb_t* pcb, uint32_t vaddr){
+  PTE_t* pte = get_task_pte(pcb, vaddr, 0);
+  if(pte == NULL || !pte->p) return;
+
+  if(!(pte->avail & PTE_NOT_OWNED)) free_frame(pte->base << 12);
+  *(uint32_t*)pte = 0;
+  if(get_cr3() == pcb->page_dir) tlb_flush_page(vaddr);
+}
+
+/* demand_page
+ * DESCRIPTION:     Resolves a fault on a not-present user page of a task.
+ *                  Program text is mapped in place (see LOADER_XIP), other
+ *                  pages of the executable are read from the filesystem
+ *                  image, BSS, heap and stack pages are zero-filled
+ * INPUTS:          pcb -- the PCB of the faulting task
+ *                  addr -- the faulting address
+ * RETURNS:         FAULT_MAJOR if the page was read from the file,
+ *                  FAULT_MINOR if it was zero-filled, FAULT_FAIL if the
+ *                  address is not part of the task's memory
+ */
+int demand_page(pcb_t* pcb, uint32_t addr){
+  uint32_t page = addr & ~(FRAME_SIZE - 1);
+
+  // Only the image (incl. BSS), the heap and the stack are demand paged
+  if(!(page >= USER_LOAD_ADDR && page < pcb->image_end)
+  && !(page >= pcb->heap_start && page < pcb->brk)
+  && !(page >= USER_STACK - USER_STACK_SIZE && page < USER_STACK)){
+    return FAULT_FAIL;
+  }
+
+#if (LOADER_XIP == 1)
+  // Nothing is copied for text pages
+  if(page >= pcb->text_start && page < pcb->text_end){
+    // Data blocks are page aligned within the (page aligned) module
+    inode_t* inode = inode_at(pcb->exe_inode);
+    uint8_t* block = data_at(inode->block_nums[(page - USER_LOAD_ADDR) / BLOCK_SIZE]);
+    return map_foreign_page(pcb, page, (uint32_t)block) == 0 ? FAULT_MINOR : FAULT_FAIL;
+  }
+#endif
+
+  if(map_task_page(pcb, page) != 0) return FAULT_FAIL;
+  if(page >= pcb->image_file_end) return FAULT_MINOR;
+
+  // Fill the (zeroed) frame through the direct map
+  PTE_t* pte = get_task_pte(pcb, page, 0);
+  read_data(pcb->exe_inode, page - USER_LOAD_ADDR, (uint8_t*)(pte->base << 12),
+            min(FRAME_SIZE, pcb->image_file_end - page));
+  return FAULT_MAJOR;
+}
+
+/* copy_task_page
+ * DESCRIPTION:     Gives a child task a copy of the parent's address space.
+ *                  Frames are shared read-only and marked copy-on-write in
+ *                  both tasks, only the page tables are copied
+ * INPUTS:          parent -- the PCB of the task being copied
+ *                  child -- the PCB of the new task
+ * RETURNS:         0 on success, -1 if out of memory
+ * SIDE EFFECTS:    flushes the TLB if the parent's directory is loaded
+ */
+int copy_task_page(pcb_t* parent, pcb_t* child){
+  if(create_task_page(child) != 0) return -1;
+
+  int i, j;
+  PDE_t* dir = (PDE_t*)parent->page_dir;
+  for(i = USER_PDE; i < PD_LENGTH; i++){
+    // The vidmap page is set up again by the caller
+    if(!dir[i].p || i == USER_VIDEO_PDE) continue;
+
+    PTE_t* table = (PTE_t*)(dir[i].base << 12);
+    for(j = 0; j < PT_LENGTH; j++){
+      if(!table[j].p) continue;
+
+      uint32_t vaddr = (i << 22) | (j << 12);
+      PTE_t* pte = get_task_pte(child, vaddr, 1);
+      if(pte == NULL){
+        free_task_page(child);
+        return -1;
+      }
+
+      if(!(table[j].avail & PTE_NOT_OWNED)){
+        // Both tasks now write-fault on the page until they get their own,
+        // except for shared memory which stays shared
+        if(table[j].rw && !(table[j].avail & PTE_SHARED)){
+          table[j].rw = 0;
+          table[j].avail |= PTE_COW;
+        }
+        get_frame(table[j].base << 12);
+      }
+      *pte = table[j];
+    }
+  }
+
+  // The parent's writable translations are now stale
+  if(get_cr3() == parent->page_dir) flush_tlb();
+  return 0;
+}
+
+/* cow_page
+ * DESCRIPTION:     Resolves a write fault on a copy-on-write page, giving
+ *                  the task its own copy unless it is the last user
+ * INPUTS:          pcb -- the PCB of the faulting task
+ *                  addr -- the faulting address
+ * RETURNS:         FAULT_MINOR if the page was made writable, FAULT_FAIL if
+ *                  it isn't a copy-on-write page
+ */
+int cow_page(pcb_t* pcb, uint32_t addr){
+  PTE_t* pte = get_task_pte(pcb, addr, 0);
+  if(pte == NULL || !pte->p || !(pte->avail & PTE_COW)) return FAULT_FAIL;
+
+  uint32_t frame = pte->base << 12;
+  if(frame_refcount(frame) > 1){
+    uint32_t copy = alloc_frame();
+    if(copy == 0) return FAULT_FAIL;
+
+    memcpy((void*)copy, (void*)frame, FRAME_SIZE);
+    pte->base = copy >> 12;
+    free_frame(frame); // Drops this task's reference
+  }
+
+  pte->avail &= ~PTE_COW;
+  pte->rw = 1;
+  if(get_cr3() == pcb->page_dir) tlb_flush_page(addr);
+  return FAULT_MINOR;
+}
+
+/* set_task_brk
+ * DESCRIPTION:     Moves the end of a task's heap. Growing only moves the
+ *                  break (pages are zero-filled on first touch), shrinking
+ *                  unmaps the pages which are no longer part of the heap
+ * INPUTS:          pcb -- the PCB of the task
+ *                  brk -- the new end of the heap
+ * RETURNS:         0 on success, -1 if the heap would leave its region
+ */
+int set_task_brk(pcb_t* pcb, uint32_t brk){
+  if(brk < pcb->heap_start || brk > USER_STACK - USER_STACK_SIZE) return -1;
+
+  uint32_t page;
+  for(page = PAGE_ALIGN_UP(brk); page < PAGE_ALIGN_UP(pcb->brk); page += FRAME_SIZE){
+    unmap_task_page(pcb, page);
+  }
+
+  pcb->brk = brk;
+  return 0;
+}
+
+/* find_window_space
+ * DESCRIPTION:     Finds the first run of unmapped pages in a 4MB window of a
+ *                  task's address space which is long enough
+ * INPUTS:          pcb -- the PCB of the task
+ *                  window -- 4MB aligned start of the window
+ *                  pages -- number of pages needed
+ * RETURNS:         user address of the run, 0 if there is none
+ */
+uint32_t find_window_space(pcb_t* pcb, uint32_t window, uint32_t pages){
+  PTE_t* table = get_task_pte(pcb, window, 1);
+  if(table == NULL) return 0;
+
+  uint32_t i, first = 0, run = 0;
+  for(i = 0; i < PT_LENGTH && run < pages; i++){
+    if(table[i].p){
+      run = 0;
+      first = i + 1;
+    }
+    else{
+      run++;
+    }
+  }
+  if(run < pages) return 0;
+
+  return window + (first << 12);
+}
+
+/* map_file
+ * DESCRIPTION:     Maps every data block of a file read-only into the mmap
+ *                  window of a task, in file order. Nothing is copied, the
+ *                  pages point straight into the filesystem image
+ * INPUTS:          pcb -- the PCB of the task
+ *                  inode -- inode of the file
+ * RETURNS:         user address of the mapping, 0 on failure
+ * NOTES:           the tail of the last page past the end of the file is
+ *                  whatever follows in that data block
+ */
+uint32_t map_file(pcb_t* pcb, uint32_t inode){
+  inode_t* node = inode_at(inode);
+  uint32_t pages = PAGE_ALIGN_UP(node->size) >> 12;
+  if(pages == 0 || pages > PT_LENGTH) return 0;
+
+  // Find a free slot to remember the mapping by
+  int slot;
+  for(slot = 0; slot < MAX_MMAPS && pcb->mmaps[slot].len != 0; slot++);
+  if(slot >= MAX_MMAPS) return 0;
+
+  uint32_t i, start = find_window_space(pcb, USER_MMAP_ADDR, pages);
+  if(start == 0) return 0;
+  for(i = 0; i < pages; i++){
+    // Blocks needn't be contiguous, each page is mapped on its own
+    map_foreign_page(pcb, start + (i << 12), (uint32_t)data_at(node->block_nums[i]));
+  }
+
+  pcb->mmaps[slot].start = start;
+  pcb->mmaps[slot].len = pages << 12;
+  return start;
+}
+
+/* unmap_file
+ * DESCRIPTION:     Removes a mapping made by map_file
+ * INPUTS:          pcb -- the PCB of the task
+ *                  start -- address returned by map_file
+ * RETURNS:         0 on success, -1 if there is no such mapping
+ */
+int unmap_file(pcb_t* pcb, uint32_t start){
+  int slot;
+  for(slot = 0; slot < MAX_MMAPS; slot++){
+    if(pcb->mmaps[slot].len != 0 && pcb->mmaps[slot].start == start) break;
+  }
+  if(slot >= MAX_MMAPS) return -1;
+
+  uint32_t addr;
+  for(addr = start; addr < start + pcb->mmaps[slot].len; addr += FRAME_SIZE){
+    unmap_task_page(pcb, addr);
+  }
+  pcb->mmaps[slot].len = 0;
+  return 0;
+}
+
+/* free_task_page
+ * DESCRIPTION:     Releases every frame mapped by a task, its page tables
+ *                  and its page directory
+ * INPUTS:          pcb -- the PCB of the task
+ * NOTES:           the directory must not be loaded (see delete_task_page)
+ */
+void free_task_page(pcb_t* pcb){
+  if(pcb->page_dir == 0) return;
+
+  int i, j;
+  PDE_t* dir = (PDE_t*)pcb->page_dir;
+  for(i = USER_PDE; i < PD_LENGTH; i++){
+    // The vidmap tables are shared and static
+    if(!dir[i].p || i == USER_VIDEO_PDE) continue;
+
+    PTE_t* table = (PTE_t*)(dir[i].base << 12);
+    for(j = 0; j < PT_LENGTH; j++){
+      if(table[j].p && !(table[j].avail & PTE_NOT_OWNED)){
+        free_frame(table[j].base << 12);
+      }
+    }
+    free_frame((uint32_t)table);
+  }
+
+  free_frame(pcb->page_dir);
+  pcb->page_dir = 0;
+}
+
 /* setup_task_page
- * DESCRIPTION:     Initializes a page in the directory for a user task
- *                  Maps virtual address 128MB to appropriate physical address
+ * DESCRIPTION:     Switches to the page directory of a user task
  * INPUTS:          pid -- the process id of the task
- * SIDE EFFECTS:    Sets bits in page_directory accordingly to a user task
+ * SIDE EFFECTS:    Loads CR3, flushing all non-global TLB entries
  */
 void setup_task_page(int pid){
-  page_dir[USER_PDE].p = 1;
-  page_dir[USER_PDE].rw = 1;
-  page_dir[USER_PDE].us = 1;
-  page_dir[USER_PDE].pwt = 0;
-  page_dir[USER_PDE].pcd = 1;
-  page_dir[USER_PDE].dirty = 0;
-  page_dir[USER_PDE].ps = 1;
-  page_dir[USER_PDE].g = 0;
-  page_dir[USER_PDE].base = (USER_BASE_ADDR + pid*USER_BASE_OFFSET) >> 12;
+  pcb_t* pcb = get_pcb(pid);
+  if(pcb == NULL || pcb->page_dir == 0) return;
 
-  // Reset TLB
-  flush_tlb();
+  // Reloading the same directory would only throw the TLB away
+  if(get_cr3() != pcb->page_dir) load_cr3(pcb->page_dir);
 }
 
 /* setup_user_video_mem
- * DESCRIPTION:     Initializes user page to point to video memory
+ * DESCRIPTION:     Maps the video memory page of a task's terminal into
+ *                  the task's address space
  * INPUTS:          pcb -- the pointer to the PCB of the process that will
  *                      be using this video memory pointer
- * SIDE EFFECTS:    Changes page directory
+ * SIDE EFFECTS:    Changes the task's page directory
  */
 void setup_user_video_mem(pcb_t* pcb){
-  if(pcb == NULL) return;
+  if(pcb == NULL || pcb->page_dir == 0) return;
   if(!(pcb->flags & TASK_VID_IN_USE)) return;
 
-  uint32_t video_base;
+  PDE_t* pde = (PDE_t*)pcb->page_dir + USER_VIDEO_PDE;
 
-  if(pcb->terminal == get_active_terminal()){
-      video_base = VIDEO_BASE_ADDR;
-  }
-  else{
-      video_base = (uint32_t)VIDEO_PTR(pcb->terminal);
+  /* Map virtual memory to 4kB page table entries */
+  pde->base = (int) page_table_vidmap[pcb->terminal] >> 12;
+  pde->ps = 0;
+  pde->dirty = 0;
+  pde->pcd = 0;
+  pde->pwt = 0;
+  pde->g = 0;
+  pde->us = 1;
+  pde->rw = 1;
+  pde->p = 1;
+
+  // Only this task's view of the vidmap page changed
+  if(get_cr3() == pcb->page_dir) tlb_flush_page(USER_VIDEO_ADDR);
+}
+
+/* sync_user_video_mem
+ * DESCRIPTION:     Points the vidmap page of the active terminal at video
+ *                  memory, and those of the other terminals at their buffers
+ * SIDE EFFECTS:    Changes the shared vidmap page tables
+ */
+void sync_user_video_mem(){
+  uint32_t t;
+  for(t = 0; t < NUM_TERMINALS; t++){
+    if(t == get_active_terminal()){
+      page_table_vidmap[t][0].base = VIDEO_BASE_ADDR >> 12;
+    }
+    else{
+      page_table_vidmap[t][0].base = (uint32_t)VIDEO_PTR(t) >> 12;
+    }
   }
 
-  /* Map video memory directly to physical memory */
-  page_table_vidmap[0].base = video_base >> 12;
-  page_table_vidmap[0].pat = 0;
-  page_table_vidmap[0].dirty = 0;
-  page_table_vidmap[0].pcd = 0;
-  page_table_vidmap[0].pwt = 0;
-  page_table_vidmap[0].us = 1;
-  page_table_vidmap[0].rw = 1;
-  page_table_vidmap[0].p = 1;
+  // Other directories pick the change up on their next CR3 load, other
+  // CPUs may have the page cached under their loaded one
+  tlb_flush_page(USER_VIDEO_ADDR);
+  smp_flush_tlb_others();
+}
 
-  /* Map virtual memory to 4kB page table entries */
-  page_dir[USER_VIDEO_PDE].base = (int) page_table_vidmap >> 12;
-  page_dir[USER_VIDEO_PDE].ps = 0;
-  page_dir[USER_VIDEO_PDE].dirty = 0;
-  page_dir[USER_VIDEO_PDE].pcd = 1;
-  page_dir[USER_VIDEO_PDE].pwt = 0;
-  page_dir[USER_VIDEO_PDE].us = 1;
-  page_dir[USER_VIDEO_PDE].rw = 1;
-  page_dir[USER_VIDEO_PDE].p = 1;
+/* get_kernel_pde
+ * DESCRIPTION:     Finds the kernel's directory entry for an address
+ * INPUTS:          vaddr -- kernel virtual address
+ * RETURNS:         pointer into the kernel page directory
+ */
+PDE_t* get_kernel_pde(uint32_t vaddr){
+  return &page_dir[PD_INDEX(vaddr)];
+}
 
-  flush_tlb();
+/* get_kernel_pte
+ * DESCRIPTION:     Finds the kernel's page table entry for an address in
+ *                  the low 4MB (the only kernel memory mapped with 4KB pages)
+ * INPUTS:          vaddr -- kernel virtual address
+ * RETURNS:         pointer into the low page table, NULL for other addresses
+ */
+PTE_t* get_kernel_pte(uint32_t vaddr){
+  if(PD_INDEX(vaddr) != 0) return NULL;
+  return &page_table[PT_INDEX(vaddr)];
 }
 
-/* disable_user_video_mem
- * DESCRIPTION:     Deletes user page to point to video memory
- * SIDE EFFECTS:    Changes page directory
+/* map_kernel_mmio
+ * DESCRIPTION:     Maps a page of device registers, uncached, into the low
+ *                  page table (so every page directory shares it)
+ * INPUTS:          vaddr -- kernel virtual address in the low 4MB
+ *                  phys -- physical address of the registers
+ * RETURNS:         0 on success, -1 if vaddr isn't in the low 4MB
  */
-void disable_user_video_mem(){
-    page_dir[USER_VIDEO_PDE].p = 0;
-    page_table_vidmap[0].p = 0;
+int map_kernel_mmio(uint32_t vaddr, uint32_t phys){
+  PTE_t* pte = get_kernel_pte(vaddr);
+  if(pte == NULL) return -1;
 
-    flush_tlb();
+  *(uint32_t*)pte = 0;
+  pte->base = phys >> 12;
+  pte_set_memtype(pte, MEM_UC);
+  pte->g = 1;
+  pte->rw = 1;
+  pte->p = 1;
+  tlb_flush_page(vaddr);
+  return 0;
+}
+
+/* get_kernel_page_dir
+ * RETURNS:         physical address of the kernel's own page directory, for
+ *                  contexts that must not keep a task's directory loaded
+ */
+uint32_t get_kernel_page_dir(){
+  return (uint32_t)page_dir;
 }
 
 /* delete_task_page
- * DESCRIPTION:     Set's user page to not present
- * SIDE EFFECTS:    Sets bits in page_directory accordingly to a user task
+ * DESCRIPTION:     Switches back to the kernel's own page directory so that
+ *                  the current task's directory can be freed
+ * SIDE EFFECTS:    Loads CR3
  */
 void delete_task_page(){
-  page_dir[USER_PDE].p = 0;
-
-  // Reset TLB
-  flush_tlb();
+  if(get_cr3() != (uint32_t)page_dir) load_cr3((uint32_t)page_dir);
 }
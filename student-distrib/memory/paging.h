@@ -18,19 +18,58 @@
 
 /* Constants defined in terms of physical address space */
 #define USER_PDE            32
-#define USER_BASE_ADDR      0x00800000
 #define USER_BASE_OFFSET    0x00400000
 
+/* Page directory entries covering the direct map of frame memory */
+#define DIRECT_MAP_PDE      2
+#define DIRECT_MAP_END_PDE  USER_PDE
+
 /* Constants defined in terms of virtual addresses space */
 #define USER_PAGE_START     0x08000000
 #define USER_LOAD_ADDR      0x08048000
 #define USER_STACK          0x08400000
+#define USER_STACK_SIZE     0x00100000
 #define USER_KTASK_BASE     0x00800000
 #define USER_KTASK_OFFSET   0x00002000
 
 #define USER_VIDEO_PDE      33
 #define USER_VIDEO_ADDR     (USER_VIDEO_PDE * 0x00400000)
 
+/* Window that shared memory segments are attached in */
+#define USER_SHM_PDE        34
+#define USER_SHM_ADDR       (USER_SHM_PDE * 0x00400000)
+
+/* Window that mmap places files in */
+#define USER_MMAP_PDE       35
+#define USER_MMAP_ADDR      (USER_MMAP_PDE * 0x00400000)
+
+/* Loader mode: when 1, read-only program text is mapped straight onto the
+ * filesystem image's data blocks instead of being copied into the task */
+#define LOADER_XIP          1
+
+/* Software bits kept in the avail field of a PTE */
+#define PTE_NOT_OWNED       0x1     // Frame isn't ours to free (e.g. the fs image)
+#define PTE_COW             0x2     // Shared read-only until the next write
+#define PTE_SHARED          0x4     // Shared memory segment, never copied
+
+/* Rounding to page boundaries */
+#define PAGE_ALIGN_DOWN(addr)   ((uint32_t)(addr) & ~0xFFF)
+#define PAGE_ALIGN_UP(addr)     (((uint32_t)(addr) + 0xFFF) & ~0xFFF)
+
+/* Outcomes of demand_page */
+#define FAULT_FAIL          -1
+#define FAULT_MINOR         0
+#define FAULT_MAJOR         1
+
+/* Page fault error code bits */
+#define PF_PRESENT          0x1
+#define PF_WRITE            0x2
+#define PF_USER             0x4
+
+/* Index of an address within the page directory / a page table */
+#define PD_INDEX(addr)      ((uint32_t)(addr) >> 22)
+#define PT_INDEX(addr)      (((uint32_t)(addr) >> 12) & 0x3FF)
+
 /* Page directory entry struct */
 typedef struct {
     unsigned int p :        1;
@@ -70,16 +109,44 @@ void init_paging(void);
 
 /* load page directory and set cr0-3-4 registers defined in pagingassembly.c */
 extern void load_pd(PDE_t* ptr);
+extern void load_cr3(uint32_t dir);
+extern uint32_t get_cr3(void);
+extern uint32_t get_cr2(void);
 extern void flush_tlb(void);
-
-/* create a page for the task */
+extern void flush_tlb_global(void);
+
+/* per-process address space management */
+int create_task_page(pcb_t* pcb);
+PTE_t* get_task_pte(pcb_t* pcb, uint32_t vaddr, int create);
+int map_task_page(pcb_t* pcb, uint32_t vaddr);
+int map_foreign_page(pcb_t* pcb, uint32_t vaddr, uint32_t phys);
+int map_shared_page(pcb_t* pcb, uint32_t vaddr, uint32_t frame);
+void unmap_task_page(pcb_t* pcb, uint32_t vaddr);
+uint32_t find_window_space(pcb_t* pcb, uint32_t window, uint32_t pages);
+void free_task_page(pcb_t* pcb);
+int demand_page(pcb_t* pcb, uint32_t addr);
+int copy_task_page(pcb_t* parent, pcb_t* child);
+int cow_page(pcb_t* pcb, uint32_t addr);
+int set_task_brk(pcb_t* pcb, uint32_t brk);
+
+/* read-only mappings of files in the filesystem image */
+uint32_t map_file(pcb_t* pcb, uint32_t inode);
+int unmap_file(pcb_t* pcb, uint32_t start);
+
+/* kernel mappings shared by every page directory */
+PDE_t* get_kernel_pde(uint32_t vaddr);
+PTE_t* get_kernel_pte(uint32_t vaddr);
+int map_kernel_mmio(uint32_t vaddr, uint32_t phys);
+uint32_t get_kernel_page_dir(void);
+
+/* switch to the page directory of a task */
 void setup_task_page(int pid);
 
 /* Create vid page for user tasks */
 void setup_user_video_mem(pcb_t* pcb);
-void disable_user_video_mem();
+void sync_user_video_mem();
 
-/* delete last task page */
+/* switch back to the kernel page directory */
 void delete_task_page();
 
 #endif
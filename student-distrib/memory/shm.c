@@ -0,0 +1,252 @@
+#include "shm.h"
+#include "paging.h"
+#include "frame.h"
+#include "slab.h"
+
+#include "../lib/lib.h"
+#include "../lib/spinlock.h"
+
+/* A shared memory segment. The segment holds one reference to each of
+ * its frames and every attached task holds another, so a frame is only
+ * freed once nobody can reach it */
+typedef struct {
+    int32_t key;
+    uint32_t pages;
+    uint32_t* frames;
+    uint32_t attached;  // Number of attachments over all tasks
+    pid_t creator;      // Task that made it, -1 once that task halts
+    uint8_t in_use;
+} shm_segment_t;
+
+static shm_segment_t segs[MAX_SHM_SEGS];
+static spinlock_t shm_lock;
+
+/* init_shm
+ * DESCRIPTION:         empties the segment table
+ */
+void init_shm(void){
+    spin_lock_init(&shm_lock, "shm");
+    memset(segs, 0, sizeof(segs));
+}
+
+/* free_segment_frames
+ * DESCRIPTION:         drops the references to a segment's frames and frees
+ *                      the frame list
+ * INPUTS:              frames -- the frame list
+ *                      pages -- number of frames in it
+ */
+static void free_segment_frames(uint32_t* frames, uint32_t pages){
+    uint32_t i;
+    for(i = 0; i < pages; i++){
+        free_frame(frames[i]);
+    }
+    kfree(frames);
+}
+
+/* destroy_segment
+ * DESCRIPTION:         drops the segment's references to its frames
+ * NOTES:               caller must hold shm_lock
+ */
+static void destroy_segment(shm_segment_t* seg){
+    free_segment_frames(seg->frames, seg->pages);
+    seg->in_use = 0;
+}
+
+/* find_segment
+ * RETURNS:             id of the segment with a key, -1 if there is none
+ * NOTES:               caller must hold shm_lock
+ */
+static int32_t find_segment(int32_t key){
+    int32_t id;
+    if(key == SHM_PRIVATE) return -1;
+    for(id = 0; id < MAX_SHM_SEGS; id++){
+        if(segs[id].in_use && segs[id].key == key) return id;
+    }
+    return -1;
+}
+
+/* shm_get
+ * DESCRIPTION:         finds the segment with a key, creating it if needed
+ * INPUTS:              key -- key shared by cooperating programs, or
+ *                             SHM_PRIVATE for a new segment
+ *                      size -- size of the segment in bytes
+ * RETURNS:             id of the segment, -1 on failure
+ * NOTES:               the frames of a new segment are allocated and zeroed
+ *                      without shm_lock held, the segment is only published
+ *                      under it
+ */
+int32_t shm_get(int32_t key, uint32_t size){
+    if(size == 0 || size > SHM_MAX_SIZE) return -1;
+    uint32_t pages = PAGE_ALIGN_UP(size) >> 12;
+
+    unsigned long flags = spin_lock_irqsave(&shm_lock);
+    int32_t id = find_segment(key);
+    uint32_t found_pages = id >= 0 ? segs[id].pages : 0;
+    spin_unlock_irqrestore(&shm_lock, flags);
+    if(id >= 0) return pages <= found_pages ? id : -1;
+
+    uint32_t* frames = kmalloc(pages * sizeof(uint32_t));
+    if(frames == NULL) return -1;
+
+    uint32_t i;
+    for(i = 0; i < pages; i++){
+        frames[i] = alloc_zeroed_frame();
+        if(frames[i] == 0){
+            free_segment_frames(frames, i);
+            return -1;
+        }
+    }
+
+    flags = spin_lock_irqsave(&shm_lock);
+
+    // Someone may have made the key's segment meanwhile
+    if((id = find_segment(key)) < 0){
+        for(id = 0; id < MAX_SHM_SEGS && segs[id].in_use; id++);
+        if(id < MAX_SHM_SEGS){
+            shm_segment_t* seg = &segs[id];
+            seg->key = key;
+            seg->pages = pages;
+            seg->frames = frames;
+            seg->attached = 0;
+            seg->creator = active_pid;
+            seg->in_use = 1;
+
+            spin_unlock_irqrestore(&shm_lock, flags);
+            return id;
+        }
+        id = -1;
+    }
+    else if(pages > segs[id].pages){
+        id = -1;
+    }
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+    free_segment_frames(frames, pages);
+    return id;
+}
+
+/* shm_size
+ * RETURNS:             size of a segment in bytes, 0 if there is none
+ */
+uint32_t shm_size(int32_t id){
+    if(id < 0 || id >= MAX_SHM_SEGS || !segs[id].in_use) return 0;
+    return segs[id].pages << 12;
+}
+
+/* shm_attach
+ * DESCRIPTION:         maps a segment into the shared memory window of a task
+ * INPUTS:              pcb -- the PCB of the task
+ *                      id -- id from shm_get
+ * RETURNS:             user address of the segment, 0 on failure
+ */
+uint32_t shm_attach(pcb_t* pcb, int32_t id){
+    if(id < 0 || id >= MAX_SHM_SEGS) return 0;
+
+    unsigned long flags = spin_lock_irqsave(&shm_lock);
+
+    shm_segment_t* seg = &segs[id];
+    int slot;
+    for(slot = 0; slot < MAX_SHM_ATTACH && pcb->shms[slot].start != 0; slot++);
+    if(!seg->in_use || slot >= MAX_SHM_ATTACH){
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return 0;
+    }
+
+    uint32_t i, start = find_window_space(pcb, USER_SHM_ADDR, seg->pages);
+    if(start == 0){
+        spin_unlock_irqrestore(&shm_lock, flags);
+        return 0;
+    }
+    for(i = 0; i < seg->pages; i++){
+        if(map_shared_page(pcb, start + (i << 12), seg->frames[i]) != 0){
+            while(i-- > 0) unmap_task_page(pcb, start + (i << 12));
+            spin_unlock_irqrestore(&shm_lock, flags);
+            return 0;
+        }
+    }
+
+    seg->attached++;
+    pcb->shms[slot].start = start;
+    pcb->shms[slot].id = id;
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+    return start;
+}
+
+/* shm_detach
+ * DESCRIPTION:         unmaps a segment from a task, destroying the segment
+ *                      once its last attachment is gone
+ * INPUTS:              pcb -- the PCB of the task
+ *                      start -- address returned by shm_attach
+ * RETURNS:             0 on success, -1 if nothing is attached there
+ */
+int shm_detach(pcb_t* pcb, uint32_t start){
+    int slot;
+    for(slot = 0; slot < MAX_SHM_ATTACH; slot++){
+        if(start != 0 && pcb->shms[slot].start == start) break;
+    }
+    if(slot >= MAX_SHM_ATTACH) return -1;
+
+    unsigned long flags = spin_lock_irqsave(&shm_lock);
+
+    shm_segment_t* seg = &segs[pcb->shms[slot].id];
+    uint32_t i;
+    for(i = 0; i < seg->pages; i++){
+        unmap_task_page(pcb, start + (i << 12));
+    }
+    pcb->shms[slot].start = 0;
+
+    if(--seg->attached == 0) destroy_segment(seg);
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+    return 0;
+}
+
+/* shm_detach_all
+ * DESCRIPTION:         detaches every segment of a task (used by halt)
+ * INPUTS:              pcb -- the PCB of the task
+ */
+void shm_detach_all(pcb_t* pcb){
+    int slot;
+    for(slot = 0; slot < MAX_SHM_ATTACH; slot++){
+        shm_detach(pcb, pcb->shms[slot].start);
+    }
+}
+
+/* shm_exit
+ * DESCRIPTION:         destroys the segments a halting task created that
+ *                      nobody is attached to, nothing could reach them again
+ *                      but their key. Attached ones live on until their last
+ *                      detach
+ * INPUTS:              pid -- the halting task, after its shm_detach_all
+ */
+void shm_exit(pid_t pid){
+    unsigned long flags = spin_lock_irqsave(&shm_lock);
+
+    int32_t id;
+    for(id = 0; id < MAX_SHM_SEGS; id++){
+        shm_segment_t* seg = &segs[id];
+        if(!seg->in_use || seg->creator != pid) continue;
+
+        if(seg->attached == 0) destroy_segment(seg);
+        else seg->creator = -1;
+    }
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+}
+
+/* shm_fork
+ * DESCRIPTION:         accounts for the attachments a forked child inherited
+ *                      along with its parent's page tables
+ * INPUTS:              child -- the PCB of the new task
+ */
+void shm_fork(pcb_t* child){
+    unsigned long flags = spin_lock_irqsave(&shm_lock);
+
+    int slot;
+    for(slot = 0; slot < MAX_SHM_ATTACH; slot++){
+        if(child->shms[slot].start != 0) segs[child->shms[slot].id].attached++;
+    }
+
+    spin_unlock_irqrestore(&shm_lock, flags);
+}
@@ -0,0 +1,25 @@
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "../lib/types.h"
+#include "../tasks/process.h"
+
+#define MAX_SHM_SEGS        16
+#define SHM_MAX_SIZE        0x00100000  // 1MB per segment
+
+/* shm_get key which always creates a new segment */
+#define SHM_PRIVATE         0
+
+/* Segment management */
+void init_shm(void);
+int32_t shm_get(int32_t key, uint32_t size);
+uint32_t shm_size(int32_t id);
+
+/* Attaching segments to tasks */
+uint32_t shm_attach(pcb_t* pcb, int32_t id);
+int shm_detach(pcb_t* pcb, uint32_t start);
+void shm_detach_all(pcb_t* pcb);
+void shm_exit(pid_t pid);
+void shm_fork(pcb_t* child);
+
+#endif /* _SHM_H */
@@ -0,0 +1,236 @@
+#include "slab.h"
+#include "frame.h"
+
+#include "../lib/lib.h"
+
+/* Every slab is a single frame with this header at its start, so the slab
+ * (and cache) owning an object is found by masking its address */
+typedef struct slab {
+    struct slab* next;
+    struct slab* prev;
+    kmem_cache_t* cache;
+    void* free;         // Free objects, linked through their first word
+    uint32_t inuse;
+} slab_t;
+
+#define SLAB_HEADER_SIZE    ((sizeof(slab_t) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+#define SLAB_OF(obj)        ((slab_t*)((uint32_t)(obj) & ~(FRAME_SIZE - 1)))
+
+static kmem_cache_t caches[MAX_CACHES];
+static int num_caches = 0;
+static spinlock_t caches_lock;
+
+static kmem_cache_t* kmalloc_caches[KMALLOC_MAX_SHIFT + 1];
+
+/* slab_push
+ * DESCRIPTION:         adds a slab to the front of a list
+ */
+static void slab_push(slab_t** list, slab_t* slab){
+    slab->prev = NULL;
+    slab->next = *list;
+    if(slab->next != NULL) slab->next->prev = slab;
+    *list = slab;
+}
+
+/* slab_remove
+ * DESCRIPTION:         unlinks a slab from a list
+ */
+static void slab_remove(slab_t** list, slab_t* slab){
+    if(slab->prev != NULL) slab->prev->next = slab->next;
+    else *list = slab->next;
+    if(slab->next != NULL) slab->next->prev = slab->prev;
+}
+
+/* slab_grow
+ * DESCRIPTION:         carves a new frame into objects for a cache
+ * RETURNS:             the new (empty) slab, NULL if out of memory
+ * NOTES:               caller must hold the cache lock
+ */
+static slab_t* slab_grow(kmem_cache_t* cache){
+    uint32_t frame = alloc_frame();
+    if(frame == 0) return NULL;
+
+    slab_t* slab = (slab_t*)frame;
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+
+    // Thread the free list through the objects, lowest address first
+    int i;
+    for(i = cache->objs_per_slab - 1; i >= 0; i--){
+        void** obj = (void**)(frame + SLAB_HEADER_SIZE + i*cache->obj_size);
+        *obj = slab->free;
+        slab->free = obj;
+    }
+
+    cache->num_slabs++;
+    return slab;
+}
+
+/* init_slab
+ * DESCRIPTION:         creates the power-of-two caches used by kmalloc
+ */
+void init_slab(void){
+    spin_lock_init(&caches_lock, "slab caches");
+
+    int shift;
+    char name[CACHE_NAME_LEN];
+    for(shift = KMALLOC_MIN_SHIFT; shift <= KMALLOC_MAX_SHIFT; shift++){
+        strcpy(name, "kmalloc-");
+        itoa(1 << shift, name + strlen(name), 10);
+        kmalloc_caches[shift] = kmem_cache_create(name, 1 << shift);
+    }
+}
+
+/* kmem_cache_create
+ * DESCRIPTION:         creates a cache of objects of one size
+ * INPUTS:              name -- name shown in the statistics
+ *                      size -- size of each object in bytes
+ * RETURNS:             the new cache, NULL if it can't be created
+ */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size){
+    // Objects must fit in a slab and hold the free list link
+    size = max(size, sizeof(void*));
+    size = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+    if(size > FRAME_SIZE - SLAB_HEADER_SIZE) return NULL;
+
+    unsigned long flags = spin_lock_irqsave(&caches_lock);
+    if(num_caches >= MAX_CACHES){
+        spin_unlock_irqrestore(&caches_lock, flags);
+        return NULL;
+    }
+    kmem_cache_t* cache = &caches[num_caches++];
+    spin_unlock_irqrestore(&caches_lock, flags);
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, CACHE_NAME_LEN - 1);
+    cache->obj_size = size;
+    cache->objs_per_slab = (FRAME_SIZE - SLAB_HEADER_SIZE) / size;
+    spin_lock_init(&cache->lock, cache->name);
+    return cache;
+}
+
+/* kmem_cache_alloc
+ * DESCRIPTION:         allocates one object from a cache
+ * INPUTS:              cache -- the cache
+ * RETURNS:             pointer to the (uninitialized) object, NULL on failure
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache){
+    if(cache == NULL) return NULL;
+
+    unsigned long flags = spin_lock_irqsave(&cache->lock);
+
+    // Fill up partial slabs before touching empty ones
+    slab_t* slab = cache->partial;
+    if(slab != NULL){
+        slab_remove(&cache->partial, slab);
+    }
+    else if(cache->empty != NULL){
+        slab = cache->empty;
+        slab_remove(&cache->empty, slab);
+    }
+    else if((slab = slab_grow(cache)) == NULL){
+        spin_unlock_irqrestore(&cache->lock, flags);
+        return NULL;
+    }
+
+    void** obj = slab->free;
+    slab->free = *obj;
+    slab->inuse++;
+    slab_push(slab->inuse == cache->objs_per_slab ? &cache->full : &cache->partial, slab);
+
+    cache->active_objs++;
+    cache->allocs++;
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+/* kmem_cache_free
+ * DESCRIPTION:         returns an object to its cache
+ * INPUTS:              cache -- the cache it was allocated from
+ *                      obj -- the object
+ * SIDE EFFECTS:        frees the slab's frame if another empty slab is
+ *                      already cached
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj){
+    if(cache == NULL || obj == NULL) return;
+
+    slab_t* slab = SLAB_OF(obj);
+    if(slab->cache != cache) return;
+
+    unsigned long flags = spin_lock_irqsave(&cache->lock);
+
+    slab_remove(slab->inuse == cache->objs_per_slab ? &cache->full : &cache->partial, slab);
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    slab->inuse--;
+
+    cache->active_objs--;
+    cache->frees++;
+
+    if(slab->inuse > 0){
+        slab_push(&cache->partial, slab);
+    }
+    else if(cache->empty == NULL){
+        // Keep one empty slab around so alloc/free pairs don't thrash
+        slab_push(&cache->empty, slab);
+    }
+    else{
+        cache->num_slabs--;
+        free_frame((uint32_t)slab);
+    }
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/* kmalloc
+ * DESCRIPTION:         allocates kernel memory
+ * INPUTS:              size -- number of bytes
+ * RETURNS:             pointer to the memory, NULL on failure
+ * NOTES:               allocations over KMALLOC_MAX_SIZE are whole, page
+ *                      aligned blocks from the frame allocator
+ */
+void* kmalloc(uint32_t size){
+    if(size == 0) return NULL;
+
+    if(size > KMALLOC_MAX_SIZE){
+        uint32_t order = 0;
+        while((FRAME_SIZE << order) < size) order++;
+        return (void*)alloc_frames(order);
+    }
+
+    uint32_t shift = KMALLOC_MIN_SHIFT;
+    while((1U << shift) < size) shift++;
+    return kmem_cache_alloc(kmalloc_caches[shift]);
+}
+
+/* kfree
+ * DESCRIPTION:         frees memory from kmalloc
+ * INPUTS:              ptr -- pointer returned by kmalloc
+ */
+void kfree(void* ptr){
+    if(ptr == NULL) return;
+
+    // Slab objects are never page aligned, they come after the slab header
+    if(((uint32_t)ptr & (FRAME_SIZE - 1)) == 0){
+        free_frames((uint32_t)ptr, frame_order((uint32_t)ptr));
+        return;
+    }
+
+    kmem_cache_t* cache = SLAB_OF(ptr)->cache;
+    kmem_cache_free(cache, ptr);
+}
+
+/* kmem_print_stats
+ * DESCRIPTION:         prints the usage statistics of every cache
+ */
+void kmem_print_stats(void){
+    int i;
+    for(i = 0; i < num_caches; i++){
+        kmem_cache_t* cache = &caches[i];
+        printf("%s: %u bytes, %u per slab, %u slabs, %u active, %u allocs, %u frees\n",
+            cache->name, cache->obj_size, cache->objs_per_slab, cache->num_slabs,
+            cache->active_objs, cache->allocs, cache->frees);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "../lib/types.h"
+#include "../lib/spinlock.h"
+
+#define MAX_CACHES          16
+#define CACHE_NAME_LEN      16
+
+/* Objects are handed out with at least this alignment */
+#define SLAB_ALIGN          8
+
+/* General purpose caches cover 2^KMALLOC_MIN_SHIFT to 2^KMALLOC_MAX_SHIFT
+ * bytes, anything larger comes straight from the frame allocator */
+#define KMALLOC_MIN_SHIFT   3
+#define KMALLOC_MAX_SHIFT   10
+#define KMALLOC_MAX_SIZE    (1 << KMALLOC_MAX_SHIFT)
+
+struct slab;
+
+/* A cache of equally sized objects, carved out of one-frame slabs */
+typedef struct kmem_cache {
+    char name[CACHE_NAME_LEN];
+    uint32_t obj_size;
+    uint32_t objs_per_slab;
+
+    // Slabs with some, none and all of their objects free
+    struct slab* partial;
+    struct slab* full;
+    struct slab* empty;
+
+    // Usage statistics
+    uint32_t num_slabs;
+    uint32_t active_objs;
+    uint32_t allocs;
+    uint32_t frees;
+
+    spinlock_t lock;
+} kmem_cache_t;
+
+/* Sets up the general purpose caches, the frame allocator must be ready */
+void init_slab(void);
+
+/* Object caches */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* General purpose allocation */
+void* kmalloc(uint32_t size);
+void kfree(void* ptr);
+
+/* Prints the usage statistics of every cache */
+void kmem_print_stats(void);
+
+#endif /* _SLAB_H */
@@ -0,0 +1,79 @@
+#include "tlb.h"
+
+#include "paging.h"
+#include "frame.h"
+
+/* tlb_flush_page
+ * DESCRIPTION:         drops the TLB entry of one page in the loaded directory
+ * INPUTS:              addr -- any virtual address inside the page
+ */
+void tlb_flush_page(uint32_t addr){
+    invlpg(addr);
+}
+
+/* tlb_flush_range
+ * DESCRIPTION:         drops the TLB entries covering [start, start + length),
+ *                      using a full flush when that is cheaper
+ * INPUTS:              start -- first virtual address
+ *                      length -- length of the range in bytes
+ */
+void tlb_flush_range(uint32_t start, uint32_t length){
+    if(length == 0) return;
+
+    uint32_t addr = start & ~(FRAME_SIZE - 1);
+    uint32_t end = start + length;
+    if(end < start || (end - addr) / FRAME_SIZE > TLB_RANGE_MAX_PAGES){
+        flush_tlb();
+        return;
+    }
+
+    for(; addr < end; addr += FRAME_SIZE){
+        invlpg(addr);
+    }
+}
+
+/* tlb_batch_init
+ * DESCRIPTION:         starts an empty batch of invalidations
+ * INPUTS:              batch -- the batch to initialize
+ */
+void tlb_batch_init(tlb_batch_t* batch){
+    batch->count = 0;
+    batch->flush_all = 0;
+}
+
+/* tlb_batch_add
+ * DESCRIPTION:         queues the invalidation of one page, to be done by
+ *                      tlb_batch_flush once every PTE edit is finished
+ * INPUTS:              batch -- the batch
+ *                      addr -- any virtual address inside the edited page
+ */
+void tlb_batch_add(tlb_batch_t* batch, uint32_t addr){
+    if(batch->flush_all) return;
+
+    if(batch->count >= TLB_BATCH_SIZE){
+        // Too many pages, a full flush will be cheaper anyway
+        batch->flush_all = 1;
+        return;
+    }
+    batch->addrs[batch->count++] = addr;
+}
+
+/* tlb_batch_flush
+ * DESCRIPTION:         performs every invalidation queued in the batch and
+ *                      empties it
+ * INPUTS:              batch -- the batch
+ */
+void tlb_batch_flush(tlb_batch_t* batch){
+    uint32_t i;
+
+    if(batch->flush_all){
+        flush_tlb();
+    }
+    else{
+        for(i = 0; i < batch->count; i++){
+            invlpg(batch->addrs[i]);
+        }
+    }
+
+    tlb_batch_init(batch);
+}
@@ -0,0 +1,29 @@
+#ifndef _TLB_H
+#define _TLB_H
+
+#include "../lib/types.h"
+
+/* Most invalidations a batch remembers before falling back to a full flush */
+#define TLB_BATCH_SIZE      16
+
+/* Ranges longer than this many pages are cheaper to flush outright */
+#define TLB_RANGE_MAX_PAGES 32
+
+/* Deferred invalidations, filled while editing page tables */
+typedef struct {
+    uint32_t addrs[TLB_BATCH_SIZE];
+    uint32_t count;
+    int flush_all;
+} tlb_batch_t;
+
+/* single-page invalidation defined in pagingassembly.S */
+extern void invlpg(uint32_t addr);
+
+void tlb_flush_page(uint32_t addr);
+void tlb_flush_range(uint32_t start, uint32_t length);
+
+void tlb_batch_init(tlb_batch_t* batch);
+void tlb_batch_add(tlb_batch_t* batch, uint32_t addr);
+void tlb_batch_flush(tlb_batch_t* batch);
+
+#endif /* _TLB_H */
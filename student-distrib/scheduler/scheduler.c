@@ -2,54 +2,635 @@
 #include "scheduler.h"
 
 #include "../arch/x86_desc.h"
+#include "../arch/cpu.h"
+#include "../arch/smp.h"
+#include "../interrupts/apic.h"
 #include "../tasks/process.h"
 #include "../devices/terminal.h"
 #include "../memory/paging.h"
 #include "../interrupts/i8259.h"
 #include "../interrupts/pit.h"
+#include "../interrupts/softirq.h"
+#include "../memory/frame.h"
+#include "tick.h"
+#include "timer.h"
+#include "switch.h"
+
+// Each CPU's run queue and idle context
+typedef struct {
+    // Bit n is set while task n is ready to run on this CPU
+    volatile uint32_t ready_map;
+
+    // The idle context's stack, saved by switch_to like a task's
+    uint32_t idle_esp;
+    pid_t idle_from;            // Round-robin position to resume from
+
+    // Task to switch to on the way out of the current interrupt, see
+    // sched_request (-1 for none)
+    pid_t resched_to;
+
+    // Idle time accounting, in ticks
+    uint32_t idle_start;
+    uint32_t idle_ticks;
+    uint32_t idle_entries;
+
+    // jiffies up to which the running task's time is charged, and the
+    // switches made on this CPU
+    uint32_t acct_stamp;
+    uint32_t nr_switches;
+} runqueue_t;
+
+static runqueue_t runqueues[MAX_CPUS];
+
+#define IDLE_STACK_SIZE 0x2000
+static uint8_t idle_stacks[MAX_CPUS][IDLE_STACK_SIZE] __attribute__((aligned(16)));
+
+#define this_rq()       (&runqueues[cpu_id()])
+
+// Where switch_to leaves the stack of a context that is never resumed
+// (a halted task, or the boot stack)
+static uint32_t dead_esp;
+
+static void switch_to_idle(pid_t from);
+static void count_switch(int voluntary);
+
+/* bsf
+ * RETURNS:             index of the lowest set bit (x must not be 0)
+ */
+static inline uint32_t bsf(uint32_t x) {
+    uint32_t index;
+    asm ("bsfl %1, %0" : "=r"(index) : "rm"(x) : "cc");
+    return index;
+}
+
+/* popcount
+ * RETURNS:             the number of set bits
+ */
+static inline uint32_t popcount(uint32_t map) {
+    uint32_t count = 0;
+    while (map != 0) {
+        map &= map - 1;
+        count++;
+    }
+    return count;
+}
+
+/* init_scheduler
+ * DESCRIPTION:         builds every CPU's idle context stack, so that the
+ *                      first switch to it starts idle_loop
+ * NOTES:               a secondary CPU instead starts out running its idle
+ *                      context, from the top of the same stack
+ */
+void init_scheduler(void) {
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint32_t* stack = (uint32_t*)sched_idle_stack(cpu);
+
+        *--stack = 0;                   // idle_loop never returns
+        runqueues[cpu].idle_esp = switch_frame(stack, idle_loop);
+        runqueues[cpu].resched_to = (unsigned)-1;
+    }
+}
+
+/* sched_idle_stack
+ * RETURNS:             the top of a CPU's idle context stack
+ * INPUTS:              cpu -- index of the CPU
+ */
+uint32_t sched_idle_stack(uint32_t cpu) {
+    return (uint32_t)(idle_stacks[cpu] + IDLE_STACK_SIZE);
+}
+
+/* update_quantum
+ * DESCRIPTION:         on CPUs other than TICK_CPU (whose quantum is part of
+ *                      the tick, see tick.c), keeps the local timer armed
+ *                      while another task waits for this CPU
+ */
+static void update_quantum(void) {
+    if (cpu_id() == TICK_CPU) return;
+    apic_timer_quantum(popcount(this_rq()->ready_map) > 1 ? SCHED_QUANTUM : 0);
+}
+
+/* least_loaded
+ * RETURNS:             the CPU in allowed with the fewest ready tasks,
+ *                      prefer if it is one of the least loaded
+ * INPUTS:              allowed -- mask of online CPUs, not 0
+ *                      prefer -- CPU to pick on a tie
+ */
+static uint32_t least_loaded(uint32_t allowed, uint32_t prefer) {
+    uint32_t best = (allowed & (1 << prefer)) ? prefer : bsf(allowed);
+    uint32_t best_ready = popcount(runqueues[best].ready_map);
+
+    while (allowed != 0) {
+        uint32_t cpu = bsf(allowed);
+        uint32_t ready = popcount(runqueues[cpu].ready_map);
+        if (ready < best_ready) {
+            best = cpu;
+            best_ready = ready;
+        }
+        allowed &= allowed - 1;
+    }
+    return best;
+}
+
+/* task_running
+ * DESCRIPTION:         checks whether a task is running on some CPU
+ * INPUTS:              pid -- the task
+ * RETURNS:             index of the CPU running it, -1 if none is
+ */
+static uint32_t task_running(pid_t pid) {
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (cpus[cpu].online && !cpus[cpu].idling && cpus[cpu].current_pid == pid) return cpu;
+    }
+    return (unsigned)-1;
+}
+
+/* sched_task_running
+ * RETURNS:             1 if a task is running on some CPU (this one
+ *                      included), 0 otherwise
+ * INPUTS:              pid -- the task
+ */
+int sched_task_running(pid_t pid) {
+    return task_running(pid) < MAX_CPUS;
+}
 
 /* pit_handler
  * DESCRIPTION:         PIT interrupt handler, calls scheduler
- * INPUTS:              context -- the interrupt context (register state)
- * RETURNS:             none
+ * RETURNS:             none (once the interrupted task runs again)
  */
-void pit_handler(int_regs_t context) {
-    // If no active processes, do nothing
-    if (active_pid == -1) return;
+void pit_handler(void) {
+    update_quantum();
+
+    // If no active processes (or nothing is ready), do nothing. Tasklets
+    // run to completion, the slice ends at the next tick instead
+    if (active_pid == -1 || sched_idling || in_softirq()) return;
 
     // Find PID of next running process
     pid_t next_pid = get_next_pid(active_pid);
-    if (next_pid > MAX_PID) return;
+    if (next_pid == active_pid) return;
 
-    pause_task(context);
+    count_switch(0);
+    pause_task();
     send_eoi(PIT_IRQ);
-    resume_task(next_pid);
 
-    // Should never reach here
-    return;
+    // The interrupted task is about to block and nothing else is ready
+    if (next_pid > MAX_PID) switch_to_idle(active_pid);
+    else resume_task(next_pid);
+}
+
+/* count_switch
+ * DESCRIPTION:         counts a switch away from the running task
+ * INPUTS:              voluntary -- 1 if it blocked or yielded, 0 if it was
+ *                                   preempted
+ */
+static void count_switch(int voluntary) {
+    pcb_t* pcb = get_pcb(active_pid);
+    if (sched_idling || pcb == NULL) return;
+
+    if (voluntary) pcb->nvcsw++;
+    else pcb->nivcsw++;
+}
+
+/* charge_ticks
+ * DESCRIPTION:         charges the ticks since this CPU last did to the
+ *                      task running on it (idle time isn't charged)
+ * INPUTS:              user -- 1 if the task was running in user mode
+ */
+static void charge_ticks(int user) {
+    runqueue_t* rq = this_rq();
+    uint32_t ticks = jiffies - rq->acct_stamp;
+    rq->acct_stamp = jiffies;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    if (sched_idling || pcb == NULL) return;
+
+    if (user) pcb->utime += ticks;
+    else pcb->stime += ticks;
+}
+
+/* sched_account_tick
+ * DESCRIPTION:         charges CPU time on a timer interrupt, to user or
+ *                      kernel time depending on what it interrupted
+ * INPUTS:              user -- 1 if it interrupted user mode
+ * NOTES:               time is charged at timer interrupts and switches, so
+ *                      with TICKLESS long shots it is only as fine as the
+ *                      shots are
+ */
+void sched_account_tick(int user) {
+    charge_ticks(user);
+}
+
+/* sched_account_switch
+ * DESCRIPTION:         charges the outgoing context's time (as kernel
+ *                      time, it is switching from the kernel) and counts
+ *                      the switch, called by whatever switches
+ */
+void sched_account_switch(void) {
+    charge_ticks(0);
+    this_rq()->nr_switches++;
+}
+
+/* sched_nr_switches
+ * RETURNS:             the context switches made on every CPU, summed
+ */
+uint32_t sched_nr_switches(void) {
+    uint32_t cpu;
+    uint32_t count = 0;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        count += runqueues[cpu].nr_switches;
+    }
+    return count;
+}
+
+/* sched_request
+ * DESCRIPTION:         has this CPU switch to a task once the current
+ *                      interrupt's deferred work is done, for tasklets,
+ *                      which can't switch themselves
+ * INPUTS:              pid -- the task
+ */
+void sched_request(pid_t pid) {
+    this_rq()->resched_to = pid;
+}
+
+/* sched_irq_exit
+ * DESCRIPTION:         on the way out of an interrupt, switches to the task
+ *                      a tasklet asked for
+ * RETURNS:             none (once the interrupted context runs again)
+ * NOTES:               called with interrupts disabled, after do_softirq.
+ *                      Inside a tasklet pass the request waits for the pass
+ *                      to end
+ */
+void sched_irq_exit(void) {
+    runqueue_t* rq = this_rq();
+    pid_t pid = rq->resched_to;
+
+    if (pid > MAX_PID || in_softirq()) return;
+    rq->resched_to = (unsigned)-1;
+
+    // The idle context can be left from here too
+    if (pid == active_pid && !sched_idling) return;
+
+    count_switch(0);
+    pause_task();
+    if (-1 == resume_task(pid)) {
+        printf("Task resumption failed for pid: %u\n", pid);
+    }
+}
+
+/* sched_save_slot
+ * RETURNS:             where switch_to should save the current kernel
+ *                      stack: the idle context's, the active task's, or a
+ *                      scratch slot if the task is gone
+ */
+uint32_t* sched_save_slot(void) {
+    if (sched_idling) return &this_rq()->idle_esp;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    return pcb == NULL ? &dead_esp : &pcb->kernel_esp;
+}
+
+/* switch_to_idle
+ * DESCRIPTION:         switches to the idle context
+ * INPUTS:              from -- PID to continue the round robin after
+ * RETURNS:             once the caller is switched back to
+ * NOTES:               called with interrupts disabled, after pause_task
+ */
+static void switch_to_idle(pid_t from) {
+    runqueue_t* rq = this_rq();
+    uint32_t* prev_esp = sched_save_slot();
+    fpu_switch_out();
+    sched_account_switch();
+
+    rq->idle_from = from;
+    sched_idling = 1;
+    rq->idle_entries++;
+    tick_sync();
+    rq->idle_start = jiffies;
+
+    // Kernel mappings are the same in every page directory, so on one CPU
+    // CR3 is kept. With more, the task may next run (and change its
+    // mappings) elsewhere, so this CPU must not keep caching them
+    switch_to(prev_esp, rq->idle_esp, smp_num_cpus() > 1 ? get_kernel_page_dir() : 0, 0);
+}
+
+/* sched_leave_idle
+ * DESCRIPTION:         accounts the idle time that just ended, called by
+ *                      resume_task on its way to a task
+ */
+void sched_leave_idle(void) {
+    if (!sched_idling) return;
+
+    runqueue_t* rq = this_rq();
+    tick_sync();
+    rq->idle_ticks += jiffies - rq->idle_start;
+    rq->acct_stamp = jiffies;
+    sched_idling = 0;
+}
+
+/* sched_idle_ticks
+ * RETURNS:             ticks the CPUs have spent idle, summed, and (in
+ *                      entries) how many times they went idle
+ */
+uint32_t sched_idle_ticks(uint32_t* entries) {
+    unsigned long flags;
+    uint32_t cpu;
+    uint32_t ticks = 0;
+    uint32_t count = 0;
+
+    cli_and_save(flags);
+    tick_sync();
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpus[cpu].online) continue;
+
+        ticks += runqueues[cpu].idle_ticks;
+        if (cpus[cpu].idling) ticks += jiffies - runqueues[cpu].idle_start;
+        count += runqueues[cpu].idle_entries;
+    }
+    if (entries != NULL) *entries = count;
+
+    restore_flags(flags);
+    return ticks;
+}
+
+/* schedule
+ * DESCRIPTION:         gives up the CPU, e.g. after prepare_to_wait. Returns
+ *                      once the task is picked to run again
+ * NOTES:               outside of a task there is nothing to switch to and
+ *                      this returns right away (callers just poll)
+ */
+void schedule(void) {
+    unsigned long flags;
+
+    if (active_pid > MAX_PID) return;
+    cli_and_save(flags);
+
+    pid_t next_pid = get_next_pid(active_pid);
+    if (next_pid != active_pid) {
+        count_switch(1);
+        pause_task();
+        if (next_pid > MAX_PID) switch_to_idle(active_pid);
+        else resume_task(next_pid);
+    }
+
+    restore_flags(flags);
+}
+
+/* sched_exit
+ * DESCRIPTION:         switches away from a task that is gone for good
+ *                      (active_pid must already be cleared)
+ * INPUTS:              old_pid -- the PID the task had
+ * RETURNS:             never
+ */
+void sched_exit(pid_t old_pid) {
+    cli();
+    pid_t next_pid = get_next_pid(old_pid);
+    if (next_pid > MAX_PID) switch_to_idle(old_pid);
+    else resume_task(next_pid);
+}
+
+/* sched_select_cpu
+ * DESCRIPTION:         picks the run queue for a task that becomes ready
+ * INPUTS:              pid -- the task
+ * RETURNS:             index of the CPU: the one it is queued on or running
+ *                      on if any, otherwise the allowed CPU with the fewest
+ *                      ready tasks, preferring the one it last ran on (its
+ *                      cache is warm there). Tasks without a PCB, or no
+ *                      online CPU allowed, go on the current CPU
+ */
+uint32_t sched_select_cpu(pid_t pid) {
+    pcb_t* pcb = get_pcb(pid);
+    if (pcb == NULL) return cpu_id();
+
+    if (runqueues[pcb->cpu].ready_map & (1 << pid)) return pcb->cpu;
+
+    uint32_t running = task_running(pid);
+    if (running < MAX_CPUS) return running;
+
+    uint32_t allowed = pcb->cpus_allowed & smp_online_mask();
+    if (allowed == 0) return cpu_id();
+
+    return least_loaded(allowed, pcb->cpu);
+}
+
+/* sched_migrate
+ * DESCRIPTION:         moves the running task to a CPU it is allowed on, if
+ *                      its affinity no longer allows this one
+ * RETURNS:             once the task runs on an allowed CPU
+ */
+void sched_migrate(void) {
+    unsigned long flags;
+    pcb_t* pcb = get_pcb(active_pid);
+    if (pcb == NULL || (pcb->cpus_allowed & (1 << cpu_id()))) return;
+
+    uint32_t allowed = pcb->cpus_allowed & smp_online_mask();
+    if (allowed == 0) return;
+
+    cli_and_save(flags);
+
+    // Other CPUs only see the task once this one has switched away from
+    // it, they can't get the kernel lock before then
+    pid_t pid = active_pid;
+    uint32_t cpu = least_loaded(allowed, bsf(allowed));
+    sched_dequeue(pid);
+    count_switch(1);
+    pause_task();
+    pcb->cpu = cpu;
+    runqueues[cpu].ready_map |= 1 << pid;
+    smp_send_resched(cpu);
+
+    pid_t next_pid = get_next_pid(pid);
+    if (next_pid > MAX_PID) switch_to_idle(pid);
+    else resume_task(next_pid);
+
+    restore_flags(flags);
+}
+
+/* sched_enqueue
+ * DESCRIPTION:         puts a task on a run queue (see sched_select_cpu),
+ *                      interrupting that CPU if it isn't this one
+ * INPUTS:              pid -- the task
+ */
+void sched_enqueue(pid_t pid) {
+    if (pid > MAX_PID) return;
+
+    uint32_t cpu = sched_select_cpu(pid);
+    pcb_t* pcb = get_pcb(pid);
+    if (pcb != NULL) pcb->cpu = cpu;
+    runqueues[cpu].ready_map |= 1 << pid;
+
+    if (cpu != cpu_id()) {
+        smp_send_resched(cpu);
+        return;
+    }
+
+    // A second runnable task needs the tick (or the local timer) for
+    // preemption
+    update_quantum();
+    tick_update();
+}
+
+/* sched_dequeue
+ * DESCRIPTION:         takes a task off the run queue (it is blocked or gone)
+ * INPUTS:              pid -- the task
+ */
+void sched_dequeue(pid_t pid) {
+    uint32_t cpu;
+
+    if (pid > MAX_PID) return;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        runqueues[cpu].ready_map &= ~(1 << pid);
+    }
+}
+
+/* sched_claim
+ * DESCRIPTION:         moves a task onto this CPU's run queue (if it is
+ *                      ready elsewhere), called before running it here
+ * INPUTS:              pid -- the task
+ */
+void sched_claim(pid_t pid) {
+    pcb_t* pcb = get_pcb(pid);
+    if (pcb == NULL) return;
+
+    uint32_t self = cpu_id();
+    if (pcb->cpu != self && (runqueues[pcb->cpu].ready_map & (1 << pid))) {
+        runqueues[pcb->cpu].ready_map &= ~(1 << pid);
+        runqueues[self].ready_map |= 1 << pid;
+    }
+    pcb->cpu = self;
+}
+
+/* sched_task_ready
+ * RETURNS:             1 if the task is on a run queue (ready or running),
+ *                      0 if it is blocked
+ * INPUTS:              pid -- the task
+ */
+int sched_task_ready(pid_t pid) {
+    uint32_t cpu;
+
+    if (pid > MAX_PID) return 0;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (runqueues[cpu].ready_map & (1 << pid)) return 1;
+    }
+    return sched_task_running(pid);
+}
+
+/* sched_nr_ready
+ * RETURNS:             the number of tasks on this CPU's run queue
+ */
+uint32_t sched_nr_ready(void) {
+    return popcount(this_rq()->ready_map);
+}
+
+/* sched_nr_ready_cpu
+ * RETURNS:             the number of tasks on a CPU's run queue
+ * INPUTS:              cpu -- index of the CPU
+ */
+uint32_t sched_nr_ready_cpu(uint32_t cpu) {
+    if (cpu >= MAX_CPUS) return 0;
+    return popcount(runqueues[cpu].ready_map);
+}
+
+/* sched_resched_ipi
+ * DESCRIPTION:         another CPU changed this one's run queue: starts the
+ *                      quantum timer if a task now waits (an idle CPU
+ *                      checks its queue anyway once the interrupt wakes it)
+ */
+void sched_resched_ipi(void) {
+    update_quantum();
+}
+
+/* pull_task
+ * DESCRIPTION:         for an idle CPU, takes a waiting task from the CPU
+ *                      with the most ready tasks
+ * RETURNS:             the task now queued here, -1 if no CPU has a task
+ *                      waiting (not running) that may run here
+ */
+static pid_t pull_task(void) {
+    uint32_t self = cpu_id();
+    uint32_t busiest = self;
+    uint32_t most = 1;
+    uint32_t cpu;
+
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!cpus[cpu].online) continue;
+
+        uint32_t ready = popcount(runqueues[cpu].ready_map);
+        if (ready > most) {
+            busiest = cpu;
+            most = ready;
+        }
+    }
+    if (busiest == self) return (unsigned)-1;
+
+    uint32_t map = runqueues[busiest].ready_map;
+    while (map != 0) {
+        pid_t pid = bsf(map);
+        pcb_t* pcb = get_pcb(pid);
+        map &= map - 1;
+
+        if (pcb == NULL || !(pcb->cpus_allowed & (1 << self))) continue;
+        if (sched_task_running(pid)) continue;
+
+        sched_claim(pid);
+        return pid;
+    }
+    return (unsigned)-1;
 }
 
 /* get_next_pid
- * DESCRIPTION:         helper to find next process in round-robin policy
- * INPUTS:              active_pid -- pid of current process
- * RETURNS:             pid of next process
+ * DESCRIPTION:         helper to find next process in round-robin policy,
+ *                      the first ready PID after the current one
+ * INPUTS:              old_pid -- pid of current process
+ * RETURNS:             pid of next process (old_pid if it is the only one
+ *                      ready), -1 if nothing is ready
  */
 pid_t get_next_pid(pid_t old_pid) {
+    uint32_t ready_map = this_rq()->ready_map;
+    if (ready_map == 0) return (unsigned)-1;
 
-    pid_t pid = old_pid + 1;
-    pcb_t* candidate_pcb;
+    // Ready PIDs above old_pid come first, then wrap around
+    uint32_t later = old_pid < MAX_PID ? ready_map & ~((2U << old_pid) - 1) : 0;
+    return bsf(later != 0 ? later : ready_map);
+}
 
-    while (pid != old_pid) {
-        if (pid > MAX_PID) pid = 0;
-        if(pid_in_use(pid)){
-            candidate_pcb = get_pcb(pid);
-            if (candidate_pcb->flags & TASK_EXECUTING) {
-                return pid;
-            }
+/* idle_loop
+ * DESCRIPTION:         the idle context, runs when no task is ready: pulls
+ *                      a waiting task from a busier CPU, does background
+ *                      work (leftover tasklets, zeroing frames), otherwise
+ *                      halts until an interrupt, and resumes the first task
+ *                      that becomes ready
+ * RETURNS:             never
+ * NOTES:               the kernel lock is let go while halted
+ */
+void idle_loop(void) {
+    while (1) {
+        cli();
+        pid_t next_pid = get_next_pid(this_rq()->idle_from);
+        if (next_pid > MAX_PID) next_pid = pull_task();
+        if (next_pid <= MAX_PID) {
+            // Continues here the next time the CPU goes idle
+            resume_task(next_pid);
+            continue;
         }
 
-        pid++;
-    }
+        // Tasklets an interrupt left for later
+        do_softirq();
+        sched_irq_exit();
 
-    return (unsigned)-1;
+        sti();
+        if (refill_zero_pool(ZERO_POOL_BATCH) == 0) {
+            // sti only takes effect after hlt, so no wakeup slips in between
+            cli();
+            if (get_next_pid(this_rq()->idle_from) > MAX_PID && !softirq_pending()) {
+                unlock_kernel();
+                asm volatile ("sti; hlt" : : : "memory");
+                cli();
+                lock_kernel();
+            }
+        }
+    }
 }
@@ -1,9 +1,37 @@
-#ifndef _PAGING_H
-#define _PAGING_H
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
 
 #include "../tasks/process.h"
+#include "../arch/cpu.h"
 
-void pit_handler(int_regs_t context);
+// Set while this CPU runs its idle context, active_pid then still names the
+// last task (whose context is saved), or -1 if it is gone
+#define sched_idling    (this_cpu()->idling)
+
+void init_scheduler(void);
+void pit_handler(void);
+void schedule(void);
+void sched_request(pid_t pid);
+void sched_account_tick(int user);
+void sched_account_switch(void);
+uint32_t sched_nr_switches(void);
+void sched_irq_exit(void);
+void sched_exit(pid_t old_pid);
 pid_t get_next_pid(pid_t pid);
+void sched_enqueue(pid_t pid);
+void sched_dequeue(pid_t pid);
+uint32_t sched_nr_ready(void);
+uint32_t sched_nr_ready_cpu(uint32_t cpu);
+uint32_t sched_select_cpu(pid_t pid);
+void sched_migrate(void);
+void sched_claim(pid_t pid);
+int sched_task_running(pid_t pid);
+int sched_task_ready(pid_t pid);
+void sched_resched_ipi(void);
+uint32_t sched_idle_stack(uint32_t cpu);
+uint32_t* sched_save_slot(void);
+void sched_leave_idle(void);
+uint32_t sched_idle_ticks(uint32_t* entries);
+void idle_loop(void);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef _SWITCH_H
+#define _SWITCH_H
+
+#include "../lib/types.h"
+
+/* Registers pushed by switch_to below its return address (and above the
+ * kernel lock depth) */
+#define SWITCH_SAVED_REGS 4
+
+/* Saves the current kernel stack in *prev_esp and continues on next_esp,
+ * loading next_cr3 and next_esp0 into CR3 and the TSS (skipped when 0) */
+extern void switch_to(uint32_t* prev_esp, uint32_t next_esp,
+                      uint32_t next_cr3, uint32_t next_esp0);
+
+/* Unwinds an interrupt frame (popal, error code, iret), see interrupt_link.S */
+extern void ret_from_intr(void);
+
+/* switch_frame
+ * DESCRIPTION:         builds what switch_to pops on a stack that hasn't run
+ *                      yet, so that the first switch to it returns to entry
+ *                      holding the kernel lock once, like any switched-out
+ *                      context
+ * INPUTS:              stack -- top of the stack, below anything entry expects
+ *                      entry -- where the first switch returns to
+ * RETURNS:             the stack pointer to switch to
+ */
+static inline uint32_t switch_frame(uint32_t* stack, void (*entry)(void)) {
+    int i;
+
+    *--stack = (uint32_t)entry;
+    for (i = 0; i < SWITCH_SAVED_REGS; i++) {
+        *--stack = 0;
+    }
+    *--stack = 1;                   // Kernel lock depth
+    return (uint32_t)stack;
+}
+
+#endif /* _SWITCH_H */
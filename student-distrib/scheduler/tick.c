@@ -0,0 +1,233 @@
+#include "tick.h"
+#include "timer.h"
+#include "scheduler.h"
+
+#include "../lib/lib.h"
+#include "../arch/smp.h"
+
+/* With TICKLESS the timer is never left running periodically. Every
+ * interrupt arms a single shot for the next thing that needs the CPU:
+ * the end of the running task's quantum if another task is waiting,
+ * otherwise the next kernel timer. With nothing to do the shot is as long
+ * as the device allows, so idle and lightly loaded systems skip most ticks.
+ *
+ * Shots always end on a tick boundary. Counts already past the last
+ * boundary (interrupt latency, or the elapsed part of a shot that is cut
+ * short) are carried into the next shot, so jiffies doesn't drift.
+ *
+ * Only TICK_CPU's timer advances jiffies. Other CPUs can't sync it, so
+ * while any are online the shot is a single tick. */
+
+static const tick_device_t* dev = NULL;
+static uint32_t max_shot;       // Longest shot, in ticks
+static uint32_t shot_base;      // jiffies at the boundary the shot counts from
+static uint32_t shot_lead;      // Counts between that boundary and arming
+static uint32_t shot_counts;    // Counts the shot was armed with
+static uint32_t shot_end;       // jiffies value the shot fires at
+static int in_irq = 0;
+
+// Interrupts latched for a shot that was re-armed before they got in,
+// they must not end the new shot
+static uint32_t stale_irqs = 0;
+
+static tick_stats_t stats;
+static uint32_t start_jiffies;
+static uint32_t start_irqs;
+
+/* shot_elapsed
+ * RETURNS:             counts since the shot's base tick boundary
+ * INPUTS:              fired -- 1 if the shot is known to have fired
+ */
+static uint32_t shot_elapsed(int fired){
+    return shot_lead + dev->elapsed(shot_counts, fired);
+}
+
+/* next_deadline
+ * RETURNS:             jiffies value the next shot should end at, always
+ *                      after the current jiffies
+ */
+static uint32_t next_deadline(void){
+    uint32_t ticks = smp_num_cpus() > 1 ? 1 : max_shot;
+
+    // Round-robin between tasks needs a tick every quantum
+    if(sched_nr_ready() > 1) ticks = SCHED_QUANTUM;
+
+    uint32_t expires = timer_next_expiry();
+    if(!time_after_eq(expires, jiffies + ticks)){
+        ticks = time_after_eq(jiffies, expires) ? 1 : expires - jiffies;
+    }
+
+    return jiffies + ticks;
+}
+
+/* arm_shot
+ * DESCRIPTION:         programs the device to fire at end
+ * INPUTS:              end -- jiffies value to fire at, after jiffies
+ *                      lead -- counts already elapsed since jiffies' boundary
+ */
+static void arm_shot(uint32_t end, uint32_t lead){
+    // Far enough behind to be past the deadline already, fire right away
+    uint32_t counts = (end - jiffies) * dev->counts_per_tick;
+    counts = counts > lead ? counts - lead : 1;
+
+    // Stop the old shot before looking for its interrupt. Checking first
+    // would miss one raised between the check and the re-arm, which would
+    // then end the new shot early
+    dev->stop();
+    if(dev->irq_pending()){
+        stale_irqs++;
+        stats.stale++;
+    }
+
+    shot_base = jiffies;
+    shot_lead = lead;
+    shot_counts = counts;
+    shot_end = end;
+    dev->arm(counts);
+}
+
+/* tick_start
+ * DESCRIPTION:         starts the one-shot tick
+ * INPUTS:              device -- the timer to drive it with
+ */
+void tick_start(const tick_device_t* device){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    dev = device;
+    max_shot = dev->max_counts / dev->counts_per_tick;
+    start_jiffies = jiffies;
+    start_irqs = stats.irqs;
+    arm_shot(next_deadline(), 0);
+
+    restore_flags(flags);
+}
+
+/* tick_stop
+ * DESCRIPTION:         stops the one-shot tick, jiffies stand still until
+ *                      a device is started again
+ */
+void tick_stop(void){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if(dev != NULL) dev->stop();
+    dev = NULL;
+    stale_irqs = 0;
+
+    restore_flags(flags);
+}
+
+/* tick_get_device
+ * RETURNS:             the device driving the tick, NULL if it is periodic
+ */
+const tick_device_t* tick_get_device(void){
+    return dev;
+}
+
+/* tick_irq
+ * DESCRIPTION:         handles a timer interrupt: advances jiffies to the
+ *                      end of the shot, runs timers and arms the next one
+ * NOTES:               falls back to a plain periodic tick without TICKLESS
+ */
+void tick_irq(void){
+    stats.irqs++;
+
+    if(dev == NULL){
+        timer_tick();
+        return;
+    }
+
+    if(stale_irqs > 0){
+        stale_irqs--;
+        return;
+    }
+
+    in_irq = 1;
+    jiffies = shot_end;
+    run_timers();
+    in_irq = 0;
+
+    // Carry over the time since the shot fired (including running timers).
+    // Stale interrupts were skipped above, so this shot is known to have fired
+    uint32_t overshoot = shot_elapsed(1) - shot_lead - shot_counts;
+    if((int32_t)overshoot < 0) overshoot = 0;
+    uint32_t lead = overshoot % dev->counts_per_tick;
+    jiffies += overshoot / dev->counts_per_tick;
+    arm_shot(next_deadline(), lead);
+}
+
+/* tick_sync
+ * DESCRIPTION:         advances jiffies by the whole ticks elapsed since
+ *                      the last timer interrupt
+ * NOTES:               timers that became due run on the next interrupt.
+ *                      Does nothing on other CPUs than TICK_CPU
+ */
+void tick_sync(void){
+    if(dev == NULL || in_irq || cpu_id() != TICK_CPU) return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    uint32_t now = shot_base + shot_elapsed(0) / dev->counts_per_tick;
+    if(time_after_eq(now, shot_end)) now = shot_end - 1; // Interrupt pending
+    if(!time_after_eq(jiffies, now)) jiffies = now;
+
+    restore_flags(flags);
+}
+
+/* tick_update
+ * DESCRIPTION:         cuts the armed shot short when something (a new
+ *                      timer, another runnable task) needs the CPU sooner
+ */
+void tick_update(void){
+    if(dev == NULL || in_irq || cpu_id() != TICK_CPU) return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+
+    tick_sync();
+    uint32_t end = next_deadline();
+    if(!time_after_eq(end, shot_end)){
+        uint32_t elapsed = shot_elapsed(0);
+        arm_shot(end, elapsed - (jiffies - shot_base) * dev->counts_per_tick);
+        stats.reprograms++;
+    }
+
+    restore_flags(flags);
+}
+
+/* tick_get_stats
+ * DESCRIPTION:         copies out the tick statistics
+ * INPUTS:              out -- where to copy them
+ */
+void tick_get_stats(tick_stats_t* out){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    *out = stats;
+    out->ticks = jiffies - start_jiffies;
+    uint32_t irqs = stats.irqs - start_irqs;
+    out->avoided = out->ticks > irqs ? out->ticks - irqs : 0;
+
+    restore_flags(flags);
+}
+
+/* tick_print_stats
+ * DESCRIPTION:         prints how many timer interrupts the dynamic tick
+ *                      has avoided, and how much of the time was idle
+ */
+void tick_print_stats(void){
+    tick_stats_t s;
+    tick_get_stats(&s);
+
+    printf("tick (%s): %u ticks, %u interrupts, %u avoided, %u reprogrammed, %u stale\n",
+        dev != NULL ? dev->name : "periodic", s.ticks, s.irqs, s.avoided, s.reprograms, s.stale);
+
+    // Idle time is summed over the CPUs
+    uint32_t entries;
+    uint32_t idle = sched_idle_ticks(&entries);
+    uint32_t cpu_ticks = s.ticks * smp_num_cpus();
+    printf("idle: %u ticks on %u CPUs (%u%% of the time), entered %u times\n",
+        idle, smp_num_cpus(), cpu_ticks > 0 ? idle * 100 / cpu_ticks : 0, entries);
+}
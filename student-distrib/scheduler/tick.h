@@ -0,0 +1,59 @@
+#ifndef _TICK_H
+#define _TICK_H
+
+#include "../lib/types.h"
+
+/* Ticks a task runs for while others are waiting for the CPU */
+#define SCHED_QUANTUM       1
+
+/* The CPU whose timer advances jiffies (the others only time quanta) */
+#define TICK_CPU            0
+
+/* A timer that can fire once after a number of counts, counting at a
+ * fixed rate (the PIT, or the local APIC timer) */
+typedef struct {
+    const char* name;
+    uint32_t counts_per_tick;   // Counts in one jiffy
+    uint32_t max_counts;        // Longest shot
+
+    // Starts a shot, the interrupt comes after counts
+    void (*arm)(uint32_t counts);
+    // Stops the running shot, it raises no interrupt after this returns
+    // (one it already raised stays pending)
+    void (*stop)(void);
+    // Counts since a shot of counts was armed, also correct for a while
+    // after it fired. With fired 1 the caller knows the shot has fired
+    // (tick_irq, for the shot's own interrupt) and the device takes its
+    // word for it. With 0 the device checks its own status (the PIT's
+    // read-back, the APIC's IRR)
+    uint32_t (*elapsed)(uint32_t counts, int fired);
+    // 1 if the device's interrupt is latched but not delivered yet
+    int (*irq_pending)(void);
+} tick_device_t;
+
+typedef struct {
+    uint32_t irqs;          // Timer interrupts taken
+    uint32_t ticks;         // Ticks (jiffies) since the tick was started
+    uint32_t avoided;       // Of those, ticks that took no interrupt
+    uint32_t reprograms;    // One-shots cut short for a sooner deadline
+    uint32_t stale;         // Interrupts from shots that were re-armed
+} tick_stats_t;
+
+/* Arms the first one-shot on the given device */
+void tick_start(const tick_device_t* dev);
+void tick_stop(void);
+const tick_device_t* tick_get_device(void);
+
+/* Timer interrupt, advances jiffies, runs timers and arms the next shot */
+void tick_irq(void);
+
+/* Brings jiffies up to date in the middle of a long shot */
+void tick_sync(void);
+
+/* Re-arms the tick sooner if a new timer or runnable task needs it */
+void tick_update(void);
+
+void tick_get_stats(tick_stats_t* stats);
+void tick_print_stats(void);
+
+#endif /* _TICK_H */
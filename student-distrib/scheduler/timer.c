@@ -0,0 +1,252 @@
+#include "timer.h"
+#include "scheduler.h"
+#include "tick.h"
+
+#include "../lib/lib.h"
+#include "../lib/spinlock.h"
+#include "../tasks/process.h"
+
+volatile uint32_t jiffies = 0;
+
+// Next tick the wheel has to process, trails jiffies while timers run
+static uint32_t timer_jiffies = 0;
+
+static ktimer_t* tv1[TVR_SIZE];
+static ktimer_t* tvn[TVN_LEVELS][TVN_SIZE];
+static spinlock_t timer_lock;
+
+/* list_add
+ * DESCRIPTION:         adds a timer to the front of a wheel slot
+ */
+static void list_add(ktimer_t** slot, ktimer_t* timer){
+    timer->prev = NULL;
+    timer->next = *slot;
+    if(timer->next != NULL) timer->next->prev = timer;
+    *slot = timer;
+    timer->slot = slot;
+}
+
+/* list_del
+ * DESCRIPTION:         unlinks a timer from its wheel slot
+ */
+static void list_del(ktimer_t* timer){
+    if(timer->prev != NULL) timer->prev->next = timer->next;
+    else *timer->slot = timer->next;
+    if(timer->next != NULL) timer->next->prev = timer->prev;
+    timer->slot = NULL;
+}
+
+/* internal_add_timer
+ * DESCRIPTION:         files a timer in the wheel covering its expiry
+ * NOTES:               caller must hold timer_lock
+ */
+static void internal_add_timer(ktimer_t* timer){
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - timer_jiffies;
+
+    if((int32_t)delta < 0){
+        // Already due, run it on the next tick
+        list_add(&tv1[timer_jiffies & TVR_MASK], timer);
+    }
+    else if(delta < TVR_SIZE){
+        list_add(&tv1[expires & TVR_MASK], timer);
+    }
+    else{
+        if(delta > MAX_TIMER_DELTA){
+            delta = MAX_TIMER_DELTA;
+            expires = timer->expires = timer_jiffies + delta;
+        }
+
+        int level = 0;
+        while(delta >= (1U << (TVR_BITS + (level + 1)*TVN_BITS))) level++;
+        uint32_t index = (expires >> (TVR_BITS + level*TVN_BITS)) & TVN_MASK;
+        list_add(&tvn[level][index], timer);
+    }
+}
+
+/* cascade
+ * DESCRIPTION:         moves the timers of one slot of a coarse wheel down
+ *                      to the finer wheels
+ * RETURNS:             the slot index, 0 means the next wheel must cascade too
+ * NOTES:               caller must hold timer_lock
+ */
+static uint32_t cascade(int level){
+    uint32_t index = (timer_jiffies >> (TVR_BITS + level*TVN_BITS)) & TVN_MASK;
+
+    ktimer_t* timer = tvn[level][index];
+    tvn[level][index] = NULL;
+    while(timer != NULL){
+        ktimer_t* next = timer->next;
+        internal_add_timer(timer);
+        timer = next;
+    }
+
+    return index;
+}
+
+/* init_timers
+ * DESCRIPTION:         empties the timer wheels
+ */
+void init_timers(void){
+    int i, level;
+
+    spin_lock_init(&timer_lock, "timer");
+    for(i = 0; i < TVR_SIZE; i++) tv1[i] = NULL;
+    for(level = 0; level < TVN_LEVELS; level++){
+        for(i = 0; i < TVN_SIZE; i++) tvn[level][i] = NULL;
+    }
+    timer_jiffies = jiffies;
+}
+
+/* init_timer
+ * DESCRIPTION:         sets up a timer before its first use
+ * INPUTS:              timer -- the timer
+ *                      fn -- callback, run from the timer interrupt
+ *                      data -- argument for the callback
+ */
+void init_timer(ktimer_t* timer, void (*fn)(uint32_t data), uint32_t data){
+    timer->next = timer->prev = NULL;
+    timer->slot = NULL;
+    timer->fn = fn;
+    timer->data = data;
+}
+
+/* add_timer
+ * DESCRIPTION:         (re)arms a timer
+ * INPUTS:              timer -- the timer
+ *                      expires -- jiffies value to fire at
+ */
+void add_timer(ktimer_t* timer, uint32_t expires){
+    unsigned long flags = spin_lock_irqsave(&timer_lock);
+    if(timer->slot != NULL) list_del(timer);
+    timer->expires = expires;
+    internal_add_timer(timer);
+    spin_unlock_irqrestore(&timer_lock, flags);
+
+    // The tick may be armed to fire later than this timer
+    tick_update();
+}
+
+/* del_timer
+ * DESCRIPTION:         disarms a timer
+ * INPUTS:              timer -- the timer
+ * RETURNS:             1 if the timer was pending, 0 otherwise
+ */
+int del_timer(ktimer_t* timer){
+    unsigned long flags = spin_lock_irqsave(&timer_lock);
+    int pending = timer->slot != NULL;
+    if(pending) list_del(timer);
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return pending;
+}
+
+/* timer_pending
+ * RETURNS:             1 if the timer is armed and hasn't fired yet
+ */
+int timer_pending(ktimer_t* timer){
+    return timer->slot != NULL;
+}
+
+/* timer_tick
+ * DESCRIPTION:         advances jiffies by one tick and runs every timer
+ *                      that is due (the periodic tick)
+ */
+void timer_tick(void){
+    jiffies++;
+    run_timers();
+}
+
+/* run_timers
+ * DESCRIPTION:         runs every timer that is due, catching up on every
+ *                      tick since the last call (jiffies may have jumped)
+ * NOTES:               callbacks run with timer_lock released, so they may
+ *                      re-arm their own timer
+ */
+void run_timers(void){
+    unsigned long flags = spin_lock_irqsave(&timer_lock);
+    while(time_after_eq(jiffies, timer_jiffies)){
+        uint32_t index = timer_jiffies & TVR_MASK;
+
+        // The fine wheel wrapped, pull the next slot of each coarse wheel down
+        int level = 0;
+        if(index == 0){
+            while(level < TVN_LEVELS && cascade(level) == 0) level++;
+        }
+        timer_jiffies++;
+
+        ktimer_t* timer;
+        while((timer = tv1[index]) != NULL){
+            list_del(timer);
+            spin_unlock_irqrestore(&timer_lock, flags);
+            timer->fn(timer->data);
+            flags = spin_lock_irqsave(&timer_lock);
+        }
+    }
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+/* timer_next_expiry
+ * DESCRIPTION:         finds when run_timers next has work to do
+ * RETURNS:             jiffies value of the earliest timer on the fine wheel,
+ *                      or of the next cascade if it has none
+ */
+uint32_t timer_next_expiry(void){
+    unsigned long flags = spin_lock_irqsave(&timer_lock);
+
+    uint32_t expires = timer_jiffies;
+    do{
+        if(tv1[expires & TVR_MASK] != NULL) break;
+        expires++;
+    } while(expires & TVR_MASK);
+
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return expires;
+}
+
+/* wake_task
+ * DESCRIPTION:         timer callback putting a sleeping task back on the
+ *                      run queue
+ * INPUTS:              data -- the task's PID
+ */
+static void wake_task(uint32_t data){
+    sched_enqueue((pid_t)data);
+}
+
+/* sleep_for
+ * DESCRIPTION:         sleeps for a number of ticks from now
+ * INPUTS:              ticks -- how long to sleep
+ */
+void sleep_for(uint32_t ticks){
+    // jiffies lags behind while a long one-shot tick is armed
+    tick_sync();
+    sleep_until(jiffies + ticks);
+}
+
+/* sleep_until
+ * DESCRIPTION:         sleeps until jiffies reaches expires
+ * INPUTS:              expires -- jiffies value to wake up at
+ * NOTES:               outside of a task (e.g. tests, before the PIT is
+ *                      running) there is nothing to wake up to, so this
+ *                      returns right away
+ */
+void sleep_until(uint32_t expires){
+    if(active_pid > MAX_PID) return;
+
+    ktimer_t timer;
+    init_timer(&timer, wake_task, active_pid);
+    add_timer(&timer, expires);
+
+    unsigned long flags;
+    while(1){
+        cli_and_save(flags);
+        if(!timer_pending(&timer)) break;
+        sched_dequeue(active_pid);
+        restore_flags(flags);
+
+        schedule();
+    }
+    restore_flags(flags);
+
+    // Still runnable whichever way we got here
+    sched_enqueue(active_pid);
+}
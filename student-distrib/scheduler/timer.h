@@ -0,0 +1,58 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "../lib/types.h"
+#include "../interrupts/pit.h"
+
+/* One jiffy is one PIT tick */
+#define TIMER_HZ            PIT_FREQ
+#define NSEC_PER_SEC        1000000000U
+#define NSEC_PER_TICK       (NSEC_PER_SEC / TIMER_HZ)
+
+/* Timer wheel layout: a 256 slot wheel for the next 256 ticks, then three
+ * coarser 64 slot wheels that are cascaded down as time passes. Timers
+ * further out than the last wheel covers are clamped to its end. */
+#define TVR_BITS            8
+#define TVN_BITS            6
+#define TVR_SIZE            (1 << TVR_BITS)
+#define TVN_SIZE            (1 << TVN_BITS)
+#define TVR_MASK            (TVR_SIZE - 1)
+#define TVN_MASK            (TVN_SIZE - 1)
+#define TVN_LEVELS          3
+#define MAX_TIMER_DELTA     ((1 << (TVR_BITS + TVN_LEVELS*TVN_BITS)) - 1)
+
+/* Wraparound-safe comparison of jiffies values */
+#define time_after_eq(a, b) ((int32_t)((a) - (b)) >= 0)
+
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer* prev;
+    struct ktimer** slot;   // Wheel slot holding the timer, NULL when idle
+    uint32_t expires;       // Jiffies value to fire at
+    void (*fn)(uint32_t data);
+    uint32_t data;
+} ktimer_t;
+
+extern volatile uint32_t jiffies;
+
+void init_timers(void);
+
+/* Timers, the callback runs from the timer interrupt */
+void init_timer(ktimer_t* timer, void (*fn)(uint32_t data), uint32_t data);
+void add_timer(ktimer_t* timer, uint32_t expires);
+int del_timer(ktimer_t* timer);
+int timer_pending(ktimer_t* timer);
+
+/* Periodic tick: advances jiffies by one and runs expired timers */
+void timer_tick(void);
+
+/* Runs expired timers up to jiffies, and finds when the next one is due */
+void run_timers(void);
+uint32_t timer_next_expiry(void);
+
+/* Puts the active task to sleep for a number of ticks, or until jiffies
+ * reaches expires */
+void sleep_for(uint32_t ticks);
+void sleep_until(uint32_t expires);
+
+#endif /* _TIMER_H */
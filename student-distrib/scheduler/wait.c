@@ -0,0 +1,64 @@
+#include "wait.h"
+#include "scheduler.h"
+
+#include "../lib/lib.h"
+
+/* init_wait_queue
+ * DESCRIPTION:         empties a wait queue
+ * INPUTS:              wq -- the wait queue
+ */
+void init_wait_queue(wait_queue_t* wq){
+    wq->waiters = 0;
+}
+
+/* prepare_to_wait
+ * DESCRIPTION:         adds the active task to a wait queue and takes it
+ *                      off the run queue, it keeps running until the next
+ *                      schedule() call
+ * INPUTS:              wq -- the wait queue
+ * NOTES:               does nothing outside of a task
+ */
+void prepare_to_wait(wait_queue_t* wq){
+    if(active_pid > MAX_PID) return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+    wq->waiters |= 1 << active_pid;
+    sched_dequeue(active_pid);
+    restore_flags(flags);
+}
+
+/* finish_wait
+ * DESCRIPTION:         removes the active task from a wait queue and makes
+ *                      sure it is runnable, whether or not it was woken up
+ * INPUTS:              wq -- the wait queue
+ */
+void finish_wait(wait_queue_t* wq){
+    if(active_pid > MAX_PID) return;
+
+    unsigned long flags;
+    cli_and_save(flags);
+    wq->waiters &= ~(1 << active_pid);
+    sched_enqueue(active_pid);
+    restore_flags(flags);
+}
+
+/* wake_up
+ * DESCRIPTION:         puts every task waiting on a queue back on the run
+ *                      queue
+ * INPUTS:              wq -- the wait queue
+ */
+void wake_up(wait_queue_t* wq){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    uint32_t waiters = wq->waiters;
+    wq->waiters = 0;
+
+    pid_t pid;
+    for(pid = 0; waiters != 0; pid++, waiters >>= 1){
+        if(waiters & 1) sched_enqueue(pid);
+    }
+
+    restore_flags(flags);
+}
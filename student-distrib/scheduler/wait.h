@@ -0,0 +1,22 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+#include "../lib/types.h"
+#include "../tasks/process.h"
+
+/* Tasks sleeping on an event, bit n is set while task n waits */
+typedef struct {
+    volatile uint32_t waiters;
+} wait_queue_t;
+
+void init_wait_queue(wait_queue_t* wq);
+
+/* Sleeping: prepare_to_wait, check the condition, schedule, repeat, then
+ * finish_wait. Being queued before the check means no wakeup is lost. */
+void prepare_to_wait(wait_queue_t* wq);
+void finish_wait(wait_queue_t* wq);
+
+/* Makes every waiter runnable again, safe from interrupt context */
+void wake_up(wait_queue_t* wq);
+
+#endif /* _WAIT_H */
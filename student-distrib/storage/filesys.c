@@ -1,4 +1,5 @@
 #include "filesys.h"
+#include "procfs.h"
 
 /* boot block pointer and filesystem size variables */
 static boot_block_t* disk_img;
@@ -72,6 +73,9 @@ int32_t read_dentry_by_name (const int8_t* fname, dentry_t* dentry){
     // Check that pointer is valid
     if(fname == NULL || dentry == NULL) return -1;
 
+    // Virtual files under proc/ aren't in the boot block
+    if(procfs_lookup(fname, dentry) == 0) return 0;
+
     // Go through each dentry to search for filename
     int i;
     for(i = 0; i < disk_img->n_dentries; i++){
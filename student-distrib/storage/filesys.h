@@ -23,6 +23,7 @@ typedef struct file_t {
     int32_t inode;
     int32_t fpos;
     int32_t flags;
+    uint32_t deadline;  // RTC: jiffies of the last virtual interrupt
 } file_t;
 
 // file_t's flags options
@@ -32,6 +33,7 @@ typedef struct file_t {
 #define DENTRY_TYPE_RTC 0
 #define DENTRY_TYPE_DIR 1
 #define DENTRY_TYPE_FILE 2
+#define DENTRY_TYPE_PROC 3 // Virtual, see procfs.c
 
 // Boot block directory entry struct
 typedef struct {
@@ -0,0 +1,250 @@
+#include "procfs.h"
+
+#include "../lib/lib.h"
+#include "../arch/smp.h"
+#include "../interrupts/interrupts.h"
+#include "../interrupts/softirq.h"
+#include "../memory/frame.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/tick.h"
+#include "../scheduler/timer.h"
+
+#define NUM_BUF_SIZE 12 // Digits of a uint32_t and '\0'
+
+// Text being built by a render function
+typedef struct {
+    int8_t* buf;
+    uint32_t len;
+    uint32_t size;
+} proc_out_t;
+
+// A file's text is rebuilt on every read (under the kernel lock)
+static int8_t read_buf[PROC_BUF_SIZE];
+
+/* put_str
+ * DESCRIPTION:         appends a string, as much as fits
+ */
+static void put_str(proc_out_t* out, const int8_t* s){
+    while(*s != '\0' && out->len < out->size){
+        out->buf[out->len++] = *s++;
+    }
+}
+
+/* put_field
+ * DESCRIPTION:         appends a "name value" line
+ */
+static void put_field(proc_out_t* out, const int8_t* name, uint32_t value){
+    int8_t num[NUM_BUF_SIZE];
+
+    put_str(out, name);
+    put_str(out, " ");
+    put_str(out, itoa(value, num, 10));
+    put_str(out, "\n");
+}
+
+/* put_name
+ * DESCRIPTION:         appends a "name value" line with a string value
+ */
+static void put_name(proc_out_t* out, const int8_t* name, const int8_t* value){
+    put_str(out, name);
+    put_str(out, " ");
+    put_str(out, value);
+    put_str(out, "\n");
+}
+
+/* render_stat
+ * DESCRIPTION:         builds proc/stat: CPU time, switches, interrupt and
+ *                      fault counters, the dynamic tick, tasks and memory
+ */
+static void render_stat(proc_out_t* out){
+    intr_stats_t intr;
+    softirq_stats_t softirq;
+    tick_stats_t tick;
+    int8_t name[NUM_BUF_SIZE + 3];
+    uint32_t idle_entries, i;
+
+    intr_get_stats(&intr);
+    softirq_get_stats(&softirq);
+    tick_get_stats(&tick);
+
+    put_field(out, "cpus", smp_num_cpus());
+    put_field(out, "hz", TIMER_HZ);
+    put_field(out, "jiffies", jiffies);
+    put_field(out, "idle", sched_idle_ticks(&idle_entries));
+    put_field(out, "ctxt", sched_nr_switches());
+    put_field(out, "tasks", num_tasks);
+
+    for(i = 0; i < NUM_IRQS; i++){
+        if(intr.irqs[i] == 0) continue;
+
+        strcpy(name, "irq");
+        itoa(i, name + 3, 10);
+        put_field(out, name, intr.irqs[i]);
+    }
+    put_field(out, "ipi", intr.ipis);
+    put_field(out, "tasklets", softirq.run);
+    put_field(out, "minflt", intr.min_flt);
+    put_field(out, "majflt", intr.maj_flt);
+    put_field(out, "exceptions", intr.exceptions);
+    put_field(out, "tick_irqs", tick.irqs);
+    put_field(out, "tick_avoided", tick.avoided);
+    put_field(out, "tick_reprograms", tick.reprograms);
+    put_field(out, "tick_stale", tick.stale);
+
+    put_field(out, "frames_free", num_free_frames());
+    put_field(out, "frames_zeroed", num_zeroed_frames());
+}
+
+/* task_name
+ * RETURNS:             a task's name: a kernel thread's own, otherwise the
+ *                      name of its executable ("?" if it isn't found)
+ * INPUTS:              pcb -- the task
+ *                      buf -- space for the name, MAX_FILENAME_SIZE + 1
+ */
+static const int8_t* task_name(pcb_t* pcb, int8_t* buf){
+    dentry_t dentry;
+    uint32_t i;
+
+    if(pcb->flags & TASK_KTHREAD) return pcb->args;
+
+    for(i = 0; read_dentry_by_index(i, &dentry) == 0; i++){
+        if(dentry.type == DENTRY_TYPE_FILE && dentry.inode == pcb->exe_inode){
+            memcpy(buf, dentry.name, MAX_FILENAME_SIZE);
+            buf[MAX_FILENAME_SIZE] = '\0';
+            return buf;
+        }
+    }
+    return "?";
+}
+
+/* render_task
+ * DESCRIPTION:         builds proc/<pid>: the task's state, CPU time,
+ *                      switches, system calls, faults and heap
+ * INPUTS:              pid -- the task, which must exist
+ */
+static void render_task(proc_out_t* out, pid_t pid){
+    pcb_t* pcb = get_pcb(pid);
+    int8_t name[MAX_FILENAME_SIZE + 1];
+
+    put_field(out, "pid", pid);
+    put_name(out, "name", task_name(pcb, name));
+    put_name(out, "state", sched_task_running(pid) ? "R" : sched_task_ready(pid) ? "W" : "S");
+    put_field(out, "kthread", (pcb->flags & TASK_KTHREAD) != 0);
+    put_field(out, "cpu", pcb->cpu);
+    put_field(out, "terminal", pcb->terminal);
+    put_field(out, "utime", pcb->utime);
+    put_field(out, "stime", pcb->stime);
+    put_field(out, "nvcsw", pcb->nvcsw);
+    put_field(out, "nivcsw", pcb->nivcsw);
+    put_field(out, "syscalls", pcb->nsyscalls);
+    put_field(out, "minflt", pcb->min_flt);
+    put_field(out, "majflt", pcb->maj_flt);
+    put_field(out, "heap", pcb->brk - pcb->heap_start);
+}
+
+/* procfs_lookup
+ * DESCRIPTION:         finds a virtual file: proc/stat, or proc/<pid> for
+ *                      a PID in use
+ * INPUTS:              fname -- the file name
+ *                      dentry -- filled in on success
+ * RETURNS:             0 on success, -1 if it isn't one
+ */
+int32_t procfs_lookup(const int8_t* fname, dentry_t* dentry){
+    const int8_t* name = fname + PROC_PREFIX_LEN;
+    int32_t inode;
+
+    if(strncmp(fname, PROC_PREFIX, PROC_PREFIX_LEN) != 0) return -1;
+
+    if(strncmp(name, "stat", 5) == 0){
+        inode = PROC_STAT_INODE;
+    }
+    else{
+        // A decimal PID, no leading zeros
+        uint32_t pid = 0;
+        const int8_t* c;
+
+        if(*name < '0' || *name > '9' || (name[0] == '0' && name[1] != '\0')) return -1;
+        for(c = name; *c != '\0'; c++){
+            if(*c < '0' || *c > '9') return -1;
+            pid = pid * 10 + (*c - '0');
+            if(pid > MAX_PID) return -1;
+        }
+        if(!pid_in_use(pid)) return -1;
+        inode = pid;
+    }
+
+    memset(dentry, 0, sizeof(dentry_t));
+    strncpy(dentry->name, fname, MAX_FILENAME_SIZE);
+    dentry->type = DENTRY_TYPE_PROC;
+    dentry->inode = inode;
+    return 0;
+}
+
+/* procfs_render
+ * DESCRIPTION:         builds the current text of a virtual file
+ * INPUTS:              inode -- the file's inode (see procfs_lookup)
+ *                      buf -- where to build it
+ *                      size -- size of buf
+ * RETURNS:             its length (cut off at size), -1 if it is gone
+ *                      (the task has exited)
+ */
+int32_t procfs_render(int32_t inode, int8_t* buf, uint32_t size){
+    proc_out_t out = { buf, 0, size };
+
+    if(inode == PROC_STAT_INODE){
+        render_stat(&out);
+    }
+    else{
+        if(inode < 0 || inode > MAX_PID || get_pcb(inode) == NULL) return -1;
+        render_task(&out, inode);
+    }
+    return out.len;
+}
+
+/* proc_open
+ * DESCRIPTION:         open handler for virtual files, does nothing
+ * INPUTS:              file -- pointer to file_t
+ * RETURN VALUE:        0
+ */
+int32_t proc_open(file_t* file){
+    return 0;
+}
+
+/* proc_read
+ * DESCRIPTION:         reads a virtual file from the file position on,
+ *                      freshly built each time
+ * INPUTS:              file -- pointer to file_t
+ *                      buf -- buffer to copy into
+ *                      n_bytes -- number of bytes to read
+ * RETURN VALUE:        number of bytes read (0 at the end, or once the task
+ *                      is gone), -1 on failure
+ * NOTES:               a file read in pieces may change between them, read
+ *                      it whole (PROC_BUF_SIZE) for a consistent copy
+ */
+int32_t proc_read(file_t* file, void* buf, int32_t n_bytes){
+    if(file == NULL || buf == NULL || n_bytes < 0) return -1;
+
+    int32_t len = procfs_render(file->inode, read_buf, PROC_BUF_SIZE);
+    if(len < 0 || file->fpos >= len) return 0;
+
+    int32_t count = min(n_bytes, len - file->fpos);
+    memcpy(buf, read_buf + file->fpos, count);
+    file->fpos += count;
+    return count;
+}
+
+/* proc_write
+ * DESCRIPTION:         does nothing, virtual files are read-only
+ * RETURN VALUE:        -1
+ */
+int32_t proc_write(file_t* file, const void* buf, int32_t n_bytes){
+    return -1;
+}
+
+/* proc_close
+ * DESCRIPTION:         close handler for virtual files, does nothing
+ * RETURN VALUE:        0
+ */
+int32_t proc_close(file_t* file){
+    return 0;
+}
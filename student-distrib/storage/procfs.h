@@ -0,0 +1,25 @@
+#ifndef _PROCFS_H
+#define _PROCFS_H
+
+#include "filesys.h"
+#include "../tasks/process.h"
+
+/* Virtual read-only files with kernel statistics, one "name value" pair
+ * per line: proc/stat for the whole system, proc/<pid> for a task. Their
+ * dentries have type DENTRY_TYPE_PROC and these inodes */
+#define PROC_STAT_INODE     (MAX_PID + 1)
+#define PROC_PREFIX         "proc/"
+#define PROC_PREFIX_LEN     5
+
+/* Longest file */
+#define PROC_BUF_SIZE       1024
+
+int32_t procfs_lookup(const int8_t* fname, dentry_t* dentry);
+int32_t procfs_render(int32_t inode, int8_t* buf, uint32_t size);
+
+int32_t proc_open(file_t* file);
+int32_t proc_read(file_t* file, void* buf, int32_t n_bytes);
+int32_t proc_write(file_t* file, const void* buf, int32_t n_bytes);
+int32_t proc_close(file_t* file);
+
+#endif /* _PROCFS_H */
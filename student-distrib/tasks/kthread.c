@@ -0,0 +1,127 @@
+#include "kthread.h"
+
+#include "../lib/lib.h"
+#include "../arch/smp.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/switch.h"
+
+/* kthread_start
+ * DESCRIPTION:         where a thread's first switch lands (see
+ *                      kthread_create), runs its function
+ * INPUTS:              fn -- the thread function
+ *                      data -- its argument
+ * RETURNS:             never
+ */
+static void kthread_start(void (*fn)(uint32_t data), uint32_t data){
+    // Switched to with interrupts disabled, like any context
+    sti();
+    fn(data);
+    kthread_exit();
+}
+
+/* kthread_create
+ * DESCRIPTION:         creates a kernel thread, which starts running fn
+ *                      once it is woken up with kthread_wake
+ * INPUTS:              fn -- the thread function, the thread ends when it
+ *                            returns
+ *                      data -- argument for fn
+ *                      name -- shown for the thread (copied)
+ * RETURNS:             the thread's PID, -1 if no PID is free
+ * NOTES:               the thread starts on the creating terminal, which
+ *                      its prints go to, and may run on any CPU
+ */
+pid_t kthread_create(void (*fn)(uint32_t data), uint32_t data, const char* name){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    pid_t pid = reserve_pid();
+    if(pid > MAX_PID){
+        restore_flags(flags);
+        return -1;
+    }
+
+    pcb_t* pcb = get_pcb(pid);
+    memset(pcb, 0, sizeof(pcb_t));
+    pcb->flags = TASK_EXECUTING | TASK_KTHREAD;
+    pcb->parent_pid = -1;
+    pcb->terminal = get_active_terminal();
+    pcb->cpu = cpu_id();
+    pcb->cpus_allowed = CPUS_ALL;
+    strncpy(pcb->args, name, TERMINAL_BUF_SIZE - 1);
+
+    // The first switch "returns" into kthread_start(fn, data)
+    uint32_t* stack = (uint32_t*)get_kernel_stack(pid);
+    *--stack = data;
+    *--stack = (uint32_t)fn;
+    *--stack = 0; // kthread_start never returns
+    pcb->kernel_esp = switch_frame(stack, (void (*)(void))kthread_start);
+
+    restore_flags(flags);
+    return pid;
+}
+
+/* kthread_bind
+ * DESCRIPTION:         restricts a thread to one CPU
+ * INPUTS:              pid -- the thread, not woken up yet
+ *                      cpu -- index of the CPU
+ * RETURNS:             0 on success, -1 if it isn't a kernel thread
+ */
+int kthread_bind(pid_t pid, uint32_t cpu){
+    if(!is_kthread(pid) || cpu >= MAX_CPUS) return -1;
+
+    pcb_t* pcb = get_pcb(pid);
+    pcb->cpu = cpu;
+    pcb->cpus_allowed = 1 << cpu;
+    return 0;
+}
+
+/* kthread_wake
+ * DESCRIPTION:         puts a thread on a run queue
+ * INPUTS:              pid -- the thread
+ * RETURNS:             0 on success, -1 if it isn't a kernel thread
+ */
+int kthread_wake(pid_t pid){
+    if(!is_kthread(pid)) return -1;
+
+    unsigned long flags;
+    cli_and_save(flags);
+    sched_enqueue(pid);
+    restore_flags(flags);
+    return 0;
+}
+
+/* kthread_run
+ * DESCRIPTION:         creates a kernel thread and makes it runnable
+ * INPUTS:              see kthread_create
+ * RETURNS:             the thread's PID, -1 on failure
+ */
+pid_t kthread_run(void (*fn)(uint32_t data), uint32_t data, const char* name){
+    pid_t pid = kthread_create(fn, data, name);
+    if(pid <= MAX_PID) kthread_wake(pid);
+    return pid;
+}
+
+/* kthread_exit
+ * DESCRIPTION:         ends the running kernel thread and frees its PID
+ * RETURNS:             never
+ */
+void kthread_exit(void){
+    cli();
+
+    pid_t pid = active_pid;
+    sched_dequeue(pid);
+    pause_task();
+    free_pid(pid);
+
+    active_pid = -1;
+    sched_exit(pid);
+}
+
+/* is_kthread
+ * RETURNS:             1 if the PID is a kernel thread, 0 otherwise
+ * INPUTS:              pid -- the PID
+ */
+int is_kthread(pid_t pid){
+    pcb_t* pcb = get_pcb(pid);
+    return pcb != NULL && (pcb->flags & TASK_KTHREAD) != 0;
+}
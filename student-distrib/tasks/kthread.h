@@ -0,0 +1,29 @@
+#ifndef _KTHREAD_H
+#define _KTHREAD_H
+
+#include "process.h"
+
+/* Kernel threads: tasks that only run kernel code, on their own kernel
+ * stack, with no user page or page directory. The scheduler runs them
+ * like any task. A thread holds the kernel lock while it runs, so it
+ * should sleep (wait queues, sleep_for) rather than spin */
+
+/* Creates a thread that will run fn(data), not yet runnable. The name is
+ * kept in the PCB's args. Returns the PID, -1 on failure */
+pid_t kthread_create(void (*fn)(uint32_t data), uint32_t data, const char* name);
+
+/* Keeps a thread that hasn't started on one CPU */
+int kthread_bind(pid_t pid, uint32_t cpu);
+
+/* Makes a created thread runnable */
+int kthread_wake(pid_t pid);
+
+/* kthread_create and kthread_wake */
+pid_t kthread_run(void (*fn)(uint32_t data), uint32_t data, const char* name);
+
+/* Ends the running thread (also what returning from fn does) */
+void kthread_exit(void);
+
+int is_kthread(pid_t pid);
+
+#endif /* _KTHREAD_H */
@@ -5,8 +5,13 @@
 #include "../lib/lib.h"
 #include "../memory/paging.h"
 #include "../arch/x86_desc.h"
+#include "../arch/smp.h"
 #include "../devices/keyboard.h"
 #include "../interrupts/i8259.h"
+#include "../interrupts/softirq.h"
+#include "../memory/slab.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/switch.h"
 
 // Terminal switching data structures
 static pid_t terminal_pid_head[NUM_TERMINALS] = {(unsigned)-1, (unsigned)-1, (unsigned)-1};
@@ -14,12 +19,13 @@ static pid_t terminal_pid_head[NUM_TERMINALS] = {(unsigned)-1, (unsigned)-1, (un
 // Bitmap of PIDs in use
 static uint32_t pid_map = 0;
 
+// PCBs of the PIDs in use, allocated from their own cache
+static kmem_cache_t* pcb_cache;
+static pcb_t* pcb_table[MAX_PID + 1];
+
 // Global counter of the number of executing tasks
 int num_tasks = 0;
 
-// Global tracker of currently active pid (initiallly invalid)
-pid_t active_pid = (unsigned)-1;
-
 // 2 basic fops tables
 static struct file_ops stdin_fops = {
     .read = terminal_read,
@@ -47,8 +53,6 @@ void init_pcb(pcb_t* pcb, pid_t pid, char args[TERMINAL_BUF_SIZE]){
     pcb_t* parent_pcb = get_pcb(active_pid);
 
     pcb->flags = TASK_EXECUTING;
-    pcb->context.esp = USER_STACK;
-    pcb->context.ebp = USER_STACK;
 
     pcb->files[STDIN].ops = &stdin_fops;
     pcb->files[STDIN].flags = FILE_IN_USE;
@@ -58,12 +62,22 @@ void init_pcb(pcb_t* pcb, pid_t pid, char args[TERMINAL_BUF_SIZE]){
     pcb->terminal = parent_pcb == NULL ? get_active_terminal() : parent_pcb->terminal;
     pcb->parent_pid = active_pid;
 
+    pcb->cpu = cpu_id();
+    pcb->cpus_allowed = parent_pcb == NULL ? CPUS_ALL : parent_pcb->cpus_allowed;
+
     /* Parsing the argument into the PCB */
     memcpy(pcb->args, args, strlen(args) + 1);
 }
 
+/* init_tasks
+ * DESCRIPTION:         creates the PCB cache, the slab allocator must be ready
+ */
+void init_tasks(){
+    pcb_cache = kmem_cache_create("pcb", sizeof(pcb_t));
+}
+
 /* reserve_pid
- * DESCRIPTION:         reserves a pid for a new task
+ * DESCRIPTION:         reserves a pid for a new task and allocates its PCB
  * RETURNS:             the newly reserved PID (0-based), or -1 on failure
  */
 pid_t reserve_pid(){
@@ -74,6 +88,13 @@ pid_t reserve_pid(){
         if(pid > MAX_PID) return (unsigned)-1;
     }
 
+    pcb_table[pid] = kmem_cache_alloc(pcb_cache);
+    if(pcb_table[pid] == NULL) return (unsigned)-1;
+
+    // Queued on the reserving CPU until init_pcb gives it an affinity
+    pcb_table[pid]->cpu = cpu_id();
+    pcb_table[pid]->cpus_allowed = 0;
+
     // Flag this PID as reserved
     pid_map |= (1 << pid);
     ++num_tasks;
@@ -82,7 +103,7 @@ pid_t reserve_pid(){
 }
 
 /* free_pid
- * DESCRIPTION:         marks the given pid as available
+ * DESCRIPTION:         marks the given pid as available and frees its PCB
  * INPUTS:              pid -- the pid to free (0-based)
  * RETURNS:             0 on success, -1 on failure
  */
@@ -92,6 +113,10 @@ int free_pid(pid_t pid){
     if(!(pid_map & (1 << pid))) return -1;
     --num_tasks;
 
+    fpu_release(pid);
+    kmem_cache_free(pcb_cache, pcb_table[pid]);
+    pcb_table[pid] = NULL;
+
     // Set as free
     pid_map &= ~(1 << pid);
     return 0;
@@ -107,12 +132,29 @@ int pid_in_use(pid_t pid){
 }
 
 /* get_pcb
- * RETURNS:             pointer to the pcb for the task with the given PID
+ * RETURNS:             pointer to the pcb for the task with the given PID,
+ *                      NULL if the PID isn't reserved
  * INPUTS:              pid -- the PID of the task
  */
 pcb_t* get_pcb(pid_t pid){
     if(pid > MAX_PID) return NULL;
-    return (pcb_t*)(USER_KTASK_BASE - (pid + 1)*USER_KTASK_OFFSET);
+    return pcb_table[pid];
+}
+
+/* reparent_children
+ * DESCRIPTION:         hands the children of a task that is going away to
+ *                      that task's parent, so no task is left pointing at a
+ *                      freed (or reused) PID
+ * INPUTS:              pid -- the task going away
+ *                      parent -- its parent, -1 if it has none
+ */
+void reparent_children(pid_t pid, pid_t parent){
+    pid_t child;
+    for(child = 0; child <= MAX_PID; child++){
+        if(pcb_table[child] != NULL && pcb_table[child]->parent_pid == pid){
+            pcb_table[child]->parent_pid = parent;
+        }
+    }
 }
 
 /* get_kernel_stack
@@ -127,12 +169,12 @@ uint32_t get_kernel_stack(pid_t pid){
 /* set_terminal_pid_head
  * DESCRIPTION:         sets which task is the most recent in the given terminal
  * INPUTS:              term -- the terminal
-                        pid -- the PID of the new task
+                        pid -- the PID of the new task, -1 for none
  * RETURNS:             0 on success, -1 on failure
  */
 int set_terminal_pid_head(uint32_t term, pid_t pid){
     if(term >= NUM_TERMINALS) return -1;
-    if(pid > MAX_PID) return -1;
+    if(pid > MAX_PID && pid != (pid_t)-1) return -1;
 
     terminal_pid_head[term] = pid;
     return 0;
@@ -148,60 +190,128 @@ pid_t get_terminal_pid_head(uint32_t term){
     return terminal_pid_head[term];
 }
 
-/* focus_terminal
- * DESCRIPTION:         sets the given terminal as active
- * INPUT:               terminal -- the terminal to activate
- *                      context -- the context of the current task to pause
- * NOTES:               called from interrupt context, must send keyboard EOI
+/* finish_task_stack
+ * DESCRIPTION:         completes the kernel stack of a task that hasn't run
+ *                      yet, so that switching to it unwinds an interrupt frame
+ * INPUTS:              pcb -- the new task
+ *                      stack -- top of an interrupt frame on the task's
+ *                               kernel stack (pushal registers, error code
+ *                               and iret frame)
  */
-void focus_terminal(uint32_t terminal, int_regs_t context){
-    if(terminal >= NUM_TERMINALS) return;
+void finish_task_stack(pcb_t* pcb, uint32_t* stack){
+    pcb->kernel_esp = switch_frame(stack, ret_from_intr);
+}
 
-    uint32_t prev_term = get_active_terminal();
-    if(terminal == prev_term) return;
+/* do_focus_terminal
+ * DESCRIPTION:         the focus tasklet: swaps the screen contents and
+ *                      has the CPU switch to the new terminal's task
+ * INPUTS:              terminal -- the terminal to activate
+ */
+static void do_focus_terminal(uint32_t terminal){
+    unsigned long flags;
+    cli_and_save(flags);
 
+    uint32_t prev_term = get_active_terminal();
     pid_t pid = get_terminal_pid_head(terminal);
-    if(pid > MAX_PID) return; // kernel.c should be setting up all initial shells
 
-    pause_task(context);
+    // kernel.c should be setting up all initial shells
+    if(terminal == prev_term || pid > MAX_PID){
+        restore_flags(flags);
+        return;
+    }
+
+    save_task_screen();
 
     // Save screen state of old terminal
     memcpy(VIDEO_PTR(prev_term), VIDEO_PTR(-1), VIDEO_SIZE);
 
     set_terminal(terminal); // Alert terminal driver
+    sync_user_video_mem(); // Repoint vidmap pages of both terminals
 
     // Restore screen state of new terminal
     memcpy(VIDEO_PTR(-1), VIDEO_PTR(terminal), VIDEO_SIZE);
     set_screen_pos(get_terminal_x(terminal), get_terminal_y(terminal));
 
-    send_eoi(KEYBOARD_IRQ);
-    if(-1 == resume_task(pid)){
-        printf("Task resumption failed for pid: %u\n", pid);
-    }
+    // Whatever this CPU was running prints to where its terminal is now
+    load_task_screen();
+    sched_request(pid);
+
+    restore_flags(flags);
+}
+
+static tasklet_t focus_tasklet = { NULL, 0, do_focus_terminal, 0 };
+
+/* focus_terminal
+ * DESCRIPTION:         sets the given terminal as active
+ * INPUT:               terminal -- the terminal to activate
+ * NOTES:               called from the keyboard interrupt, the screen copies
+ *                      and the switch to the terminal's task are left to a
+ *                      tasklet. Repeated requests before it runs keep the
+ *                      last terminal
+ */
+void focus_terminal(uint32_t terminal){
+    if(terminal >= NUM_TERMINALS) return;
+
+    focus_tasklet.data = terminal;
+    tasklet_schedule(&focus_tasklet);
 }
 
 /* pause_task
- * DESCRIPTION:         saves the current task's context
- *                      (assumes this is called from interrupt context)
- * INPUTS:              context -- the register context to save for resumption
+ * DESCRIPTION:         saves the running task's terminal position before
+ *                      switching away from it (the registers are saved by
+ *                      switch_to)
  */
-void pause_task(int_regs_t context){
+void pause_task(void){
+    save_task_screen();
+}
+
+/* save_task_screen
+ * DESCRIPTION:         saves the terminal position of the task running on
+ *                      this CPU, the print functions' position is shared
+ *                      by every CPU
+ */
+void save_task_screen(void){
+    // An idling scheduler has already saved the task (or it is gone)
+    if(sched_idling) return;
+
     pcb_t* pcb = get_pcb(active_pid);
-    pcb->context = context;
+    if(pcb == NULL) return;
 
     // Save terminal position
     set_terminal_pos(pcb->terminal, get_screen_x(), get_screen_y());
+}
+
+/* load_task_screen
+ * DESCRIPTION:         points the print functions at the terminal of the
+ *                      task running on this CPU (the screen if it is the
+ *                      visible one), at its position
+ */
+void load_task_screen(void){
+    if(sched_idling) return;
+
+    pcb_t* pcb = get_pcb(active_pid);
+    if(pcb == NULL) return;
 
-    delete_task_page();
-    if(pcb->flags & TASK_VID_IN_USE){
-        disable_user_video_mem();
+    // Make print calls write correctly
+    if(pcb->terminal == get_active_terminal()){
+        set_lib_video_mem(-1);
     }
+    else{
+        set_lib_video_mem(pcb->terminal);
+    }
+    set_screen_pos(get_terminal_x(pcb->terminal), get_terminal_y(pcb->terminal));
 }
 
 /* resume_task
- * DESCRIPTION:         resumes the task specified task
+ * DESCRIPTION:         switches to the specified task, saving the current
+ *                      context (task, idle context or a dead one) so that it
+ *                      continues from here when it is switched back to
  * INPUTS:              pid -- the task to resume
- * RETURNS:             -1 on failure (does not return on success)
+ * RETURNS:             -1 on failure, 0 once the caller is resumed (right
+ *                      away if the task is already running, here or on
+ *                      another CPU)
+ * NOTES:               called with interrupts disabled, after pause_task.
+ *                      The task moves to this CPU's run queue
  */
 int resume_task(pid_t pid){
     if(pid > MAX_PID) return -1;
@@ -210,39 +320,24 @@ int resume_task(pid_t pid){
     if(pcb == NULL) return -1;
     if(!(pcb->flags & TASK_EXECUTING)) return -1;
 
-    tss.esp0 = get_kernel_stack(pid);
-    setup_task_page(pid);
-    if(pcb->flags & TASK_VID_IN_USE){
-        setup_user_video_mem(pcb);
-    }
+    // Already running
+    if(sched_task_running(pid)) return 0;
 
-    // Make print calls write correctly
-    if(pcb->terminal == get_active_terminal()){
-        set_lib_video_mem(-1);
-    }
-    else{
-        set_lib_video_mem(pcb->terminal);
-    }
-    set_screen_pos(get_terminal_x(pcb->terminal), get_terminal_y(pcb->terminal));
+    uint32_t* prev_esp = sched_save_slot();
+    sched_account_switch();
+    fpu_switch_out();
+    fpu_switch(pid);
+    sched_claim(pid);
 
     active_pid = pid;
+    sched_leave_idle();
+    load_task_screen();
+
+    // Kernel threads have no page directory. On one CPU they keep the last
+    // one, on more the kernel's, like the idle context
+    uint32_t cr3 = pcb->page_dir;
+    if(cr3 == 0 && smp_num_cpus() > 1) cr3 = get_kernel_page_dir();
 
-    // Setup context on stack (See Intel manual figure 5-4)
-    asm volatile(
-        /*
-            PCB context stores ESP from just after error code.
-            We will move to that stack but with room for the pushed state,
-            and then do the same as in "ret_from_intr" (interrupt_link.S)
-        */
-        "movl %0, %%esp;"
-        "subl $32, %%esp;"
-        "popal;"
-        "addl $4, %%esp;" // pop error code
-        "iret;"
-        : /* no outputs */
-        : "r"(pcb->context.esp)
-        : "cc", "memory"
-    );
-
-    return -1; // Should never reach here
+    switch_to(prev_esp, pcb->kernel_esp, cr3, get_kernel_stack(pid));
+    return 0;
 }
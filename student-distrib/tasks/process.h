@@ -4,8 +4,12 @@
 #include "../storage/filesys.h"
 #include "../devices/terminal.h"
 #include "../interrupts/interrupts.h"
+#include "../arch/fpu.h"
+#include "../arch/cpu.h"
 
 #define MAX_FILES 8
+#define MAX_MMAPS 8
+#define MAX_SHM_ATTACH 8
 #define STDIN 0
 #define STDOUT 1
 
@@ -13,11 +17,29 @@
 #define TASK_VID_IN_USE 1
 #define TASK_EXECUTING 2
 #define TASK_WAITING_FOR_CHILD 4
+#define TASK_FORKED 8 // Not started by execute, nobody waits on it
+#define TASK_USED_FPU 16 // fpu holds saved FPU state
+#define TASK_KTHREAD 32 // Kernel thread, no user page (see kthread.c)
 
 // Max PID is 31 because a 32-bit bitmap is used
 #define MAX_PID 31
 typedef uint32_t pid_t;
 
+// Affinity mask allowing every CPU
+#define CPUS_ALL ((1 << MAX_CPUS) - 1)
+
+// A file mapped into the mmap window (len 0 when unused)
+typedef struct {
+    uint32_t start;
+    uint32_t len;
+} mmap_area_t;
+
+// An attached shared memory segment (start 0 when unused)
+typedef struct {
+    uint32_t start;
+    int32_t id;
+} shm_attach_t;
+
 typedef struct pcb_struct{
     file_t files[MAX_FILES];
     char args[TERMINAL_BUF_SIZE]; // Buffer to hold the arguments
@@ -26,27 +48,73 @@ typedef struct pcb_struct{
     pid_t parent_pid;
 
     uint32_t terminal;
-    int_regs_t context;
+    uint32_t kernel_esp; // Saved by switch_to while the task isn't running
+    int32_t child_status; // Halt status of the child execute waits on
+
+    uint32_t page_dir; // Physical address of the task's page directory
+
+    // Executable backing the user image, paged in on demand
+    int32_t exe_inode;
+    uint32_t image_file_end; // End of the file contents in user memory
+    uint32_t image_end; // End of the image including BSS
+    uint32_t text_start; // Page aligned read-only text, mapped in place
+    uint32_t text_end;
+
+    // Heap above the image, grown with brk/sbrk
+    uint32_t heap_start;
+    uint32_t brk;
+
+    mmap_area_t mmaps[MAX_MMAPS];
+    shm_attach_t shms[MAX_SHM_ATTACH];
+
+    // Page fault counters
+    uint32_t min_flt; // Resolved without touching the filesystem
+    uint32_t maj_flt; // Read in from the filesystem image
+
+    // CPU time in ticks, in user and kernel mode (see sched_account_tick)
+    uint32_t utime;
+    uint32_t stime;
+
+    // Switches away from the task: it blocked or yielded (voluntary), or
+    // was preempted (involuntary)
+    uint32_t nvcsw;
+    uint32_t nivcsw;
+
+    uint32_t nsyscalls;
+
+    // x87/SSE registers while another task owns the FPU (see fpu.c)
+    fpu_state_t fpu;
+
+    // CPU whose run queue the task is on (or last ran on), and the CPUs it
+    // may run on (bit n for CPU n), see scheduler.c
+    uint32_t cpu;
+    uint32_t cpus_allowed;
 } pcb_t;
 
 // Global counter of the number of executing tasks
 extern int num_tasks;
 
-// Global variable for current process' PID
-extern pid_t active_pid;
+// PID of the task running on this CPU
+#define active_pid (this_cpu()->current_pid)
 
 
+void init_tasks();
 void init_pcb(pcb_t* pcb, pid_t pid, char args[TERMINAL_BUF_SIZE]);
 pid_t reserve_pid();
 int free_pid(pid_t pid);
 int pid_in_use(pid_t pid);
 pcb_t* get_pcb(pid_t pid);
+void reparent_children(pid_t pid, pid_t parent);
 uint32_t get_kernel_stack(pid_t pid);
 
-void focus_terminal(uint32_t terminal, int_regs_t context);
+void finish_task_stack(pcb_t* pcb, uint32_t* stack);
+
+void focus_terminal(uint32_t terminal);
 int set_terminal_pid_head(uint32_t term, pid_t pid);
 pid_t get_terminal_pid_head(uint32_t term);
-void pause_task(int_regs_t context);
+void pause_task(void);
+void save_task_screen(void);
+void load_task_screen(void);
 int resume_task(pid_t pid);
 
 #endif /* _PROCESS_H */
@@ -0,0 +1,146 @@
+#include "workqueue.h"
+#include "kthread.h"
+
+#include "../lib/lib.h"
+#include "../scheduler/scheduler.h"
+
+workqueue_t system_wq;
+
+/* init_work
+ * DESCRIPTION:         sets up a work item that isn't queued
+ * INPUTS:              work -- the work item
+ *                      fn -- what it runs, called with data
+ *                      data -- argument for fn
+ */
+void init_work(work_t* work, void (*fn)(uint32_t data), uint32_t data){
+    work->next = NULL;
+    work->pending = 0;
+    work->fn = fn;
+    work->data = data;
+}
+
+/* worker_thread
+ * DESCRIPTION:         body of a workqueue's kernel thread: sleeps until
+ *                      work is queued, then runs all of it
+ * INPUTS:              data -- the workqueue
+ * RETURNS:             never
+ */
+static void worker_thread(uint32_t data){
+    workqueue_t* wq = (workqueue_t*)data;
+    unsigned long flags;
+
+    while(1){
+        cli_and_save(flags);
+        while(wq->head == NULL){
+            prepare_to_wait(&wq->more_work);
+            if(wq->head == NULL) schedule();
+            finish_wait(&wq->more_work);
+        }
+
+        // Take the whole list, work queued from here on is the next batch
+        work_t* list = wq->head;
+        wq->head = NULL;
+        wq->tail = &wq->head;
+        wq->batches++;
+        restore_flags(flags);
+
+        while(list != NULL){
+            cli_and_save(flags);
+            work_t* work = list;
+            list = work->next;
+            work->pending = 0; // It may be queued again from here on
+            restore_flags(flags);
+
+            work->fn(work->data);
+            wq->run++;
+        }
+
+        wake_up(&wq->done_wait);
+    }
+}
+
+/* init_workqueue
+ * DESCRIPTION:         sets up a workqueue and starts its worker thread
+ * INPUTS:              wq -- the workqueue
+ *                      name -- the worker thread's name
+ * RETURNS:             0 on success, -1 if the thread couldn't be created
+ * NOTES:               workqueues are never torn down, the worker keeps a
+ *                      pointer to wq
+ */
+int init_workqueue(workqueue_t* wq, const char* name){
+    wq->head = NULL;
+    wq->tail = &wq->head;
+    init_wait_queue(&wq->more_work);
+    init_wait_queue(&wq->done_wait);
+    wq->queued = 0;
+    wq->run = 0;
+    wq->batches = 0;
+
+    wq->worker = kthread_run(worker_thread, (uint32_t)wq, name);
+    return wq->worker > MAX_PID ? -1 : 0;
+}
+
+/* init_workqueues
+ * DESCRIPTION:         starts system_wq
+ * RETURNS:             0 on success, -1 on failure
+ * NOTES:               PID 0's kernel stack is the boot stack, so the
+ *                      caller must hold PID 0 while the boot code runs
+ */
+int init_workqueues(void){
+    return init_workqueue(&system_wq, "kworker");
+}
+
+/* queue_work
+ * DESCRIPTION:         adds work to the end of a workqueue and wakes up
+ *                      its worker
+ * INPUTS:              wq -- the workqueue
+ *                      work -- the work item
+ * RETURNS:             1 if it was queued, 0 if it already was
+ */
+int queue_work(workqueue_t* wq, work_t* work){
+    unsigned long flags;
+    cli_and_save(flags);
+
+    if(work->pending){
+        restore_flags(flags);
+        return 0;
+    }
+
+    work->pending = 1;
+    work->next = NULL;
+    *wq->tail = work;
+    wq->tail = &work->next;
+    wq->queued++;
+    wake_up(&wq->more_work);
+
+    restore_flags(flags);
+    return 1;
+}
+
+/* schedule_work
+ * DESCRIPTION:         queues work on system_wq
+ * INPUTS:              work -- the work item
+ * RETURNS:             1 if it was queued, 0 if it already was
+ */
+int schedule_work(work_t* work){
+    return queue_work(&system_wq, work);
+}
+
+/* flush_workqueue
+ * DESCRIPTION:         sleeps until the work queued on a workqueue before
+ *                      the call has run
+ * INPUTS:              wq -- the workqueue
+ * RETURNS:             0 once it has, -1 when called outside of a task or
+ *                      from the worker itself (which would wait forever)
+ */
+int flush_workqueue(workqueue_t* wq){
+    if(active_pid > MAX_PID || active_pid == wq->worker) return -1;
+
+    uint32_t target = wq->queued;
+    while((int32_t)(wq->run - target) < 0){
+        prepare_to_wait(&wq->done_wait);
+        if((int32_t)(wq->run - target) < 0) schedule();
+        finish_wait(&wq->done_wait);
+    }
+    return 0;
+}
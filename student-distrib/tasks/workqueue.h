@@ -0,0 +1,48 @@
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include "../lib/types.h"
+#include "../scheduler/wait.h"
+#include "process.h"
+
+/* Work deferred to a kernel thread. Unlike a tasklet, a work function runs
+ * in a task, so it may sleep. Queueing work that is already queued does
+ * nothing, and the worker runs everything queued since it last woke up in
+ * one batch */
+typedef struct work {
+    struct work* next;
+    volatile uint32_t pending;  // Queued and not yet started
+    void (*fn)(uint32_t data);
+    uint32_t data;
+} work_t;
+
+typedef struct {
+    work_t* head;
+    work_t** tail;
+    pid_t worker;               // The kernel thread running the work
+
+    wait_queue_t more_work;     // The worker, while the queue is empty
+    wait_queue_t done_wait;     // flush_workqueue callers
+
+    // Work queued and run so far (flush_workqueue waits for run to catch
+    // up), and how many batches it took
+    volatile uint32_t queued;
+    volatile uint32_t run;
+    uint32_t batches;
+} workqueue_t;
+
+/* Shared queue for work that doesn't need its own thread */
+extern workqueue_t system_wq;
+
+void init_work(work_t* work, void (*fn)(uint32_t data), uint32_t data);
+int init_workqueue(workqueue_t* wq, const char* name);
+int init_workqueues(void);
+
+/* Safe from interrupt context. 1 if queued, 0 if it already was */
+int queue_work(workqueue_t* wq, work_t* work);
+int schedule_work(work_t* work);
+
+/* Waits until the work queued before the call has run */
+int flush_workqueue(workqueue_t* wq);
+
+#endif /* _WORKQUEUE_H */
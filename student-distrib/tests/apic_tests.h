@@ -0,0 +1,6 @@
+#ifndef _APIC_TESTS_H
+#define _APIC_TESTS_H
+
+int apic_timer_test();
+
+#endif /* _APIC_TESTS_H */
@@ -238,7 +238,7 @@ int read_dir_test(){
 	TEST_HEADER();
 
 	int counter = 0;
-	#define EXPECTED_COUNT 17
+	#define EXPECTED_COUNT 18
 
 	char* filename = ".";
 	dentry_t dentry_name;
@@ -0,0 +1,67 @@
+#include "fpu_tests.h"
+#include "tests.h"
+
+#include "../arch/fpu.h"
+#include "../tasks/process.h"
+#include "../lib/lib.h"
+
+/* FPU switch test
+ *
+ * Pretends to switch between two tasks that each keep a value on the x87
+ * stack, letting the Device Not Available trap swap their FPU state
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PIDs are released)
+ * Coverage: fpu_switch, do_fpu_trap, lazy save/restore
+ * Files: fpu.h/c, interrupts.c
+ */
+int fpu_switch_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	int32_t a_in = 391, b_in = -1234;
+	int32_t a_out = 0, b_out = 0;
+
+	pid_t a = reserve_pid();
+	pid_t b = reserve_pid();
+	if(a > MAX_PID || b > MAX_PID){
+		printf("Couldn't reserve PIDs\n");
+		free_pid(a);
+		free_pid(b);
+		return FAIL;
+	}
+	get_pcb(a)->flags = TASK_EXECUTING;
+	get_pcb(b)->flags = TASK_EXECUTING;
+
+	// Each first use traps and gets a clean FPU
+	active_pid = a;
+	fpu_switch(a);
+	asm volatile ("fildl %0" : : "m"(a_in));
+
+	active_pid = b;
+	fpu_switch(b);
+	asm volatile ("fildl %0" : : "m"(b_in));
+
+	// Switching back must bring each task's own x87 stack back
+	active_pid = a;
+	fpu_switch(a);
+	asm volatile ("fistpl %0" : "=m"(a_out));
+
+	active_pid = b;
+	fpu_switch(b);
+	asm volatile ("fistpl %0" : "=m"(b_out));
+
+	if(a_out != a_in || b_out != b_in){
+		printf("FPU state mixed up: got %d and %d\n", a_out, b_out);
+		result = FAIL;
+	}
+	if(!(get_pcb(a)->flags & TASK_USED_FPU) || !(get_pcb(b)->flags & TASK_USED_FPU)){
+		printf("FPU use wasn't recorded\n");
+		result = FAIL;
+	}
+
+	free_pid(a);
+	free_pid(b);
+	active_pid = -1;
+	return result;
+}
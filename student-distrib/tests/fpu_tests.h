@@ -0,0 +1,6 @@
+#ifndef _FPU_TESTS_H
+#define _FPU_TESTS_H
+
+int fpu_switch_test();
+
+#endif /* _FPU_TESTS_H */
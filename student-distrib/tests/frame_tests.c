@@ -0,0 +1,165 @@
+#include "frame_tests.h"
+#include "tests.h"
+
+#include "../memory/frame.h"
+#include "../lib/lib.h"
+
+/* Frame allocation test
+ *
+ * Allocates frames of several orders and checks their alignment
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (all frames are freed)
+ * Coverage: Buddy frame allocator
+ * Files: frame.h/c
+ */
+int frame_alloc_test(){
+	TEST_HEADER();
+
+	uint32_t single = alloc_frame();
+	if(single == 0){
+		printf("alloc_frame failed\n");
+		return FAIL;
+	}
+	if(single < FRAME_MEM_START || single >= FRAME_MEM_END || (single & (FRAME_SIZE - 1))){
+		printf("alloc_frame returned bad address 0x%#x\n", single);
+		return FAIL;
+	}
+
+	// Frames are direct-mapped, so they must be writable
+	*(uint32_t*)single = 391;
+	if(*(uint32_t*)single != 391){
+		printf("Frame 0x%#x is not direct-mapped\n", single);
+		return FAIL;
+	}
+
+	uint32_t order;
+	for(order = 1; order <= FRAME_MAX_ORDER; order++){
+		uint32_t block = alloc_frames(order);
+		if(block == 0){
+			printf("alloc_frames(%u) failed\n", order);
+			free_frame(single);
+			return FAIL;
+		}
+		if(block & ((FRAME_SIZE << order) - 1)){
+			printf("alloc_frames(%u) returned misaligned 0x%#x\n", order, block);
+			free_frames(block, order);
+			free_frame(single);
+			return FAIL;
+		}
+		free_frames(block, order);
+	}
+
+	free_frame(single);
+	return PASS;
+}
+
+/* Frame coalesce test
+ *
+ * Splits a 4MB run into single frames and checks that freeing them
+ * merges the buddies back together
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (all frames are freed)
+ * Coverage: Buddy frame allocator
+ * Files: frame.h/c
+ */
+int frame_coalesce_test(){
+	TEST_HEADER();
+
+	#define NUM_TEST_FRAMES 16
+	uint32_t frames[NUM_TEST_FRAMES];
+	uint32_t free_before = num_free_frames();
+	int i;
+
+	for(i = 0; i < NUM_TEST_FRAMES; i++){
+		frames[i] = alloc_frame();
+		if(frames[i] == 0){
+			printf("alloc_frame failed on frame %d\n", i);
+			return FAIL;
+		}
+	}
+
+	if(num_free_frames() != free_before - NUM_TEST_FRAMES){
+		printf("Free count did not drop by %d\n", NUM_TEST_FRAMES);
+		return FAIL;
+	}
+
+	// Free in reverse so that every merge happens late
+	for(i = NUM_TEST_FRAMES - 1; i >= 0; i--){
+		free_frame(frames[i]);
+	}
+
+	if(num_free_frames() != free_before){
+		printf("Expected %u free frames but got %u\n", free_before, num_free_frames());
+		return FAIL;
+	}
+
+	// The largest blocks should be whole again
+	uint32_t run = alloc_frames(FRAME_4MB_ORDER);
+	if(run == 0){
+		printf("Could not allocate a 4MB run after freeing\n");
+		return FAIL;
+	}
+	free_frames(run, FRAME_4MB_ORDER);
+
+	#undef NUM_TEST_FRAMES
+	return PASS;
+}
+
+/* Zero pool test
+ *
+ * Dirties a frame, frees it, and checks that frames handed out by
+ * alloc_zeroed_frame are zeroed whether or not the pool has any left
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (all frames are freed)
+ * Coverage: Zeroed frame pool
+ * Files: frame.h/c
+ */
+int zero_pool_test(){
+	TEST_HEADER();
+
+	uint32_t frame, i;
+	int result = PASS;
+
+	// Leave some garbage behind in the allocator
+	frame = alloc_frame();
+	if(frame == 0){
+		printf("alloc_frame failed\n");
+		return FAIL;
+	}
+	memset((void*)frame, 0xAB, FRAME_SIZE);
+	free_frame(frame);
+
+	refill_zero_pool(ZERO_POOL_SIZE);
+	if(num_zeroed_frames() != ZERO_POOL_SIZE){
+		printf("Pool holds %u frames after a refill\n", num_zeroed_frames());
+		result = FAIL;
+	}
+
+	// Drain the pool and take one more, which must be zeroed on the spot
+	static uint32_t frames[ZERO_POOL_SIZE + 1];
+	for(i = 0; i <= ZERO_POOL_SIZE; i++){
+		frames[i] = alloc_zeroed_frame();
+		uint32_t* words = (uint32_t*)frames[i];
+		uint32_t w;
+		for(w = 0; frames[i] != 0 && w < FRAME_SIZE / 4; w++){
+			if(words[w] != 0){
+				printf("Frame 0x%#x is not zeroed\n", frames[i]);
+				result = FAIL;
+				break;
+			}
+		}
+	}
+	if(num_zeroed_frames() != 0){
+		printf("Pool was not drained\n");
+		result = FAIL;
+	}
+
+	for(i = 0; i <= ZERO_POOL_SIZE; i++){
+		free_frame(frames[i]);
+	}
+	refill_zero_pool(ZERO_POOL_SIZE);
+	return result;
+}
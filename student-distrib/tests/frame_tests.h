@@ -0,0 +1,8 @@
+#ifndef _FRAME_TESTS_H
+#define _FRAME_TESTS_H
+
+int frame_alloc_test();
+int frame_coalesce_test();
+int zero_pool_test();
+
+#endif /* _FRAME_TESTS_H */
@@ -0,0 +1,189 @@
+#include "kthread_tests.h"
+#include "tests.h"
+
+#include "../lib/lib.h"
+#include "../arch/cpu.h"
+#include "../scheduler/scheduler.h"
+#include "../scheduler/switch.h"
+#include "../tasks/kthread.h"
+#include "../tasks/workqueue.h"
+
+#define WORK_TEST_COUNT 3
+
+static uint32_t kthread_test_esp;
+static uint32_t kthread_done_esp;
+
+static volatile uint32_t kthread_arg;
+static volatile uint32_t works_run;
+static uint32_t work_order[WORK_TEST_COUNT];
+
+/* back_to_test
+ * DESCRIPTION:         test thread body, notes its argument and switches
+ *                      back to the test
+ */
+static void back_to_test(uint32_t data){
+	kthread_arg = data;
+	switch_to(&kthread_done_esp, kthread_test_esp, 0, 0);
+}
+
+/* wait_for_works
+ * DESCRIPTION:         test thread body, yields until every test work item
+ *                      ran, then switches back to the test
+ */
+static void wait_for_works(uint32_t data){
+	while(works_run < WORK_TEST_COUNT){
+		schedule();
+	}
+	switch_to(&kthread_done_esp, kthread_test_esp, 0, 0);
+}
+
+/* record_work
+ * DESCRIPTION:         test work function, notes the order work ran in
+ */
+static void record_work(uint32_t data){
+	if(works_run < WORK_TEST_COUNT) work_order[works_run] = data;
+	works_run++;
+}
+
+/* hold_boot_stack
+ * DESCRIPTION:         the tests run on the boot stack, which is PID 0's
+ *                      kernel stack, so a thread must not get PID 0
+ * RETURNS:             a PID to free afterwards, -1 if none was needed
+ */
+static pid_t hold_boot_stack(void){
+	return pid_in_use(0) ? (unsigned)-1 : reserve_pid();
+}
+
+/* Kernel thread creation test
+ *
+ * Creates a kernel thread, checks its PCB, then switches to it once and
+ * checks that it ran its function with its argument
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PIDs are released)
+ * Coverage: kthread_create, kthread_bind, kthread_wake
+ * Files: kthread.h/c
+ */
+int kthread_create_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	unsigned long flags;
+	pid_t hold = hold_boot_stack();
+
+	pid_t pid = kthread_create(back_to_test, 0x391, "test thread");
+	if(pid > MAX_PID){
+		printf("Couldn't create a kernel thread\n");
+		free_pid(hold);
+		return FAIL;
+	}
+
+	pcb_t* pcb = get_pcb(pid);
+	if(!is_kthread(pid) || pcb->page_dir != 0 || strncmp(pcb->args, "test thread", 12) != 0){
+		printf("Kernel thread PCB is wrong\n");
+		result = FAIL;
+	}
+	if(sched_nr_ready_cpu(pcb->cpu) != 0 || kthread_bind(pid, cpu_id()) != 0 || kthread_wake(pid) != 0){
+		printf("Couldn't bind and wake the thread\n");
+		result = FAIL;
+	}
+	if(sched_nr_ready_cpu(cpu_id()) != 1){
+		printf("Woken thread isn't on this CPU's run queue\n");
+		result = FAIL;
+	}
+
+	cli_and_save(flags);
+	active_pid = pid;
+	switch_to(&kthread_test_esp, pcb->kernel_esp, 0, 0);
+	active_pid = -1;
+	restore_flags(flags);
+
+	if(kthread_arg != 0x391){
+		printf("Thread ran with 0x%x instead of 0x391\n", kthread_arg);
+		result = FAIL;
+	}
+
+	sched_dequeue(pid);
+	free_pid(pid);
+	free_pid(hold);
+	return result;
+}
+
+/* Workqueue test
+ *
+ * Queues work (one item twice) on a new workqueue, then lets its worker
+ * run, with a second thread that switches back to the test once the work
+ * is done
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PIDs are released)
+ * Coverage: init_workqueue, queue_work, worker thread
+ * Files: workqueue.h/c, kthread.h/c
+ */
+int workqueue_test(){
+	TEST_HEADER();
+
+	static workqueue_t wq;
+	work_t works[WORK_TEST_COUNT];
+	int result = PASS;
+	unsigned long flags;
+	uint32_t i;
+	pid_t hold = hold_boot_stack();
+
+	cli_and_save(flags);
+	works_run = 0;
+
+	// Both threads only run here, on this CPU
+	pid_t waiter = kthread_create(wait_for_works, 0, "test waiter");
+	if(waiter > MAX_PID || init_workqueue(&wq, "test worker") != 0){
+		printf("Couldn't create the threads\n");
+		if(waiter <= MAX_PID) free_pid(waiter);
+		free_pid(hold);
+		restore_flags(flags);
+		return FAIL;
+	}
+	sched_dequeue(wq.worker);
+	kthread_bind(wq.worker, cpu_id());
+	kthread_bind(waiter, cpu_id());
+	kthread_wake(wq.worker);
+	kthread_wake(waiter);
+
+	for(i = 0; i < WORK_TEST_COUNT; i++){
+		init_work(&works[i], record_work, i);
+		if(queue_work(&wq, &works[i]) != 1){
+			printf("Work %u wasn't queued\n", i);
+			result = FAIL;
+		}
+	}
+	if(queue_work(&wq, &works[0]) != 0){
+		printf("Pending work was queued twice\n");
+		result = FAIL;
+	}
+
+	active_pid = wq.worker;
+	switch_to(&kthread_test_esp, get_pcb(wq.worker)->kernel_esp, 0, 0);
+	active_pid = -1;
+
+	if(works_run != WORK_TEST_COUNT || wq.run != WORK_TEST_COUNT){
+		printf("%u work items ran (expected %u)\n", works_run, WORK_TEST_COUNT);
+		result = FAIL;
+	}
+	for(i = 0; i < WORK_TEST_COUNT && i < works_run; i++){
+		if(work_order[i] != i){
+			printf("Work %u ran in place %u\n", work_order[i], i);
+			result = FAIL;
+		}
+	}
+	if(wq.batches != 1){
+		printf("Work ran in %u batches (expected 1)\n", wq.batches);
+		result = FAIL;
+	}
+
+	sched_dequeue(wq.worker);
+	sched_dequeue(waiter);
+	free_pid(wq.worker);
+	free_pid(waiter);
+	free_pid(hold);
+	restore_flags(flags);
+	return result;
+}
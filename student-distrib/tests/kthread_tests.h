@@ -0,0 +1,7 @@
+#ifndef _KTHREAD_TESTS_H
+#define _KTHREAD_TESTS_H
+
+int kthread_create_test();
+int workqueue_test();
+
+#endif /* _KTHREAD_TESTS_H */
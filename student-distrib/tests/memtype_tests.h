@@ -0,0 +1,6 @@
+#ifndef _MEMTYPE_TESTS_H
+#define _MEMTYPE_TESTS_H
+
+int memtype_bench();
+
+#endif /* _MEMTYPE_TESTS_H */
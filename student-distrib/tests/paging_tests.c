@@ -2,6 +2,11 @@
 #include "tests.h"
 
 #include "../lib/lib.h"
+#include "../memory/paging.h"
+#include "../memory/tlb.h"
+#include "../memory/frame.h"
+#include "../memory/shm.h"
+#include "../memory/slab.h"
 
 /* deref
  * Inputs: a - pointer to int
@@ -20,6 +25,39 @@ void write(int32_t * addr, int32_t val) {
     *addr = val;
 }
 
+/* create_fake_tasks
+ * DESCRIPTION: gives fake tasks empty PCBs and their own address spaces
+ * INPUTS: pcbs -- the tasks
+ *         num -- how many
+ *         map -- 1 to also map each one's first user page
+ * RETURNS: 0 on success, -1 (with nothing left allocated) on failure
+ */
+static int create_fake_tasks(pcb_t* pcbs, int num, int map) {
+	int i;
+	memset(pcbs, 0, num*sizeof(pcb_t));
+
+	for(i = 0; i < num; i++){
+		if(create_task_page(&pcbs[i]) || (map && map_task_page(&pcbs[i], USER_LOAD_ADDR))){
+			printf("Could not create address spaces\n");
+			while(i >= 0) free_task_page(&pcbs[i--]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* free_fake_tasks
+ * DESCRIPTION: switches back to the kernel's page directory and frees the
+ *              fake tasks' address spaces
+ * INPUTS: pcbs -- the tasks
+ *         num -- how many
+ */
+static void free_fake_tasks(pcb_t* pcbs, int num) {
+	int i;
+	delete_task_page();
+	for(i = 0; i < num; i++) free_task_page(&pcbs[i]);
+}
+
 /* Invalid Dereferencing Tests
  *
  * Tests dereferencing invalid address and locations that are not accessible
@@ -109,3 +147,483 @@ int valid_write_test(){
 
 	return PASS;
 }
+
+/* Context switch benchmark
+ *
+ * Compares the cost of switching user address spaces the old way
+ * (unmap and remap the user PDE of one shared directory, flushing the
+ * TLB each time) with loading a per-process page directory into CR3
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints cycles per switch for both methods
+ * Coverage: Per-process page directories, global kernel pages
+ * Files: paging.h/c, pagingassembly.S
+ */
+int context_switch_bench(){
+	TEST_HEADER();
+
+	#define SWITCH_ITERATIONS 10000
+	pcb_t tasks[2];
+	if(create_fake_tasks(tasks, 2, 1)) return FAIL;
+
+	PDE_t* shared = (PDE_t*)tasks[0].page_dir;
+	PDE_t pde_a = shared[USER_PDE];
+	PDE_t pde_b = ((PDE_t*)tasks[1].page_dir)[USER_PDE];
+	volatile uint32_t* user = (uint32_t*)USER_LOAD_ADDR;
+	uint64_t start;
+	uint32_t shared_cycles, cr3_cycles;
+	int i;
+
+	// Before: pause_task unmapped the user PDE, resume_task remapped it
+	load_cr3(tasks[0].page_dir);
+	start = rdtsc();
+	for(i = 0; i < SWITCH_ITERATIONS; i++){
+		shared[USER_PDE].p = 0;
+		flush_tlb();
+		shared[USER_PDE] = (i & 1) ? pde_b : pde_a;
+		flush_tlb();
+		*user += 1;
+	}
+	shared_cycles = (uint32_t)(rdtsc() - start);
+	shared[USER_PDE] = pde_a;
+
+	// After: a single CR3 load per switch
+	start = rdtsc();
+	for(i = 0; i < SWITCH_ITERATIONS; i++){
+		load_cr3(tasks[i & 1].page_dir);
+		*user += 1;
+	}
+	cr3_cycles = (uint32_t)(rdtsc() - start);
+
+	free_fake_tasks(tasks, 2);
+
+	printf("Address space switch: shared PDE %u cycles, CR3 load %u cycles\n",
+		shared_cycles / SWITCH_ITERATIONS, cr3_cycles / SWITCH_ITERATIONS);
+
+	#undef SWITCH_ITERATIONS
+	return PASS;
+}
+
+/* TLB flush test
+ *
+ * Remaps a user page onto another frame and checks that a targeted
+ * invalidation (single page and batched) makes the new frame visible
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: INVLPG-based TLB management
+ * Files: tlb.h/c, pagingassembly.S
+ */
+int tlb_flush_test(){
+	TEST_HEADER();
+
+	pcb_t pcb;
+	if(create_fake_tasks(&pcb, 1, 1)) return FAIL;
+	if(map_task_page(&pcb, USER_LOAD_ADDR + FRAME_SIZE)){
+		printf("Could not map a second page\n");
+		free_fake_tasks(&pcb, 1);
+		return FAIL;
+	}
+
+	PTE_t* first = get_task_pte(&pcb, USER_LOAD_ADDR, 0);
+	PTE_t* second = get_task_pte(&pcb, USER_LOAD_ADDR + FRAME_SIZE, 0);
+	volatile uint32_t* user = (uint32_t*)USER_LOAD_ADDR;
+	int result = PASS;
+
+	load_cr3(pcb.page_dir);
+	*(uint32_t*)(second->base << 12) = 391;
+	*user = 0;
+
+	// Point the first page at the second frame
+	uint32_t old_base = first->base;
+	first->base = second->base;
+	tlb_flush_page(USER_LOAD_ADDR);
+	if(*user != 391){
+		printf("tlb_flush_page left a stale translation\n");
+		result = FAIL;
+	}
+
+	// And back again through a batch
+	tlb_batch_t batch;
+	tlb_batch_init(&batch);
+	first->base = old_base;
+	tlb_batch_add(&batch, USER_LOAD_ADDR);
+	tlb_batch_flush(&batch);
+	if(*user != 0){
+		printf("tlb_batch_flush left a stale translation\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(&pcb, 1);
+	return result;
+}
+
+/* Demand paging test
+ *
+ * Backs a fake task with an executable and pages in its first page,
+ * a BSS page and a stack page without any eager loading
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: demand_page, fault counters
+ * Files: paging.h/c
+ */
+int demand_paging_test(){
+	TEST_HEADER();
+
+	dentry_t dentry;
+	if(read_dentry_by_name("ls", &dentry) != 0){
+		printf("Could not find ls\n");
+		return FAIL;
+	}
+
+	pcb_t pcb;
+	if(create_fake_tasks(&pcb, 1, 0)) return FAIL;
+	pcb.exe_inode = dentry.inode;
+	pcb.image_file_end = USER_LOAD_ADDR + inode_at(dentry.inode)->size;
+	pcb.image_end = pcb.image_file_end + FRAME_SIZE;
+
+	#define CHECK_LEN 256
+	uint8_t expected[CHECK_LEN];
+	uint32_t bss = (pcb.image_file_end + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+	int result = PASS;
+
+	read_data(dentry.inode, 0, expected, CHECK_LEN);
+	load_cr3(pcb.page_dir);
+
+	if(demand_page(&pcb, USER_LOAD_ADDR + 4) != FAULT_MAJOR
+	|| strncmp((int8_t*)USER_LOAD_ADDR, (int8_t*)expected, CHECK_LEN) != 0){
+		printf("First page of the image was not read in\n");
+		result = FAIL;
+	}
+	if(demand_page(&pcb, bss) != FAULT_MINOR || *(uint32_t*)bss != 0){
+		printf("BSS page was not zero filled\n");
+		result = FAIL;
+	}
+	if(demand_page(&pcb, USER_STACK - 4) != FAULT_MINOR){
+		printf("Stack page was not zero filled\n");
+		result = FAIL;
+	}
+	if(demand_page(&pcb, bss + FRAME_SIZE) != FAULT_FAIL
+	|| demand_page(&pcb, USER_STACK - USER_STACK_SIZE - 4) != FAULT_FAIL){
+		printf("Fault outside the task's memory was resolved\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(&pcb, 1);
+
+	#undef CHECK_LEN
+	return result;
+}
+
+/* Execute-in-place test
+ *
+ * Pages in the text of the same executable for two fake tasks and checks
+ * that both map the filesystem image's data block read-only, without
+ * using up any frames
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: LOADER_XIP text mapping
+ * Files: paging.h/c
+ */
+int xip_test(){
+	TEST_HEADER();
+
+	dentry_t dentry;
+	if(read_dentry_by_name("ls", &dentry) != 0){
+		printf("Could not find ls\n");
+		return FAIL;
+	}
+
+	pcb_t tasks[2];
+	if(create_fake_tasks(tasks, 2, 0)) return FAIL;
+	pcb_t* a = &tasks[0];
+	pcb_t* b = &tasks[1];
+	a->exe_inode = b->exe_inode = dentry.inode;
+	a->image_file_end = b->image_file_end = USER_LOAD_ADDR + inode_at(dentry.inode)->size;
+	a->image_end = b->image_end = a->image_file_end;
+	a->text_start = b->text_start = USER_LOAD_ADDR;
+	a->text_end = b->text_end = USER_LOAD_ADDR + FRAME_SIZE;
+
+	uint32_t block = (uint32_t)data_at(inode_at(dentry.inode)->block_nums[0]);
+	uint32_t free_before = num_free_frames();
+	int result = PASS;
+
+	if(demand_page(a, USER_LOAD_ADDR) == FAULT_FAIL
+	|| demand_page(b, USER_LOAD_ADDR) == FAULT_FAIL){
+		printf("Could not page in text\n");
+		result = FAIL;
+	}
+	else{
+		PTE_t* pte_a = get_task_pte(a, USER_LOAD_ADDR, 0);
+		PTE_t* pte_b = get_task_pte(b, USER_LOAD_ADDR, 0);
+		if(pte_a->base != block >> 12 || pte_b->base != block >> 12){
+			printf("Text is not mapped onto the filesystem image\n");
+			result = FAIL;
+		}
+		if(pte_a->rw || pte_b->rw){
+			printf("Text is mapped writable\n");
+			result = FAIL;
+		}
+	}
+	if(num_free_frames() != free_before){
+		printf("Text pages used up frames\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(tasks, 2);
+	return result;
+}
+
+/* File mapping test
+ *
+ * Maps a multi-block file into a fake task and compares it against
+ * read_data, then checks that a second mapping doesn't overlap and that
+ * unmapping removes the pages
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: map_file, unmap_file
+ * Files: paging.h/c
+ */
+int mmap_test(){
+	TEST_HEADER();
+
+	dentry_t dentry;
+	if(read_dentry_by_name("fish", &dentry) != 0){
+		printf("Could not find fish\n");
+		return FAIL;
+	}
+
+	pcb_t pcb;
+	if(create_fake_tasks(&pcb, 1, 0)) return FAIL;
+	load_cr3(pcb.page_dir);
+
+	#define CHECK_LEN 256
+	uint8_t expected[CHECK_LEN];
+	uint32_t size = inode_at(dentry.inode)->size;
+	uint32_t offset, first, second;
+	int result = PASS;
+
+	first = map_file(&pcb, dentry.inode);
+	second = map_file(&pcb, dentry.inode);
+	if(first == 0 || second == 0 || second < first + size){
+		printf("Could not map the file twice\n");
+		result = FAIL;
+	}
+	else{
+		// Compare the start of every block
+		for(offset = 0; offset < size; offset += FRAME_SIZE){
+			uint32_t len = min(CHECK_LEN, size - offset);
+			read_data(dentry.inode, offset, expected, len);
+			if(strncmp((int8_t*)(first + offset), (int8_t*)expected, len) != 0){
+				printf("Mapping differs from the file at offset %u\n", offset);
+				result = FAIL;
+			}
+		}
+
+		if(unmap_file(&pcb, first) != 0 || get_task_pte(&pcb, first, 0)->p
+		|| unmap_file(&pcb, first) == 0){
+			printf("Mapping was not removed\n");
+			result = FAIL;
+		}
+	}
+
+	free_fake_tasks(&pcb, 1);
+
+	#undef CHECK_LEN
+	return result;
+}
+
+/* Copy-on-write test
+ *
+ * Copies a fake task's address space and breaks the sharing from both
+ * sides, checking frame reference counts and contents along the way
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: copy_task_page, cow_page, frame reference counts
+ * Files: paging.h/c, frame.h/c
+ */
+int cow_test(){
+	TEST_HEADER();
+
+	// Only the parent is set up, the child's address space is a copy of it
+	pcb_t tasks[2];
+	pcb_t* parent = &tasks[0];
+	pcb_t* child = &tasks[1];
+
+	uint32_t free_before = num_free_frames();
+	if(create_fake_tasks(parent, 1, 1)) return FAIL;
+	memset(child, 0, sizeof(pcb_t));
+
+	PTE_t* pte_p = get_task_pte(parent, USER_LOAD_ADDR, 0);
+	uint32_t frame = pte_p->base << 12;
+	*(uint32_t*)frame = 391;
+	int result = PASS;
+
+	if(copy_task_page(parent, child)){
+		printf("Could not copy address space\n");
+		free_fake_tasks(tasks, 2);
+		return FAIL;
+	}
+	PTE_t* pte_c = get_task_pte(child, USER_LOAD_ADDR, 0);
+
+	if(pte_p->rw || pte_c->rw || pte_c->base != pte_p->base || frame_refcount(frame) != 2){
+		printf("Page is not shared copy-on-write\n");
+		result = FAIL;
+	}
+
+	// The child writes first and gets its own copy
+	if(cow_page(child, USER_LOAD_ADDR) != FAULT_MINOR || !pte_c->rw
+	|| pte_c->base == pte_p->base || *(uint32_t*)(pte_c->base << 12) != 391
+	|| frame_refcount(frame) != 1){
+		printf("Child did not get a private copy\n");
+		result = FAIL;
+	}
+
+	// The parent is the last user and keeps its frame
+	if(cow_page(parent, USER_LOAD_ADDR) != FAULT_MINOR || !pte_p->rw
+	|| (pte_p->base << 12) != frame){
+		printf("Parent did not keep its frame\n");
+		result = FAIL;
+	}
+
+	if(cow_page(parent, USER_LOAD_ADDR) != FAULT_FAIL){
+		printf("Writable page was treated as copy-on-write\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(tasks, 2);
+	if(num_free_frames() != free_before){
+		printf("Frames leaked\n");
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Shared memory test
+ *
+ * Attaches one segment to two fake tasks, checks that they map the same
+ * frames, and that the frames are freed with the last detach, or when the
+ * creator of a segment nobody attached halts
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: shm_get, shm_attach, shm_detach, shm_exit
+ * Files: shm.h/c, paging.h/c
+ */
+int shm_test(){
+	TEST_HEADER();
+
+	#define SHM_TEST_KEY 391
+	#define SHM_TEST_SIZE (2*FRAME_SIZE)
+	#define SHM_TEST_PID MAX_PID
+	pcb_t tasks[2];
+	if(create_fake_tasks(tasks, 2, 0)) return FAIL;
+	pcb_t* a = &tasks[0];
+	pcb_t* b = &tasks[1];
+
+	// Page tables for the window are allocated on the first attach
+	get_task_pte(a, USER_SHM_ADDR, 1);
+	get_task_pte(b, USER_SHM_ADDR, 1);
+	kfree(kmalloc(sizeof(uint32_t))); // Warm the cache for the frame list
+	uint32_t free_before = num_free_frames();
+	int result = PASS;
+
+	int32_t id = shm_get(SHM_TEST_KEY, SHM_TEST_SIZE);
+	uint32_t start_a = shm_attach(a, id);
+	uint32_t start_b = shm_attach(b, shm_get(SHM_TEST_KEY, FRAME_SIZE));
+	if(id < 0 || start_a == 0 || start_b == 0){
+		printf("Could not attach the segment\n");
+		result = FAIL;
+	}
+	else{
+		PTE_t* pte_a = get_task_pte(a, start_a + FRAME_SIZE, 0);
+		PTE_t* pte_b = get_task_pte(b, start_b + FRAME_SIZE, 0);
+		if(!pte_a->p || !pte_a->rw || pte_a->base != pte_b->base){
+			printf("Tasks don't share the segment's frames\n");
+			result = FAIL;
+		}
+		if(shm_get(SHM_TEST_KEY, 2*SHM_TEST_SIZE) != -1){
+			printf("Segment grew through shm_get\n");
+			result = FAIL;
+		}
+
+		shm_detach(a, start_a);
+		if(shm_size(id) != SHM_TEST_SIZE){
+			printf("Segment was destroyed while still attached\n");
+			result = FAIL;
+		}
+		shm_detach_all(b);
+		if(shm_size(id) != 0 || num_free_frames() != free_before){
+			printf("Segment was not destroyed with its last attachment\n");
+			result = FAIL;
+		}
+	}
+
+	// A segment nobody attached goes away when its creator halts
+	pid_t pid = active_pid;
+	active_pid = SHM_TEST_PID;
+	id = shm_get(SHM_PRIVATE, SHM_TEST_SIZE);
+	active_pid = pid;
+	if(id < 0 || shm_size(id) != SHM_TEST_SIZE){
+		printf("Could not create a private segment\n");
+		result = FAIL;
+	}
+	shm_exit(SHM_TEST_PID);
+	if(shm_size(id) != 0 || num_free_frames() != free_before){
+		printf("Unattached segment outlived its creator\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(tasks, 2);
+
+	#undef SHM_TEST_KEY
+	#undef SHM_TEST_SIZE
+	#undef SHM_TEST_PID
+	return result;
+}
+
+/* Heap test
+ *
+ * Grows a fake task's heap, pages it in and shrinks it again
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: set_task_brk, demand_page on the heap
+ * Files: paging.h/c
+ */
+int brk_test(){
+	TEST_HEADER();
+
+	pcb_t pcb;
+	if(create_fake_tasks(&pcb, 1, 0)) return FAIL;
+	pcb.image_end = pcb.image_file_end = USER_LOAD_ADDR + FRAME_SIZE;
+	pcb.heap_start = pcb.brk = pcb.image_end;
+	int result = PASS;
+
+	if(demand_page(&pcb, pcb.heap_start) != FAULT_FAIL){
+		printf("Empty heap was paged in\n");
+		result = FAIL;
+	}
+	if(set_task_brk(&pcb, pcb.heap_start + 3*FRAME_SIZE + 1) != 0
+	|| demand_page(&pcb, pcb.heap_start + 3*FRAME_SIZE) != FAULT_MINOR){
+		printf("Heap did not grow\n");
+		result = FAIL;
+	}
+	if(set_task_brk(&pcb, pcb.heap_start + FRAME_SIZE) != 0
+	|| get_task_pte(&pcb, pcb.heap_start + 3*FRAME_SIZE, 0)->p){
+		printf("Heap did not shrink\n");
+		result = FAIL;
+	}
+	if(set_task_brk(&pcb, pcb.heap_start - 1) == 0
+	|| set_task_brk(&pcb, USER_STACK - USER_STACK_SIZE + 1) == 0){
+		printf("Heap left its region\n");
+		result = FAIL;
+	}
+
+	free_fake_tasks(&pcb, 1);
+	return result;
+}
@@ -5,5 +5,13 @@ int invalid_deref_test();
 int invalid_write_test();
 int valid_deref_test();
 int valid_write_test();
+int context_switch_bench();
+int tlb_flush_test();
+int demand_paging_test();
+int xip_test();
+int mmap_test();
+int cow_test();
+int shm_test();
+int brk_test();
 
 #endif /* _PAGING_TESTS_H */
@@ -38,7 +38,7 @@ static pcb_t fake_pcb = {
 int file_fops_tests(){
     TEST_HEADER();
 
-    active_pid = 0;
+    active_pid = reserve_pid();
     pcb_t* pcb = get_pcb(active_pid);
     *pcb = fake_pcb;
 
@@ -89,6 +89,7 @@ int file_fops_tests(){
 		return FAIL;
 	}
 
+    free_pid(active_pid);
     active_pid = (unsigned)-1;
 	#undef EXPECTED_STR
 	#undef EXPECTED_STR_LEN
@@ -104,14 +105,14 @@ int file_fops_tests(){
 int dir_fops_tests(){
     TEST_HEADER();
 
-    active_pid = 0;
+    active_pid = reserve_pid();
     pcb_t* pcb = get_pcb(active_pid);
     *pcb = fake_pcb;
 
 	char* filename = ".";
 	int counter = 0;
 
-	#define EXPECTED_COUNT 17
+	#define EXPECTED_COUNT 18
 	char* expected[EXPECTED_COUNT] = {
 		".",
 		"sigtest",
@@ -129,7 +130,8 @@ int dir_fops_tests(){
 		"testprint",
 		"created.txt",
 		"frame1.txt",
-		"hello"
+		"hello",
+		"top"
 	};
 
 	// Test opening of file
@@ -171,6 +173,7 @@ int dir_fops_tests(){
 		return FAIL;
 	}
 
+    free_pid(active_pid);
     active_pid = (unsigned)-1;
 	#undef EXPECTED_COUNT
 	return PASS;
@@ -185,7 +188,7 @@ int dir_fops_tests(){
 int invalid_fops_test(){
     TEST_HEADER();
 
-    active_pid = 0;
+    active_pid = reserve_pid();
     pcb_t* pcb = get_pcb(active_pid);
     *pcb = fake_pcb;
 
@@ -204,7 +207,60 @@ int invalid_fops_test(){
 		return FAIL;
 	}
 
+    free_pid(active_pid);
     active_pid = (unsigned)-1;
 	#undef BUF_SIZE
 	return PASS;
 }
+
+/* reparent test
+ * DESCRIPTION:		Tests that the children of a halting task move to its
+ * 					parent, and that a terminal can be left without a head
+ * COVERAGE:			reparent_children, set_terminal_pid_head
+ * FILES:				process.h/c
+ */
+int reparent_test(){
+	TEST_HEADER();
+
+	pid_t parent = reserve_pid();
+	pid_t task = reserve_pid();
+	pid_t child = reserve_pid();
+	pid_t other = reserve_pid();
+	if(parent > MAX_PID || task > MAX_PID || child > MAX_PID || other > MAX_PID){
+		printf("Could not reserve PIDs\n");
+		return FAIL;
+	}
+	get_pcb(task)->parent_pid = parent;
+	get_pcb(child)->parent_pid = task;
+	get_pcb(other)->parent_pid = parent;
+
+	reparent_children(task, parent);
+	if(get_pcb(child)->parent_pid != parent || get_pcb(other)->parent_pid != parent){
+		printf("Child was not handed to its grandparent\n");
+		return FAIL;
+	}
+
+	// The grandparent went away too: nobody is left above the child
+	reparent_children(parent, (unsigned)-1);
+	if(get_pcb(child)->parent_pid != (unsigned)-1){
+		printf("Child kept a freed parent\n");
+		return FAIL;
+	}
+
+	pid_t head = get_terminal_pid_head(0);
+	if(set_terminal_pid_head(0, (unsigned)-1) != 0 || get_terminal_pid_head(0) != (unsigned)-1){
+		printf("Terminal could not be left without a head\n");
+		return FAIL;
+	}
+	if(set_terminal_pid_head(0, MAX_PID + 1) != -1){
+		printf("Invalid head PID was accepted\n");
+		return FAIL;
+	}
+	set_terminal_pid_head(0, head);
+
+	free_pid(other);
+	free_pid(child);
+	free_pid(task);
+	free_pid(parent);
+	return PASS;
+}
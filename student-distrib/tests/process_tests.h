@@ -4,5 +4,6 @@
 int file_fops_tests();
 int dir_fops_tests();
 int invalid_fops_test();
+int reparent_test();
 
 #endif /* _PROCESS_TESTS_H */
@@ -0,0 +1,105 @@
+#include "procfs_tests.h"
+#include "tests.h"
+
+#include "../lib/lib.h"
+#include "../storage/filesys.h"
+#include "../storage/procfs.h"
+#include "../tasks/process.h"
+
+#define PROC_READ_CHUNK 7
+
+/* Procfs lookup test
+ *
+ * Looks up proc/stat and the entry of a task that exists, and checks that
+ * other proc/ names aren't found
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PID is released)
+ * Coverage: read_dentry_by_name, procfs_lookup
+ * Files: filesys.h/c, procfs.h/c
+ */
+int procfs_lookup_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	dentry_t dentry;
+	int8_t name[MAX_FILENAME_SIZE];
+
+	if(read_dentry_by_name("proc/stat", &dentry) != 0
+	|| dentry.type != DENTRY_TYPE_PROC || dentry.inode != PROC_STAT_INODE){
+		printf("proc/stat not found\n");
+		result = FAIL;
+	}
+
+	// Only the PID has to be in use
+	pid_t pid = reserve_pid();
+	if(pid > MAX_PID){
+		printf("Couldn't create a task\n");
+		return FAIL;
+	}
+	strcpy(name, "proc/");
+	itoa(pid, name + 5, 10);
+	if(read_dentry_by_name(name, &dentry) != 0 || dentry.type != DENTRY_TYPE_PROC || dentry.inode != pid){
+		printf("%s not found\n", name);
+		result = FAIL;
+	}
+	free_pid(pid);
+
+	if(read_dentry_by_name(name, &dentry) == 0
+	|| read_dentry_by_name("proc/32", &dentry) == 0
+	|| read_dentry_by_name("proc/01", &dentry) == 0
+	|| read_dentry_by_name("proc/", &dentry) == 0
+	|| read_dentry_by_name("proc/stats", &dentry) == 0){
+		printf("Found a proc/ entry that doesn't exist\n");
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Procfs read test
+ *
+ * Reads proc/stat whole and in small pieces, and checks the pieces add up
+ * to the same lines
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints proc/stat
+ * Coverage: proc_read, procfs_render
+ * Files: procfs.h/c
+ */
+int procfs_read_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	static int8_t whole[PROC_BUF_SIZE + 1];
+	static int8_t pieces[PROC_BUF_SIZE + 1];
+	file_t file;
+	int32_t len, n, total = 0;
+	unsigned long flags;
+
+	// Nothing that changes the counters may run in between
+	cli_and_save(flags);
+
+	file.inode = PROC_STAT_INODE;
+	file.fpos = 0;
+	len = proc_read(&file, whole, PROC_BUF_SIZE);
+
+	file.fpos = 0;
+	while((n = proc_read(&file, pieces + total, PROC_READ_CHUNK)) > 0){
+		total += n;
+	}
+
+	restore_flags(flags);
+
+	whole[len > 0 ? len : 0] = '\0';
+	if(len <= 0 || strncmp(whole, "cpus ", 5) != 0){
+		printf("proc/stat is empty or malformed\n");
+		result = FAIL;
+	}
+	if(total != len || strncmp(whole, pieces, len) != 0){
+		printf("Read in pieces: %d bytes, whole: %d bytes\n", total, len);
+		result = FAIL;
+	}
+
+	printf("%s", whole);
+	return result;
+}
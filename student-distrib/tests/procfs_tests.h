@@ -0,0 +1,7 @@
+#ifndef _PROCFS_TESTS_H
+#define _PROCFS_TESTS_H
+
+int procfs_lookup_test();
+int procfs_read_test();
+
+#endif /* _PROCFS_TESTS_H */
@@ -0,0 +1,401 @@
+#include "scheduler_tests.h"
+#include "tests.h"
+
+#include "../scheduler/scheduler.h"
+#include "../scheduler/wait.h"
+#include "../scheduler/timer.h"
+#include "../scheduler/switch.h"
+#include "../scheduler/tick.h"
+#include "../tasks/process.h"
+#include "../arch/smp.h"
+#include "../lib/lib.h"
+
+/* Run queue test
+ *
+ * Puts a few PIDs on the run queue and checks the round-robin order
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the run queue is emptied again)
+ * Coverage: Ready bitmap, get_next_pid
+ * Files: scheduler.h/c
+ */
+int run_queue_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	// Nothing may be running yet, tests happen before the first shell
+	if(get_next_pid(0) <= MAX_PID){
+		printf("Run queue not empty\n");
+		return FAIL;
+	}
+
+	sched_enqueue(3);
+	sched_enqueue(7);
+	sched_enqueue(MAX_PID);
+
+	if(get_next_pid(3) != 7 || get_next_pid(7) != MAX_PID || get_next_pid(MAX_PID) != 3){
+		printf("Wrong round-robin order\n");
+		result = FAIL;
+	}
+	// PIDs in between and not on the queue go to the next ready one
+	if(get_next_pid(0) != 3 || get_next_pid(5) != 7){
+		printf("Wrong next PID from an idle slot\n");
+		result = FAIL;
+	}
+
+	sched_dequeue(7);
+	sched_dequeue(MAX_PID);
+	if(get_next_pid(3) != 3){
+		printf("A lone ready task should be picked again\n");
+		result = FAIL;
+	}
+
+	sched_dequeue(3);
+	if(get_next_pid(3) <= MAX_PID){
+		printf("Run queue not empty after dequeue\n");
+		result = FAIL;
+	}
+	return result;
+}
+
+/* Wait queue test
+ *
+ * Sleeps a fake task on a wait queue and wakes it up again
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PID is released and the run queue emptied)
+ * Coverage: prepare_to_wait, wake_up, finish_wait
+ * Files: wait.h/c, scheduler.h/c
+ */
+int wait_queue_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	wait_queue_t wq;
+	init_wait_queue(&wq);
+
+	active_pid = reserve_pid();
+	if(active_pid > MAX_PID){
+		printf("Couldn't reserve a PID\n");
+		active_pid = -1;
+		return FAIL;
+	}
+	sched_enqueue(active_pid);
+
+	prepare_to_wait(&wq);
+	if(get_next_pid(active_pid) <= MAX_PID){
+		printf("Waiting task is still on the run queue\n");
+		result = FAIL;
+	}
+
+	wake_up(&wq);
+	if(get_next_pid(active_pid) != active_pid || wq.waiters != 0){
+		printf("Woken task is not back on the run queue\n");
+		result = FAIL;
+	}
+
+	// Waking an empty queue does nothing
+	sched_dequeue(active_pid);
+	wake_up(&wq);
+	if(get_next_pid(active_pid) <= MAX_PID){
+		printf("Empty wait queue woke a task\n");
+		result = FAIL;
+	}
+
+	finish_wait(&wq);
+	sched_dequeue(active_pid);
+	free_pid(active_pid);
+	active_pid = -1;
+	return result;
+}
+
+// Jiffies value each test timer fired at
+static uint32_t fired_at[4];
+
+/* record_fire
+ * DESCRIPTION:		timer callback for timer_wheel_test
+ */
+static void record_fire(uint32_t data){
+	fired_at[data] = jiffies;
+}
+
+/* Timer wheel test
+ *
+ * Arms timers on each level of the wheel, ticks the wheel by hand and
+ * checks that every timer fires exactly on time
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Advances jiffies (the PIT isn't running during tests)
+ * Coverage: add_timer, del_timer, cascading, timer_tick, timer_next_expiry
+ * Files: timer.h/c
+ */
+int timer_wheel_test(){
+	TEST_HEADER();
+
+	// Fine wheel, first coarse wheel, second coarse wheel, deleted
+	const uint32_t delays[4] = {5, 300, 20000, 100};
+	ktimer_t timers[4];
+	uint32_t start = jiffies;
+	int i, result = PASS;
+
+	for(i = 0; i < 4; i++){
+		fired_at[i] = 0;
+		init_timer(&timers[i], record_fire, i);
+		add_timer(&timers[i], start + delays[i]);
+	}
+	// The dynamic tick sleeps until the earliest timer
+	if(timer_next_expiry() != start + delays[0]){
+		printf("Next expiry is +%d instead of +%d\n", timer_next_expiry() - start, delays[0]);
+		result = FAIL;
+	}
+	if(!del_timer(&timers[3]) || del_timer(&timers[3])){
+		printf("del_timer didn't report the pending state\n");
+		result = FAIL;
+	}
+
+	while(jiffies - start < delays[2] + 10){
+		timer_tick();
+	}
+
+	for(i = 0; i < 3; i++){
+		if(timer_pending(&timers[i]) || fired_at[i] != start + delays[i]){
+			printf("Timer %d fired at +%d instead of +%d\n", i, fired_at[i] - start, delays[i]);
+			result = FAIL;
+		}
+	}
+	if(fired_at[3] != 0){
+		printf("Deleted timer fired\n");
+		result = FAIL;
+	}
+	return result;
+}
+
+#define FAKE_COUNTS_PER_TICK 1000
+
+// Tick device whose old shot can be made to fire just before it is stopped
+static uint32_t fake_armed;
+static int fake_fire_on_stop;
+static int fake_latched;
+
+static void fake_tick_arm(uint32_t counts){
+	fake_armed = counts;
+}
+
+static void fake_tick_stop(void){
+	if(fake_fire_on_stop) fake_latched = 1;
+	fake_fire_on_stop = 0;
+}
+
+static uint32_t fake_tick_elapsed(uint32_t counts, int fired){
+	return counts;
+}
+
+static int fake_tick_pending(void){
+	return fake_latched;
+}
+
+static const tick_device_t fake_tick_device = {
+	.name = "fake",
+	.counts_per_tick = FAKE_COUNTS_PER_TICK,
+	.max_counts = 0xFFFFFFFF,
+	.arm = fake_tick_arm,
+	.stop = fake_tick_stop,
+	.elapsed = fake_tick_elapsed,
+	.irq_pending = fake_tick_pending
+};
+
+/* Stale tick interrupt test
+ *
+ * Has the old shot fire just as it is re-armed and checks that its
+ * interrupt is skipped instead of ending the new shot
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the tick isn't running during tests)
+ * Coverage: arm_shot stopping the old shot, stale interrupts in tick_irq
+ * Files: tick.h/c
+ */
+int tick_stale_irq_test(){
+	TEST_HEADER();
+
+	if(tick_get_device() != NULL){
+		printf("The tick is already running\n");
+		return FAIL;
+	}
+
+	int result = PASS;
+	tick_stats_t before, after;
+	unsigned long flags;
+	cli_and_save(flags);
+
+	fake_latched = 0;
+	fake_fire_on_stop = 0;
+	tick_start(&fake_tick_device);
+	tick_get_stats(&before);
+
+	// Re-arming stops the old shot, which fires right then
+	fake_fire_on_stop = 1;
+	tick_start(&fake_tick_device);
+	uint32_t start = jiffies;
+
+	// Its interrupt comes in, then is acknowledged
+	tick_irq();
+	fake_latched = 0;
+	tick_get_stats(&after);
+
+	if(after.stale != before.stale + 1){
+		printf("Interrupt of the stopped shot wasn't seen as stale\n");
+		result = FAIL;
+	}
+	if(jiffies != start){
+		printf("Stale interrupt ended the new shot (jiffies +%u)\n", jiffies - start);
+		result = FAIL;
+	}
+
+	tick_stop();
+	restore_flags(flags);
+	return result;
+}
+
+#define TICK_IDLE_SLEEP 50
+
+/* Tick avoided test
+ *
+ * Sleeps an idle system until a timer TICK_IDLE_SLEEP ticks out and checks
+ * that the whole sleep took a single interrupt
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Advances jiffies, prints the tick statistics
+ * Coverage: one-shots spanning several ticks, tick_get_stats
+ * Files: tick.h/c
+ */
+int tick_avoided_test(){
+	TEST_HEADER();
+
+	if(tick_get_device() != NULL){
+		printf("The tick is already running\n");
+		return FAIL;
+	}
+	// Other CPUs keep the shot at a single tick
+	if(smp_num_cpus() > 1){
+		printf("Skipped, %u CPUs online\n", smp_num_cpus());
+		return PASS;
+	}
+
+	int result = PASS;
+	ktimer_t timer;
+	tick_stats_t stats;
+	unsigned long flags;
+	cli_and_save(flags);
+
+	uint32_t start = jiffies;
+	fired_at[0] = 0;
+	init_timer(&timer, record_fire, 0);
+	add_timer(&timer, start + TICK_IDLE_SLEEP);
+
+	fake_latched = 0;
+	fake_fire_on_stop = 0;
+	tick_start(&fake_tick_device);
+	if(fake_armed != TICK_IDLE_SLEEP * FAKE_COUNTS_PER_TICK){
+		printf("Shot is %u counts instead of the whole sleep\n", fake_armed);
+		result = FAIL;
+	}
+
+	// The shot fires at the end of the sleep
+	tick_irq();
+	tick_get_stats(&stats);
+	tick_print_stats();
+
+	if(fired_at[0] != start + TICK_IDLE_SLEEP){
+		printf("Timer fired at +%u instead of +%u\n", fired_at[0] - start, TICK_IDLE_SLEEP);
+		result = FAIL;
+	}
+	if(stats.ticks != TICK_IDLE_SLEEP || stats.avoided == 0){
+		printf("%u ticks with %u avoided\n", stats.ticks, stats.avoided);
+		result = FAIL;
+	}
+
+	del_timer(&timer);
+	tick_stop();
+	restore_flags(flags);
+	return result;
+}
+
+#define PINGPONG_SWITCHES 10000
+
+static volatile uint32_t pingpong_switches;
+static uint32_t pingpong_bench_esp;
+static uint32_t pingpong_done_esp;
+
+/* pingpong_thread
+ * DESCRIPTION:         body of both fake tasks, yields until enough
+ *                      switches have happened, then goes back to the test
+ */
+static void pingpong_thread(void){
+	while(pingpong_switches < PINGPONG_SWITCHES){
+		pingpong_switches++;
+		schedule();
+	}
+	switch_to(&pingpong_done_esp, pingpong_bench_esp, 0, 0);
+}
+
+/* Yield ping-pong benchmark
+ *
+ * Two fake tasks that only yield to each other, so every schedule() call
+ * is one switch through pause_task, resume_task and switch_to
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints cycles per switch (the PIDs are released)
+ * Coverage: schedule, resume_task, switch_to
+ * Files: scheduler.h/c, switch.S, process.h/c
+ */
+int yield_pingpong_bench(){
+	TEST_HEADER();
+
+	pid_t pids[2];
+	unsigned long flags;
+	uint64_t start;
+	uint32_t cycles;
+	int i;
+
+	pids[0] = reserve_pid();
+	pids[1] = reserve_pid();
+	if(pids[0] > MAX_PID || pids[1] > MAX_PID){
+		printf("Couldn't reserve PIDs\n");
+		free_pid(pids[0]);
+		free_pid(pids[1]);
+		return FAIL;
+	}
+
+	// Kernel-only tasks whose first switch starts pingpong_thread
+	for(i = 0; i < 2; i++){
+		pcb_t* pcb = get_pcb(pids[i]);
+		uint32_t* stack = (uint32_t*)get_kernel_stack(pids[i]);
+
+		memset(pcb, 0, sizeof(pcb_t));
+		pcb->flags = TASK_EXECUTING;
+		pcb->terminal = get_active_terminal();
+
+		*--stack = 0; // pingpong_thread never returns
+		pcb->kernel_esp = switch_frame(stack, pingpong_thread);
+		sched_enqueue(pids[i]);
+	}
+
+	cli_and_save(flags);
+	pingpong_switches = 0;
+	active_pid = pids[0];
+
+	start = rdtsc();
+	switch_to(&pingpong_bench_esp, get_pcb(pids[0])->kernel_esp, 0, 0);
+	cycles = (uint32_t)(rdtsc() - start);
+
+	active_pid = -1;
+	restore_flags(flags);
+
+	for(i = 0; i < 2; i++){
+		sched_dequeue(pids[i]);
+		free_pid(pids[i]);
+	}
+
+	printf("Yield ping-pong: %u cycles per switch\n", cycles / PINGPONG_SWITCHES);
+	return PASS;
+}
@@ -0,0 +1,11 @@
+#ifndef _SCHEDULER_TESTS_H
+#define _SCHEDULER_TESTS_H
+
+int run_queue_test();
+int wait_queue_test();
+int timer_wheel_test();
+int yield_pingpong_bench();
+int tick_stale_irq_test();
+int tick_avoided_test();
+
+#endif /* _SCHEDULER_TESTS_H */
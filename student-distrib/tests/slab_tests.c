@@ -0,0 +1,119 @@
+#include "slab_tests.h"
+#include "tests.h"
+
+#include "../memory/slab.h"
+#include "../memory/frame.h"
+#include "../lib/lib.h"
+
+#define TEST_OBJS 100
+
+/* Slab cache test
+ *
+ * Fills more than one slab of a cache, checks that objects are distinct
+ * and aligned, then frees them and checks the statistics
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Creates a cache (caches can't be destroyed)
+ * Coverage: Slab object caches
+ * Files: slab.h/c
+ */
+int slab_cache_test(){
+	TEST_HEADER();
+
+	static kmem_cache_t* cache = NULL;
+	if(cache == NULL) cache = kmem_cache_create("test-100", 100);
+	if(cache == NULL){
+		printf("Could not create cache\n");
+		return FAIL;
+	}
+
+	uint32_t* objs[TEST_OBJS];
+	int i, result = PASS;
+
+	for(i = 0; i < TEST_OBJS; i++){
+		objs[i] = kmem_cache_alloc(cache);
+		if(objs[i] == NULL || ((uint32_t)objs[i] & (SLAB_ALIGN - 1))){
+			printf("Bad object 0x%#x\n", objs[i]);
+			result = FAIL;
+			break;
+		}
+		*objs[i] = i;
+	}
+
+	if(result == PASS){
+		// Writing one object must not have touched another
+		for(i = 0; i < TEST_OBJS; i++){
+			if(*objs[i] != i){
+				printf("Objects overlap\n");
+				result = FAIL;
+				break;
+			}
+		}
+		if(cache->active_objs != TEST_OBJS || cache->num_slabs < 2){
+			printf("Statistics are off: %u active, %u slabs\n", cache->active_objs, cache->num_slabs);
+			result = FAIL;
+		}
+		i = TEST_OBJS;
+	}
+
+	while(--i >= 0){
+		kmem_cache_free(cache, objs[i]);
+	}
+	if(cache->active_objs != 0 || cache->num_slabs > 1){
+		printf("Slabs were not released: %u active, %u slabs\n", cache->active_objs, cache->num_slabs);
+		result = FAIL;
+	}
+	return result;
+}
+
+/* kmalloc test
+ *
+ * Allocates a range of sizes, both from the power-of-two caches and
+ * directly from the frame allocator, and checks nothing leaks
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: kmalloc, kfree
+ * Files: slab.h/c
+ */
+int kmalloc_test(){
+	TEST_HEADER();
+
+	#define NUM_SIZES 6
+	uint32_t sizes[NUM_SIZES] = {1, 24, 100, 1000, 3000, 10000};
+	uint8_t* ptrs[NUM_SIZES];
+	int i, result = PASS;
+
+	// Warm the caches so their first slabs don't count as leaks
+	for(i = 0; i < NUM_SIZES; i++){
+		kfree(kmalloc(sizes[i]));
+	}
+	uint32_t free_before = num_free_frames();
+
+	for(i = 0; i < NUM_SIZES; i++){
+		ptrs[i] = kmalloc(sizes[i]);
+		if(ptrs[i] == NULL){
+			printf("kmalloc(%u) failed\n", sizes[i]);
+			result = FAIL;
+			continue;
+		}
+		memset(ptrs[i], i, sizes[i]);
+	}
+	for(i = 0; i < NUM_SIZES; i++){
+		if(ptrs[i] != NULL && (ptrs[i][0] != i || ptrs[i][sizes[i] - 1] != i)){
+			printf("kmalloc(%u) memory was overwritten\n", sizes[i]);
+			result = FAIL;
+		}
+	}
+	for(i = 0; i < NUM_SIZES; i++){
+		kfree(ptrs[i]);
+	}
+
+	if(num_free_frames() != free_before){
+		printf("kfree leaked frames\n");
+		result = FAIL;
+	}
+
+	#undef NUM_SIZES
+	return result;
+}
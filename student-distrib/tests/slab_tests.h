@@ -0,0 +1,7 @@
+#ifndef _SLAB_TESTS_H
+#define _SLAB_TESTS_H
+
+int slab_cache_test();
+int kmalloc_test();
+
+#endif /* _SLAB_TESTS_H */
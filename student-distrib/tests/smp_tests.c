@@ -0,0 +1,125 @@
+#include "smp_tests.h"
+#include "tests.h"
+
+#include "../arch/cpu.h"
+#include "../arch/smp.h"
+#include "../lib/lib.h"
+#include "../scheduler/scheduler.h"
+#include "../tasks/process.h"
+
+/* Per-CPU data test
+ *
+ * Checks that %fs reaches the running CPU's cpu_t, and that every CPU
+ * that came up has its own entry and local APIC
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: Prints the number of CPUs online
+ * Coverage: cpu_init, this_cpu, smp_init
+ * Files: cpu.h/c, smp.h/c
+ */
+int percpu_data_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	uint32_t mask = smp_online_mask();
+	uint32_t online = 0;
+	uint32_t i, j;
+
+	// Tests run on the boot CPU, holding the kernel lock
+	if(this_cpu() != &cpus[0] || cpu_id() != 0 || this_cpu()->lock_depth == 0){
+		printf("Boot CPU's per-CPU data is wrong\n");
+		result = FAIL;
+	}
+
+	for(i = 0; i < MAX_CPUS; i++){
+		if(!(mask & (1 << i))) continue;
+		online++;
+
+		if(cpus[i].self != &cpus[i] || cpus[i].id != i){
+			printf("CPU %u's cpu_t doesn't point at itself\n", i);
+			result = FAIL;
+		}
+		for(j = 0; j < i; j++){
+			if((mask & (1 << j)) && cpus[j].apic_id == cpus[i].apic_id){
+				printf("CPUs %u and %u share APIC ID %u\n", j, i, cpus[i].apic_id);
+				result = FAIL;
+			}
+		}
+	}
+
+	if(online != smp_num_cpus()){
+		printf("%u CPUs in the online mask, %u counted\n", online, smp_num_cpus());
+		result = FAIL;
+	}
+
+	printf("%u CPUs online\n", smp_num_cpus());
+	return result;
+}
+
+/* CPU placement test
+ *
+ * Checks where sched_select_cpu puts a task that becomes ready, for
+ * each affinity rule
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None (the PIDs are released and the run queues emptied)
+ * Coverage: sched_select_cpu, affinity, least loaded placement
+ * Files: scheduler.h/c
+ */
+int cpu_placement_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	uint32_t mask = smp_online_mask();
+	uint32_t i;
+
+	pid_t task = reserve_pid();
+	pid_t busy = reserve_pid();
+	if(task > MAX_PID || busy > MAX_PID){
+		printf("Couldn't reserve PIDs\n");
+		free_pid(task);
+		free_pid(busy);
+		return FAIL;
+	}
+	pcb_t* pcb = get_pcb(task);
+
+	// Pinned to each online CPU in turn
+	for(i = 0; i < MAX_CPUS; i++){
+		if(!(mask & (1 << i))) continue;
+
+		pcb->cpu = 0;
+		pcb->cpus_allowed = 1 << i;
+		if(sched_select_cpu(task) != i){
+			printf("Task pinned to CPU %u placed on %u\n", i, sched_select_cpu(task));
+			result = FAIL;
+		}
+	}
+
+	// Allowed only on CPUs that aren't running: stays here
+	pcb->cpus_allowed = ~mask & CPUS_ALL;
+	if(pcb->cpus_allowed != 0 && sched_select_cpu(task) != cpu_id()){
+		printf("Task with no online CPU allowed left this CPU\n");
+		result = FAIL;
+	}
+
+	// With a task ready here, any other CPU is less loaded
+	sched_enqueue(busy);
+	pcb->cpu = 0;
+	pcb->cpus_allowed = CPUS_ALL;
+	uint32_t chosen = sched_select_cpu(task);
+	if(smp_num_cpus() > 1 ? chosen == 0 || !(mask & (1 << chosen)) : chosen != 0){
+		printf("Task placed on CPU %u next to a busy one\n", chosen);
+		result = FAIL;
+	}
+
+	// Already queued: stays on that queue
+	if(sched_select_cpu(busy) != cpu_id()){
+		printf("Queued task moved to another CPU\n");
+		result = FAIL;
+	}
+
+	sched_dequeue(busy);
+	free_pid(task);
+	free_pid(busy);
+	return result;
+}
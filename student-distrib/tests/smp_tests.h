@@ -0,0 +1,7 @@
+#ifndef _SMP_TESTS_H
+#define _SMP_TESTS_H
+
+int percpu_data_test();
+int cpu_placement_test();
+
+#endif /* _SMP_TESTS_H */
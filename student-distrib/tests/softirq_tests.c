@@ -0,0 +1,140 @@
+#include "softirq_tests.h"
+#include "tests.h"
+
+#include "../lib/lib.h"
+#include "../interrupts/softirq.h"
+
+#define TASKLET_TEST_COUNT  3
+#define EFLAGS_IF           0x200
+
+static uint32_t tasklet_order[TASKLET_TEST_COUNT + 1];
+static uint32_t tasklet_runs;
+static uint32_t tasklet_bad_context;
+
+/* interrupts_enabled
+ * RETURNS:             1 if EFLAGS.IF is set, 0 otherwise
+ */
+static int interrupts_enabled(void){
+    unsigned long flags;
+    asm volatile ("pushfl; popl %0" : "=r"(flags));
+    return (flags & EFLAGS_IF) != 0;
+}
+
+/* record_tasklet
+ * DESCRIPTION:         test tasklet, notes when it ran and checks that it
+ *                      runs as a tasklet with interrupts enabled
+ */
+static void record_tasklet(uint32_t data){
+    if(!in_softirq() || !interrupts_enabled()) tasklet_bad_context++;
+    if(tasklet_runs < TASKLET_TEST_COUNT + 1) tasklet_order[tasklet_runs] = data;
+    tasklet_runs++;
+}
+
+static tasklet_t rescheduling;
+
+/* reschedule_tasklet
+ * DESCRIPTION:         test tasklet that schedules itself every time it runs
+ */
+static void reschedule_tasklet(uint32_t data){
+    tasklet_runs++;
+    tasklet_schedule(&rescheduling);
+}
+
+/* Tasklet test
+ *
+ * Schedules tasklets (one of them twice) and runs them, checking that each
+ * runs once, in order, with interrupts enabled
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: tasklet_schedule, do_softirq
+ * Files: softirq.h/c
+ */
+int tasklet_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	tasklet_t tasklets[TASKLET_TEST_COUNT];
+	unsigned long flags;
+	uint32_t i;
+
+	cli_and_save(flags);
+	tasklet_runs = 0;
+	tasklet_bad_context = 0;
+
+	for(i = 0; i < TASKLET_TEST_COUNT; i++){
+		init_tasklet(&tasklets[i], record_tasklet, i);
+		tasklet_schedule(&tasklets[i]);
+	}
+	tasklet_schedule(&tasklets[0]);
+
+	if(!softirq_pending()){
+		printf("Nothing pending after tasklet_schedule\n");
+		result = FAIL;
+	}
+
+	do_softirq();
+
+	if(tasklet_runs != TASKLET_TEST_COUNT){
+		printf("%u tasklets ran (expected %u)\n", tasklet_runs, TASKLET_TEST_COUNT);
+		result = FAIL;
+	}
+	for(i = 0; i < TASKLET_TEST_COUNT && i < tasklet_runs; i++){
+		if(tasklet_order[i] != i){
+			printf("Tasklet %u ran in place %u\n", tasklet_order[i], i);
+			result = FAIL;
+		}
+	}
+	if(tasklet_bad_context > 0){
+		printf("Tasklet ran outside a softirq pass or with interrupts off\n");
+		result = FAIL;
+	}
+	if(softirq_pending() || in_softirq() || interrupts_enabled()){
+		printf("do_softirq left state behind\n");
+		result = FAIL;
+	}
+
+	restore_flags(flags);
+	return result;
+}
+
+/* Tasklet restart test
+ *
+ * A tasklet that keeps scheduling itself runs MAX_SOFTIRQ_RESTART times
+ * in one pass, then is left for the next
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: do_softirq
+ * Files: softirq.h/c
+ */
+int tasklet_restart_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	unsigned long flags;
+
+	cli_and_save(flags);
+	tasklet_runs = 0;
+
+	init_tasklet(&rescheduling, reschedule_tasklet, 0);
+	tasklet_schedule(&rescheduling);
+	do_softirq();
+
+	if(tasklet_runs != MAX_SOFTIRQ_RESTART || !softirq_pending()){
+		printf("%u runs in one pass (expected %u, then left pending)\n", tasklet_runs, MAX_SOFTIRQ_RESTART);
+		result = FAIL;
+	}
+
+	// Swap in a tasklet that stops, so the leftover run ends it
+	rescheduling.fn = record_tasklet;
+	tasklet_runs = 0;
+	do_softirq();
+	if(tasklet_runs != 1 || softirq_pending()){
+		printf("Leftover tasklet didn't run once\n");
+		result = FAIL;
+	}
+
+	restore_flags(flags);
+	return result;
+}
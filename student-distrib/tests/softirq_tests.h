@@ -0,0 +1,7 @@
+#ifndef _SOFTIRQ_TESTS_H
+#define _SOFTIRQ_TESTS_H
+
+int tasklet_test();
+int tasklet_restart_test();
+
+#endif /* _SOFTIRQ_TESTS_H */
@@ -0,0 +1,135 @@
+#include "spinlock_tests.h"
+#include "tests.h"
+
+#include "../lib/lib.h"
+#include "../lib/spinlock.h"
+
+#define LOCK_BENCH_PAIRS    10000
+
+/* Ticket spinlock test
+ *
+ * Takes and releases a lock with spin_lock and spin_trylock, checking
+ * that a held lock can't be taken again and that the statistics count
+ * every acquisition
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: spin_lock, spin_trylock, spin_unlock, spin_lock_get_stats
+ * Files: spinlock.h/c
+ */
+int spinlock_ticket_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	spinlock_t lock;
+	spinlock_stats_t stats;
+
+	spin_lock_init(&lock, NULL);
+	if(spin_is_locked(&lock)){
+		printf("New lock is held\n");
+		result = FAIL;
+	}
+
+	spin_lock(&lock);
+	if(!spin_is_locked(&lock) || spin_trylock(&lock)){
+		printf("Held lock was taken again\n");
+		result = FAIL;
+	}
+	spin_unlock(&lock);
+
+	if(!spin_trylock(&lock)){
+		printf("Free lock couldn't be taken\n");
+		result = FAIL;
+	}
+	spin_unlock(&lock);
+	if(spin_is_locked(&lock)){
+		printf("Lock held after unlock\n");
+		result = FAIL;
+	}
+
+	// The failed trylock isn't an acquisition, and nothing waited
+	spin_lock_get_stats(&lock, &stats);
+#if (SPINLOCK_STATS == 1)
+	if(stats.acquisitions != 2 || stats.contended != 0){
+		printf("%u acquisitions, %u contended (expected 2, 0)\n", stats.acquisitions, stats.contended);
+		result = FAIL;
+	}
+#endif
+
+	return result;
+}
+
+/* Reader-writer lock test
+ *
+ * Two readers share the lock while a writer can't get it, then a writer
+ * holds it alone
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: read_lock_irqsave, write_lock_irqsave, write_trylock
+ * Files: spinlock.h/c
+ */
+int rwlock_test(){
+	TEST_HEADER();
+
+	int result = PASS;
+	rwlock_t lock;
+	unsigned long flags[2];
+
+	rwlock_init(&lock);
+
+	flags[0] = read_lock_irqsave(&lock);
+	flags[1] = read_lock_irqsave(&lock);
+	if(lock.count != 2 || write_trylock(&lock)){
+		printf("Writer got in with readers holding the lock\n");
+		result = FAIL;
+	}
+	read_unlock_irqrestore(&lock, flags[1]);
+	read_unlock_irqrestore(&lock, flags[0]);
+
+	flags[0] = write_lock_irqsave(&lock);
+	if(write_trylock(&lock) || lock.writers_waiting != 0){
+		printf("Second writer got in\n");
+		result = FAIL;
+	}
+	write_unlock_irqrestore(&lock, flags[0]);
+
+	if(lock.count != 0){
+		printf("Lock held after unlock (count %u)\n", lock.count);
+		result = FAIL;
+	}
+
+	return result;
+}
+
+/* Spinlock benchmark
+ *
+ * Uncontended lock/unlock pairs, the cost every kernel entry pays for the
+ * kernel lock
+ * Inputs: None
+ * Outputs: PASS
+ * Side Effects: Prints cycles per pair and every named lock's statistics
+ * Coverage: spin_lock, spin_unlock, spin_lock_print_stats
+ * Files: spinlock.h/c
+ */
+int spinlock_bench(){
+	TEST_HEADER();
+
+	spinlock_t lock;
+	uint64_t start;
+	uint32_t cycles;
+	int i;
+
+	spin_lock_init(&lock, NULL);
+
+	start = rdtsc();
+	for(i = 0; i < LOCK_BENCH_PAIRS; i++){
+		spin_lock(&lock);
+		spin_unlock(&lock);
+	}
+	cycles = (uint32_t)(rdtsc() - start);
+
+	printf("Spinlock: %u cycles per lock/unlock pair\n", cycles / LOCK_BENCH_PAIRS);
+	spin_lock_print_stats();
+	return PASS;
+}
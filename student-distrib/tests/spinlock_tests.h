@@ -0,0 +1,8 @@
+#ifndef _SPINLOCK_TESTS_H
+#define _SPINLOCK_TESTS_H
+
+int spinlock_ticket_test();
+int rwlock_test();
+int spinlock_bench();
+
+#endif /* _SPINLOCK_TESTS_H */
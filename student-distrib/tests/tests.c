@@ -22,6 +22,18 @@ printf("[TEST %s] Result = %s\n", name, (result) ? "PASS" : "FAIL");
 #include "process_tests.h"
 
 /* Checkpoint 4 tests */
+#include "frame_tests.h"
+#include "slab_tests.h"
+#include "memtype_tests.h"
+#include "scheduler_tests.h"
+#include "fpu_tests.h"
+#include "apic_tests.h"
+#include "smp_tests.h"
+#include "spinlock_tests.h"
+#include "softirq_tests.h"
+#include "kthread_tests.h"
+#include "procfs_tests.h"
+
 /* Checkpoint 5 tests */
 
 
@@ -93,6 +105,42 @@ void launch_tests(){
 	TEST(dir_fops_tests);
 
 	TEST(invalid_fops_test);
+	TEST(reparent_test);
+
+	// Test physical memory allocator
+	TEST(frame_alloc_test);
+	TEST(frame_coalesce_test);
+	TEST(zero_pool_test);
+	TEST(context_switch_bench);
+	TEST(tlb_flush_test);
+	TEST(demand_paging_test);
+	TEST(xip_test);
+	TEST(mmap_test);
+	TEST(cow_test);
+	TEST(shm_test);
+	TEST(brk_test);
+	TEST(slab_cache_test);
+	TEST(kmalloc_test);
+	TEST(memtype_bench);
+	TEST(run_queue_test);
+	TEST(wait_queue_test);
+	TEST(timer_wheel_test);
+	TEST(yield_pingpong_bench);
+	TEST(tick_stale_irq_test);
+	TEST(tick_avoided_test);
+	TEST(fpu_switch_test);
+	TEST(apic_timer_test);
+	TEST(percpu_data_test);
+	TEST(cpu_placement_test);
+	TEST(spinlock_ticket_test);
+	TEST(rwlock_test);
+	TEST(spinlock_bench);
+	TEST(tasklet_test);
+	TEST(tasklet_restart_test);
+	TEST(kthread_create_test);
+	TEST(workqueue_test);
+	TEST(procfs_lookup_test);
+	TEST(procfs_read_test);
 
 	printf(
 		"\n"
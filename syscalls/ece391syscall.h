@@ -22,6 +22,37 @@ extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/* mmap maps an open file read-only, sets *start to the mapping and returns
+ * the file's size. munmap takes the address back. */
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_munmap (uint8_t* start);
+
+/* fork returns the child's pid to the parent and 0 to the child. The
+ * child runs alongside the parent and is never waited on. */
+extern int32_t ece391_fork (void);
+
+/* Shared memory: shmget finds or creates the segment for a key (0 always
+ * creates a new one) and returns its id, shmat maps it, sets *start and
+ * returns its size, shmdt unmaps it. A segment goes away with its last
+ * attachment, or when its creator halts if nobody is attached. */
+extern int32_t ece391_shmget (int32_t key, uint32_t size);
+extern int32_t ece391_shmat (int32_t id, uint8_t** start);
+extern int32_t ece391_shmdt (uint8_t* start);
+
+/* Heap: brk sets the end of the heap (NULL just queries it) and returns
+ * the new end, sbrk moves it by increment and returns the old end. */
+extern int32_t ece391_brk (void* end);
+extern int32_t ece391_sbrk (int32_t increment);
+
+/* nanosleep blocks the caller for at least sec seconds plus nsec
+ * nanoseconds (nsec < 1000000000), at the timer's 1ms resolution. */
+extern int32_t ece391_nanosleep (uint32_t sec, uint32_t nsec);
+
+/* set_affinity restricts the caller to the CPUs whose bits are set in mask
+ * (bit n for CPU n), moving it if it runs on another, and returns the
+ * previous mask. It fails if mask allows none of the running CPUs. */
+extern int32_t ece391_set_affinity (uint32_t mask);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
@@ -11,5 +11,15 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    11
+#define SYS_MUNMAP  12
+#define SYS_FORK    13
+#define SYS_SHMGET  14
+#define SYS_SHMAT   15
+#define SYS_SHMDT   16
+#define SYS_BRK     17
+#define SYS_SBRK    18
+#define SYS_NANOSLEEP 19
+#define SYS_SET_AFFINITY 20
 
 #endif /* ECE391SYSNUM_H */
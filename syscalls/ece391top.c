@@ -0,0 +1,213 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+#define MAX_PID 31
+#define NAME_WIDTH 12
+#define NUM_WIDTH 7
+
+/* CPU time and name seen in the previous refresh, for %CPU */
+static uint32_t last_time[MAX_PID + 1];
+static uint8_t last_name[MAX_PID + 1][NAME_WIDTH];
+static uint32_t last_jiffies;
+
+/* Reads a whole proc file into buf, returns 0 on success */
+static int32_t read_proc(const uint8_t* name, uint8_t* buf)
+{
+    int32_t fd, cnt;
+
+    if (-1 == (fd = ece391_open(name)))
+        return -1;
+    cnt = ece391_read(fd, buf, BUFSIZE - 1);
+    ece391_close(fd);
+    if (cnt <= 0)
+        return -1;
+
+    buf[cnt] = '\0';
+    return 0;
+}
+
+/* Finds the "key value" line for key, returns the value or 0 */
+static uint8_t* find_field(uint8_t* buf, const uint8_t* key)
+{
+    uint32_t len = ece391_strlen(key);
+
+    while (*buf != '\0') {
+        if (0 == ece391_strncmp(buf, key, len) && buf[len] == ' ')
+            return buf + len + 1;
+
+        while (*buf != '\0' && *buf != '\n')
+            buf++;
+        if (*buf == '\n')
+            buf++;
+    }
+    return 0;
+}
+
+/* The number in the line for key, 0 if there is none */
+static uint32_t get_num(uint8_t* buf, const uint8_t* key)
+{
+    uint8_t* value = find_field(buf, key);
+    uint32_t num = 0;
+
+    if (value == 0)
+        return 0;
+    while (*value >= '0' && *value <= '9')
+        num = num * 10 + (*value++ - '0');
+    return num;
+}
+
+/* Copies the string in the line for key into out (at most size - 1 chars) */
+static void get_str(uint8_t* buf, const uint8_t* key, uint8_t* out, uint32_t size)
+{
+    uint8_t* value = find_field(buf, key);
+    uint32_t i = 0;
+
+    if (value != 0) {
+        while (i < size - 1 && value[i] != '\0' && value[i] != '\n') {
+            out[i] = value[i];
+            i++;
+        }
+    }
+    out[i] = '\0';
+}
+
+/* Prints s, then spaces up to width (or cut to width - 1 and a space) */
+static void put_col(const uint8_t* s, uint32_t width)
+{
+    uint8_t col[NAME_WIDTH + NUM_WIDTH + 1];
+    uint32_t i;
+
+    for (i = 0; i < width - 1 && s[i] != '\0'; i++)
+        col[i] = s[i];
+    for (; i < width; i++)
+        col[i] = ' ';
+    col[width] = '\0';
+    ece391_fdputs(1, col);
+}
+
+/* Prints a number right-aligned in width, then a space */
+static void put_num(uint32_t num, uint32_t width)
+{
+    uint8_t digits[NUM_WIDTH + 6];
+    uint32_t len;
+
+    ece391_itoa(num, digits, 10);
+    for (len = ece391_strlen(digits); len < width; len++)
+        ece391_fdputs(1, (uint8_t*)" ");
+    ece391_fdputs(1, digits);
+    ece391_fdputs(1, (uint8_t*)" ");
+}
+
+/* Prints "label value  " */
+static void put_stat(const uint8_t* label, uint32_t value)
+{
+    uint8_t digits[NUM_WIDTH + 6];
+
+    ece391_fdputs(1, label);
+    ece391_fdputs(1, (uint8_t*)" ");
+    ece391_fdputs(1, ece391_itoa(value, digits, 10));
+    ece391_fdputs(1, (uint8_t*)"  ");
+}
+
+/* Prints the system summary and one line per task. %CPU is over the time
+ * since the previous call (since boot for the first) */
+static void show(void)
+{
+    uint8_t buf[BUFSIZE];
+    uint8_t name[BUFSIZE];
+    uint8_t proc_name[NAME_WIDTH];
+    uint32_t pid, jiffies, interval, time, hz;
+
+    if (0 != read_proc((uint8_t*)"proc/stat", buf)) {
+        ece391_fdputs(1, (uint8_t*)"can't read proc/stat\n");
+        return;
+    }
+
+    jiffies = get_num(buf, (uint8_t*)"jiffies");
+    interval = jiffies - last_jiffies;
+    if (interval == 0)
+        interval = 1;
+    if (0 == (hz = get_num(buf, (uint8_t*)"hz")))
+        hz = 1;
+
+    put_stat((uint8_t*)"cpus", get_num(buf, (uint8_t*)"cpus"));
+    put_stat((uint8_t*)"tasks", get_num(buf, (uint8_t*)"tasks"));
+    put_stat((uint8_t*)"uptime(s)", jiffies / hz);
+    put_stat((uint8_t*)"idle", get_num(buf, (uint8_t*)"idle"));
+    put_stat((uint8_t*)"ctxt", get_num(buf, (uint8_t*)"ctxt"));
+    ece391_fdputs(1, (uint8_t*)"\n");
+    put_stat((uint8_t*)"timer irqs", get_num(buf, (uint8_t*)"irq0"));
+    put_stat((uint8_t*)"kbd irqs", get_num(buf, (uint8_t*)"irq1"));
+    put_stat((uint8_t*)"ipis", get_num(buf, (uint8_t*)"ipi"));
+    put_stat((uint8_t*)"faults", get_num(buf, (uint8_t*)"minflt") + get_num(buf, (uint8_t*)"majflt"));
+    put_stat((uint8_t*)"free frames", get_num(buf, (uint8_t*)"frames_free"));
+    ece391_fdputs(1, (uint8_t*)"\n\n");
+
+    ece391_fdputs(1, (uint8_t*)"  PID NAME        S CPU    USER     SYS    VCSW   IVCSW SYSCALL  FAULTS  %CPU\n");
+
+    ece391_strcpy(proc_name, (uint8_t*)"proc/");
+    for (pid = 0; pid <= MAX_PID; pid++) {
+        ece391_itoa(pid, proc_name + 5, 10);
+        if (0 != read_proc(proc_name, buf)) {
+            last_time[pid] = 0;
+            continue;
+        }
+
+        time = get_num(buf, (uint8_t*)"utime") + get_num(buf, (uint8_t*)"stime");
+
+        put_num(pid, 5);
+        get_str(buf, (uint8_t*)"name", name, NAME_WIDTH);
+        put_col(name, NAME_WIDTH);
+
+        // The PID was reused since the last refresh, all of its time is new
+        if (time < last_time[pid] || 0 != ece391_strncmp(name, last_name[pid], NAME_WIDTH))
+            last_time[pid] = 0;
+        ece391_strcpy(last_name[pid], name);
+
+        get_str(buf, (uint8_t*)"state", name, 2);
+        put_col(name, 2);
+        put_num(get_num(buf, (uint8_t*)"cpu"), 3);
+        put_num(get_num(buf, (uint8_t*)"utime"), NUM_WIDTH);
+        put_num(get_num(buf, (uint8_t*)"stime"), NUM_WIDTH);
+        put_num(get_num(buf, (uint8_t*)"nvcsw"), NUM_WIDTH);
+        put_num(get_num(buf, (uint8_t*)"nivcsw"), NUM_WIDTH);
+        put_num(get_num(buf, (uint8_t*)"syscalls"), NUM_WIDTH);
+        put_num(get_num(buf, (uint8_t*)"minflt") + get_num(buf, (uint8_t*)"majflt"), NUM_WIDTH);
+        put_num((time - last_time[pid]) * 100 / interval, 5);
+        ece391_fdputs(1, (uint8_t*)"\n");
+
+        last_time[pid] = time;
+    }
+
+    last_jiffies = jiffies;
+}
+
+/* top [n]: shows the tasks once, or n times a second apart */
+int main ()
+{
+    uint8_t buf[BUFSIZE];
+    uint32_t count = 1, i;
+
+    if (0 == ece391_getargs(buf, BUFSIZE) && buf[0] != '\0') {
+        count = 0;
+        for (i = 0; buf[i] >= '0' && buf[i] <= '9'; i++)
+            count = count * 10 + (buf[i] - '0');
+        if (count == 0 || buf[i] != '\0') {
+            ece391_fdputs(1, (uint8_t*)"usage: top [refreshes]\n");
+            return 3;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (i > 0) {
+            ece391_nanosleep(1, 0);
+            ece391_fdputs(1, (uint8_t*)"\n");
+        }
+        show();
+    }
+
+    return 0;
+}